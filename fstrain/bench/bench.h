@@ -0,0 +1,170 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_BENCH_BENCH_H
+#define FSTRAIN_BENCH_BENCH_H
+
+#include <unistd.h> // gethostname
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "fstrain/util/trace.h" // GetMonotonicNanos
+
+namespace fstrain { namespace bench {
+
+/**
+ * @brief A benchmark: SetUp builds the inputs (not timed), Run does
+ * the measured operation num_iterations times.
+ */
+class Benchmark {
+
+ public:
+  typedef boost::shared_ptr<Benchmark> Ptr;
+
+  Benchmark(const std::string& name, const std::string& kind)
+      : name_(name), kind_(kind) {}
+
+  virtual ~Benchmark() {}
+
+  virtual void SetUp() {}
+
+  virtual void Run(long num_iterations) = 0;
+
+  const std::string& Name() const {
+    return name_;
+  }
+
+  /**
+   * @brief "micro" or "macro".
+   */
+  const std::string& Kind() const {
+    return kind_;
+  }
+
+ private:
+  std::string name_;
+  std::string kind_;
+};
+
+struct BenchResult {
+  std::string name;
+  std::string kind;
+  long iterations;            // per repetition
+  std::vector<double> ns_per_op; // one per repetition
+
+  double Median() const {
+    std::vector<double> sorted(ns_per_op);
+    std::sort(sorted.begin(), sorted.end());
+    const std::size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+  }
+
+  double Min() const {
+    return *std::min_element(ns_per_op.begin(), ns_per_op.end());
+  }
+
+  double Max() const {
+    return *std::max_element(ns_per_op.begin(), ns_per_op.end());
+  }
+};
+
+struct BenchOptions {
+  double min_time_ms;  // per repetition
+  int repetitions;
+  BenchOptions() : min_time_ms(200.0), repetitions(5) {}
+};
+
+/**
+ * @brief Sets up the benchmark, finds a number of iterations that
+ * takes at least min_time_ms, then times that many iterations
+ * repeatedly.
+ */
+inline BenchResult RunBenchmark(Benchmark* b, const BenchOptions& opts) {
+  b->SetUp();
+  long n = 1;
+  while (true) {
+    const uint64 start = util::GetMonotonicNanos();
+    b->Run(n);
+    const double elapsed_ms = (util::GetMonotonicNanos() - start) / 1e6;
+    if (elapsed_ms >= opts.min_time_ms) {
+      break;
+    }
+    // aims a bit higher than needed, but at most 100 times as many
+    const double factor = elapsed_ms > 0.0 ? 1.4 * opts.min_time_ms / elapsed_ms : 100.0;
+    n = std::max(n + 1, (long)(n * std::min(factor, 100.0)));
+  }
+  BenchResult result;
+  result.name = b->Name();
+  result.kind = b->Kind();
+  result.iterations = n;
+  for (int r = 0; r < opts.repetitions; ++r) {
+    const uint64 start = util::GetMonotonicNanos();
+    b->Run(n);
+    result.ns_per_op.push_back((double)(util::GetMonotonicNanos() - start) / n);
+  }
+  return result;
+}
+
+inline std::string JsonEscape(const std::string& str) {
+  std::string result;
+  for (std::size_t i = 0; i < str.length(); ++i) {
+    if (str[i] == '"' || str[i] == '\\') {
+      result += '\\';
+    }
+    result += str[i];
+  }
+  return result;
+}
+
+/**
+ * @brief Writes the results as JSON (one benchmark per line, see
+ * scripts/compare-bench.pl).
+ */
+inline void WriteJson(const std::vector<BenchResult>& results,
+                      const BenchOptions& opts, unsigned seed,
+                      std::ostream& out) {
+  char hostname[256] = "";
+  gethostname(hostname, sizeof(hostname) - 1);
+  char date[64];
+  const time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+  out << "{\n";
+  out << "  \"context\": {\"date\": \"" << date << "\", \"host\": \""
+      << JsonEscape(hostname) << "\", \"seed\": " << seed
+      << ", \"min_time_ms\": " << opts.min_time_ms
+      << ", \"repetitions\": " << opts.repetitions << "},\n";
+  out << "  \"benchmarks\": [\n";
+  char buf[256];
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    snprintf(buf, sizeof(buf),
+             "\"iterations\": %ld, \"ns_per_op\": %.1f, \"ns_per_op_min\": %.1f, "
+             "\"ns_per_op_max\": %.1f}",
+             r.iterations, r.Median(), r.Min(), r.Max());
+    out << "    {\"name\": \"" << JsonEscape(r.name) << "\", \"kind\": \""
+        << r.kind << "\", " << buf << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+} } // end namespaces
+
+#endif
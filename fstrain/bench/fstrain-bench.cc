@@ -0,0 +1,591 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+// Times the hot paths of training (semiring operations, composition,
+// forward-backward, the full objective function) and writes the
+// results as JSON. Compare two runs with scripts/compare-bench.pl.
+//
+// The micro benchmarks run on small synthetic machines built from
+// --seed; the macro benchmark additionally runs on a real data file if
+// --data, --isymbols and --osymbols are given.
+
+#include "fst/arcsort.h"
+#include "fst/compose.h"
+#include "fst/symbol-table.h"
+#include "fst/vector-fst.h"
+
+#include "fstrain/bench/bench.h"
+#include "fstrain/core/expectation-arc.h"
+#include "fstrain/core/neg-log-of-signed-num.h"
+#include "fstrain/create/ngram-counter.h"
+#include "fstrain/train/obj-func-fst-conditional.h"
+#include "fstrain/train/obj-func-fst-util.h"
+#include "fstrain/train/set-feature-weights.h"
+#include "fstrain/util/add-maps.h"
+#include "fstrain/util/check-convergence.h"
+#include "fstrain/util/compose-fcts.h"
+#include "fstrain/util/data.h"
+#include "fstrain/util/linear-fst.h"
+#include "fstrain/util/options.h"
+#include "fstrain/util/string-to-fst.h"
+
+#include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+using namespace fst;
+using namespace fstrain;
+using fstrain::bench::Benchmark;
+
+namespace {
+
+const int kNumSymbols = 8;
+const int64 kPhiLabel = -3;
+
+// results go here so that the compiler cannot drop the timed work
+volatile double sink;
+
+SymbolTable* GetSyntheticSymbols() {
+  SymbolTable* syms = new SymbolTable("bench-syms");
+  syms->AddSymbol("eps", 0);
+  for (int i = 1; i <= kNumSymbols; ++i) {
+    syms->AddSymbol(std::string(1, 'a' + i - 1), i);
+  }
+  return syms;
+}
+
+std::string GetRandomString(const SymbolTable& syms, int min_len, int max_len) {
+  const int len = min_len + rand() % (max_len - min_len + 1);
+  std::stringstream ss;
+  for (int i = 0; i < len; ++i) {
+    ss << (i ? " " : "") << syms.Find(1 + rand() % kNumSymbols);
+  }
+  return ss.str();
+}
+
+MDExpectationWeight GetRandomExpectationWeight(int num_features) {
+  MDExpectationWeight w(rand() / (double)RAND_MAX);
+  for (int i = 0; i < num_features; ++i) {
+    w.GetMDExpectations().insert(rand() % (4 * num_features),
+                                 core::NeglogNum(rand() / (double)RAND_MAX));
+  }
+  return w;
+}
+
+/**
+ * @brief One-state edit model: x:y, x:eps and eps:y arcs, each with
+ * its own feature. Also returns parameters for it.
+ */
+void GetEditModel(const SymbolTable& isyms, const SymbolTable& osyms,
+                  MutableFst<MDExpectationArc>* result,
+                  std::vector<double>* params) {
+  typedef MDExpectationArc::Label Label;
+  result->DeleteStates();
+  const MDExpectationArc::StateId s = result->AddState();
+  result->SetStart(s);
+  result->SetFinal(s, MDExpectationWeight::One());
+  std::vector<Label> ilabels(1, 0);
+  std::vector<Label> olabels(1, 0);
+  for (SymbolTableIterator it(isyms); !it.Done(); it.Next()) {
+    if (it.Value() != 0) ilabels.push_back(it.Value());
+  }
+  for (SymbolTableIterator it(osyms); !it.Done(); it.Next()) {
+    if (it.Value() != 0) olabels.push_back(it.Value());
+  }
+  int num_features = 0;
+  for (std::size_t i = 0; i < ilabels.size(); ++i) {
+    for (std::size_t o = 0; o < olabels.size(); ++o) {
+      if (i == 0 && o == 0) {
+        continue;
+      }
+      MDExpectationWeight w = MDExpectationWeight::One();
+      w.GetMDExpectations().insert(num_features++, core::NeglogNum(0.0));
+      result->AddArc(s, MDExpectationArc(ilabels[i], olabels[o], w, s));
+    }
+  }
+  ArcSort(result, ILabelCompare<MDExpectationArc>());
+  params->assign(num_features, 0.0);
+  // same weight on all arcs, low enough that the eps:y loop converges
+  for (int f = 0; f < num_features; ++f) {
+    (*params)[f] = 3.0 + log((double)olabels.size());
+  }
+}
+
+/**
+ * @brief Bigram acceptor with phi backoff: the start state has arcs for
+ * all symbols; each history state has arcs for some symbols and a phi
+ * arc back to the start state.
+ */
+void GetPhiBackoffModel(MutableFst<MDExpectationArc>* result) {
+  typedef MDExpectationArc::StateId StateId;
+  result->DeleteStates();
+  const StateId unigram = result->AddState();
+  result->SetStart(unigram);
+  for (int h = 1; h <= kNumSymbols; ++h) {
+    result->AddState();
+  }
+  for (StateId s = 0; s <= kNumSymbols; ++s) {
+    result->SetFinal(s, MDExpectationWeight::One());
+    for (int b = 1; b <= kNumSymbols; ++b) {
+      if (s == unigram || (s + b) % 3 == 0) {
+        result->AddArc(s, MDExpectationArc(b, b, GetRandomExpectationWeight(2), b));
+      }
+    }
+    if (s != unigram) {
+      result->AddArc(s, MDExpectationArc(kPhiLabel, kPhiLabel,
+                                         MDExpectationWeight::One(), unigram));
+    }
+  }
+}
+
+/**
+ * @brief Input string composed with the edit model, composed with the
+ * output string (the "clamped" machine in training).
+ */
+void GetLattice(const Fst<MDExpectationArc>& model,
+                const std::vector<MDExpectationArc::Label>& input,
+                const std::vector<MDExpectationArc::Label>& output,
+                MutableFst<MDExpectationArc>* result) {
+  util::LinearFst<MDExpectationArc> input_fst(input);
+  util::LinearFst<MDExpectationArc> output_fst(output);
+  VectorFst<MDExpectationArc> unclamped;
+  Compose(input_fst, model, &unclamped);
+  Compose(unclamped, output_fst, result);
+}
+
+class NeglogPlusBenchmark : public Benchmark {
+  std::vector<core::NeglogNum> nums_;
+ public:
+  NeglogPlusBenchmark() : Benchmark("neglog_plus", "micro") {}
+  void SetUp() {
+    for (int i = 0; i < 1024; ++i) {
+      nums_.push_back(core::NeglogNum(rand() / (double)RAND_MAX, rand() % 4 != 0));
+    }
+  }
+  void Run(long n) {
+    core::NeglogNum result(nums_[0]);
+    for (long i = 0; i < n; ++i) {
+      result = core::NeglogPlus(result, nums_[i & 1023]);
+    }
+    sink = result.lx();
+  }
+};
+
+class WeightPlusBenchmark : public Benchmark {
+  std::vector<MDExpectationWeight> weights_;
+ public:
+  WeightPlusBenchmark() : Benchmark("weight_plus", "micro") {}
+  void SetUp() {
+    for (int i = 0; i < 64; ++i) {
+      weights_.push_back(GetRandomExpectationWeight(8));
+    }
+  }
+  void Run(long n) {
+    double sum = 0.0;
+    for (long i = 0; i < n; ++i) {
+      sum += Plus(weights_[i & 63], weights_[(i + 1) & 63]).Value();
+    }
+    sink = sum;
+  }
+};
+
+class WeightTimesBenchmark : public Benchmark {
+  std::vector<MDExpectationWeight> weights_;
+ public:
+  WeightTimesBenchmark() : Benchmark("weight_times", "micro") {}
+  void SetUp() {
+    for (int i = 0; i < 64; ++i) {
+      weights_.push_back(GetRandomExpectationWeight(8));
+    }
+  }
+  void Run(long n) {
+    double sum = 0.0;
+    for (long i = 0; i < n; ++i) {
+      sum += Times(weights_[i & 63], weights_[(i + 1) & 63]).Value();
+    }
+    sink = sum;
+  }
+};
+
+class AddMapsBenchmark : public Benchmark {
+  std::vector<core::MDExpectations> maps_;
+ public:
+  AddMapsBenchmark() : Benchmark("add_maps", "micro") {}
+  void SetUp() {
+    for (int i = 0; i < 64; ++i) {
+      maps_.push_back(GetRandomExpectationWeight(32).GetMDExpectations());
+    }
+  }
+  void Run(long n) {
+    std::size_t size = 0;
+    for (long i = 0; i < n; ++i) {
+      core::MDExpectations result;
+      const core::MDExpectations& m1 = maps_[i & 63];
+      const core::MDExpectations& m2 = maps_[(i + 1) & 63];
+      util::AddMaps(m1.begin(), m1.end(), m2.begin(), m2.end(),
+                    core::NeglogPlus, &result);
+      size += result.size();
+    }
+    sink = size;
+  }
+};
+
+class ConvertStringToFstBenchmark : public Benchmark {
+  boost::scoped_ptr<SymbolTable> syms_;
+  std::vector<std::string> strings_;
+ public:
+  ConvertStringToFstBenchmark() : Benchmark("convert_string_to_fst", "micro") {}
+  void SetUp() {
+    syms_.reset(GetSyntheticSymbols());
+    for (int i = 0; i < 64; ++i) {
+      strings_.push_back(GetRandomString(*syms_, 5, 15));
+    }
+  }
+  void Run(long n) {
+    std::size_t num_states = 0;
+    for (long i = 0; i < n; ++i) {
+      VectorFst<MDExpectationArc> fst;
+      util::ConvertStringToFst(strings_[i & 63], *syms_, &fst);
+      num_states += fst.NumStates();
+    }
+    sink = num_states;
+  }
+};
+
+class LinearFstBenchmark : public Benchmark {
+  boost::scoped_ptr<SymbolTable> syms_;
+  std::vector<std::string> strings_;
+ public:
+  LinearFstBenchmark() : Benchmark("linear_fst", "micro") {}
+  void SetUp() {
+    syms_.reset(GetSyntheticSymbols());
+    for (int i = 0; i < 64; ++i) {
+      strings_.push_back(GetRandomString(*syms_, 5, 15));
+    }
+  }
+  void Run(long n) {
+    std::size_t num_states = 0;
+    std::vector<MDExpectationArc::Label> labels;
+    for (long i = 0; i < n; ++i) {
+      util::ConvertStringToLabels(strings_[i & 63], *syms_, &labels);
+      util::LinearFst<MDExpectationArc> fst(labels);
+      num_states += fst.NumStates();
+    }
+    sink = num_states;
+  }
+};
+
+/**
+ * @brief Composes strings with the phi backoff model, which is on the
+ * left (ComposePhiLeftFct) or on the right (ComposePhiRightFct).
+ */
+class ComposePhiBenchmark : public Benchmark {
+  bool phi_left_;
+  VectorFst<MDExpectationArc> model_;
+  std::vector< std::vector<MDExpectationArc::Label> > strings_;
+ public:
+  explicit ComposePhiBenchmark(bool phi_left)
+      : Benchmark(phi_left ? "compose_phi_left" : "compose_phi_right", "micro"),
+        phi_left_(phi_left) {}
+  void SetUp() {
+    GetPhiBackoffModel(&model_);
+    boost::scoped_ptr<SymbolTable> syms(GetSyntheticSymbols());
+    strings_.resize(64);
+    for (int i = 0; i < 64; ++i) {
+      util::ConvertStringToLabels(GetRandomString(*syms, 5, 15), *syms, &strings_[i]);
+    }
+  }
+  void Run(long n) {
+    util::ComposePhiLeftFct<MDExpectationArc> compose_left(kPhiLabel);
+    util::ComposePhiRightFct<MDExpectationArc> compose_right(kPhiLabel);
+    std::size_t num_states = 0;
+    for (long i = 0; i < n; ++i) {
+      util::LinearFst<MDExpectationArc> str(strings_[i & 63]);
+      VectorFst<MDExpectationArc> result;
+      if (phi_left_) {
+        compose_left(model_, str, &result);
+      }
+      else {
+        compose_right(str, model_, &result);
+      }
+      num_states += result.NumStates();
+    }
+    sink = num_states;
+  }
+};
+
+/**
+ * @brief Forward-backward over a clamped lattice (input and output
+ * string composed with the edit model).
+ */
+class GetFeatureMDExpectationsBenchmark : public Benchmark {
+  VectorFst<MDExpectationArc> lattice_;
+  std::vector<double> gradients_;
+ public:
+  GetFeatureMDExpectationsBenchmark()
+      : Benchmark("get_feature_md_expectations", "micro") {}
+  void SetUp() {
+    boost::scoped_ptr<SymbolTable> syms(GetSyntheticSymbols());
+    VectorFst<MDExpectationArc> model;
+    std::vector<double> params;
+    GetEditModel(*syms, *syms, &model, &params);
+    train::SetFeatureWeights(&params[0], &model);
+    std::vector<MDExpectationArc::Label> input, output;
+    util::ConvertStringToLabels(GetRandomString(*syms, 10, 10), *syms, &input);
+    util::ConvertStringToLabels(GetRandomString(*syms, 10, 10), *syms, &output);
+    GetLattice(model, input, output, &lattice_);
+    gradients_.resize(params.size());
+  }
+  void Run(long n) {
+    using train::nsObjectiveFunctionFstUtil::GetFeatureMDExpectations;
+    double sum = 0.0;
+    for (long i = 0; i < n; ++i) {
+      double* gradients = &gradients_[0];
+      long timelimit = -1;
+      sum += GetFeatureMDExpectations<double, double*>(
+          lattice_, &gradients, gradients_.size(), false, 1.0, 1e-10, &timelimit);
+    }
+    sink = sum;
+  }
+};
+
+class SetFeatureWeightsBenchmark : public Benchmark {
+  VectorFst<MDExpectationArc> model_;
+  std::vector<double> params_;
+ public:
+  SetFeatureWeightsBenchmark() : Benchmark("set_feature_weights", "micro") {}
+  void SetUp() {
+    boost::scoped_ptr<SymbolTable> syms(GetSyntheticSymbols());
+    GetEditModel(*syms, *syms, &model_, &params_);
+  }
+  void Run(long n) {
+    for (long i = 0; i < n; ++i) {
+      train::SetFeatureWeights(&params_[0], &model_);
+    }
+    sink = model_.NumStates();
+  }
+};
+
+/**
+ * @brief Counts trigrams in sausage-shaped alignment lattices (two or
+ * three alternatives per position).
+ */
+class NgramCounterBenchmark : public Benchmark {
+  std::vector< VectorFst<LogArc> > lattices_;
+ public:
+  NgramCounterBenchmark() : Benchmark("ngram_counter_add_counts", "micro") {}
+  void SetUp() {
+    lattices_.resize(16);
+    for (int i = 0; i < 16; ++i) {
+      VectorFst<LogArc>& lattice = lattices_[i];
+      LogArc::StateId s = lattice.AddState();
+      lattice.SetStart(s);
+      for (int pos = 0; pos < 10; ++pos) {
+        const LogArc::StateId next = lattice.AddState();
+        const int num_alternatives = 2 + rand() % 2;
+        for (int a = 0; a < num_alternatives; ++a) {
+          lattice.AddArc(s, LogArc(1 + rand() % kNumSymbols, 1 + rand() % kNumSymbols,
+                                   log((double)num_alternatives), next));
+        }
+        s = next;
+      }
+      lattice.SetFinal(s, LogArc::Weight::One());
+    }
+  }
+  void Run(long n) {
+    create::NgramCounter<LogArc> counter(3);
+    for (long i = 0; i < n; ++i) {
+      counter.AddCounts(lattices_[i & 15]);
+    }
+    VectorFst<LogArc> result;
+    counter.GetResult(&result);
+    sink = result.NumStates();
+  }
+};
+
+class CheckConvergenceBenchmark : public Benchmark {
+  VectorFst<MDExpectationArc> model_;
+ public:
+  CheckConvergenceBenchmark() : Benchmark("check_convergence", "micro") {}
+  void SetUp() {
+    boost::scoped_ptr<SymbolTable> syms(GetSyntheticSymbols());
+    std::vector<double> params;
+    GetEditModel(*syms, *syms, &model_, &params);
+    train::SetFeatureWeights(&params[0], &model_);
+  }
+  void Run(long n) {
+    int num_converged = 0;
+    for (long i = 0; i < n; ++i) {
+      num_converged += util::CheckConvergence(model_) ? 1 : 0;
+    }
+    sink = num_converged;
+  }
+};
+
+/**
+ * @brief One full objective function evaluation (set the parameters,
+ * forward-backward over all examples), as in each training iteration.
+ */
+class ComputeGradientsBenchmark : public Benchmark {
+  std::string data_filename_;
+  std::string isymbols_filename_;
+  std::string osymbols_filename_;
+  boost::scoped_ptr<train::ObjectiveFunctionFstConditional> obj_;
+  std::vector<double> params_;
+ public:
+  ComputeGradientsBenchmark()
+      : Benchmark("compute_gradients/synthetic", "macro") {}
+  ComputeGradientsBenchmark(const std::string& data_filename,
+                            const std::string& isymbols_filename,
+                            const std::string& osymbols_filename)
+      : Benchmark("compute_gradients/data", "macro"),
+        data_filename_(data_filename),
+        isymbols_filename_(isymbols_filename),
+        osymbols_filename_(osymbols_filename) {}
+  void SetUp() {
+    SymbolTable* isyms;
+    SymbolTable* osyms;
+    util::Data* data;
+    if (data_filename_.empty()) {
+      isyms = GetSyntheticSymbols();
+      osyms = GetSyntheticSymbols();
+      data = new util::Data();
+      for (int i = 0; i < 100; ++i) {
+        data->push_back(GetRandomString(*isyms, 3, 8), GetRandomString(*osyms, 3, 8));
+      }
+    }
+    else {
+      isyms = SymbolTable::ReadText(isymbols_filename_);
+      osyms = SymbolTable::ReadText(osymbols_filename_);
+      data = new util::Data(data_filename_);
+    }
+    VectorFst<MDExpectationArc>* model = new VectorFst<MDExpectationArc>();
+    GetEditModel(*isyms, *osyms, model, &params_);
+    util::options["slow-examples-top-k"] = 0; // no report in the timed runs
+    obj_.reset(new train::ObjectiveFunctionFstConditional(model, data, isyms, osyms));
+  }
+  void Run(long n) {
+    double sum = 0.0;
+    for (long i = 0; i < n; ++i) {
+      obj_->SetParameters(&params_[0]);
+      sum += obj_->GetFunctionValue();
+    }
+    sink = sum;
+  }
+};
+
+} // end namespace
+
+int main(int ac, char** av) {
+  try{
+
+    po::options_description generic("Allowed options");
+    generic.add_options()
+        ("help", "produce help message")
+        ("filter", po::value<std::string>(), "only run benchmarks whose name contains this")
+        ("min-time-ms", po::value<double>()->default_value(200.0), "minimum time per repetition")
+        ("repetitions", po::value<int>()->default_value(5), "number of timed repetitions")
+        ("seed", po::value<unsigned>()->default_value(1), "random seed for the synthetic inputs")
+        ("output", po::value<std::string>(), "write JSON here (default: stdout)")
+        ("data", po::value<std::string>(), "data file for the macro benchmark")
+        ("isymbols", po::value<std::string>(), "symbol table for input words (with --data)")
+        ("osymbols", po::value<std::string>(), "symbol table for output words (with --data)")
+        ;
+
+    po::variables_map vm;
+    store(po::command_line_parser(ac, av).options(generic).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << "Usage: " << av[0] << " [options]\n";
+      std::cout << generic << "\n";
+      return EXIT_FAILURE;
+    }
+
+    if (vm.count("data") && (vm.count("isymbols") == 0 || vm.count("osymbols") == 0)) {
+      std::cerr << "Please specify symbol tables with --isymbols and --osymbols" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    bench::BenchOptions opts;
+    opts.min_time_ms = vm["min-time-ms"].as<double>();
+    opts.repetitions = vm["repetitions"].as<int>();
+    const unsigned seed = vm["seed"].as<unsigned>();
+    const std::string filter = vm.count("filter") ? vm["filter"].as<std::string>() : "";
+
+    std::vector<Benchmark::Ptr> benchmarks;
+    benchmarks.push_back(Benchmark::Ptr(new NeglogPlusBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new WeightPlusBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new WeightTimesBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new AddMapsBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new ConvertStringToFstBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new LinearFstBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new ComposePhiBenchmark(true)));
+    benchmarks.push_back(Benchmark::Ptr(new ComposePhiBenchmark(false)));
+    benchmarks.push_back(Benchmark::Ptr(new GetFeatureMDExpectationsBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new SetFeatureWeightsBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new NgramCounterBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new CheckConvergenceBenchmark()));
+    benchmarks.push_back(Benchmark::Ptr(new ComputeGradientsBenchmark()));
+    if (vm.count("data")) {
+      benchmarks.push_back(Benchmark::Ptr(
+          new ComputeGradientsBenchmark(vm["data"].as<std::string>(),
+                                        vm["isymbols"].as<std::string>(),
+                                        vm["osymbols"].as<std::string>())));
+    }
+
+    std::vector<bench::BenchResult> results;
+    for (std::size_t i = 0; i < benchmarks.size(); ++i) {
+      if (benchmarks[i]->Name().find(filter) == std::string::npos) {
+        continue;
+      }
+      srand(seed); // same inputs for each benchmark, whatever runs before
+      results.push_back(bench::RunBenchmark(benchmarks[i].get(), opts));
+      fprintf(stderr, "%-32s %12.1f ns/op (%ld iterations)\n",
+              results.back().name.c_str(), results.back().Median(),
+              results.back().iterations);
+      benchmarks[i].reset(); // frees the inputs
+    }
+
+    if (vm.count("output")) {
+      const std::string filename = vm["output"].as<std::string>();
+      std::ofstream out(filename.c_str());
+      if (!out) {
+        std::cerr << "Could not write to " << filename << std::endl;
+        return EXIT_FAILURE;
+      }
+      bench::WriteJson(results, opts, seed, out);
+    }
+    else {
+      bench::WriteJson(results, opts, seed, std::cout);
+    }
+
+  }
+  catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -50,6 +50,10 @@ class MDExpectationWeight : public MDExpectationWeightBase {
   }
 
   MDExpectationWeight& operator= (const MDExpectationWeight& other) {
+    if (expectations_ == other.expectations_) { // no refcount traffic
+      SetValue(other.Value());
+      return *this;
+    }
     MDExpectations* const old = expectations_;
     expectations_ = other.expectations_;
     if (expectations_ != 0)
@@ -68,7 +72,10 @@ class MDExpectationWeight : public MDExpectationWeightBase {
     }
   }
 
-  // void SetValue(double v) { value_ = v; }
+  /**
+   * @brief Sets the value; the expectations stay.
+   */
+  using MDExpectationWeightBase::SetValue;
 
   const MDExpectations& GetMDExpectations() const {
     if (expectations_ == 0) {
@@ -82,6 +89,7 @@ class MDExpectationWeight : public MDExpectationWeightBase {
       expectations_ = new MDExpectations();
     }
     if (expectations_->getCount() > 1) {
+      FSTR_COUNT_OP(fstrain::core::kOpExpectationsClone);
       MDExpectations* d = new MDExpectations(*expectations_);
       expectations_->decCount();
       expectations_ = d;
@@ -90,6 +98,40 @@ class MDExpectationWeight : public MDExpectationWeightBase {
     return *expectations_;
   }
 
+  /**
+   * @brief Exchanges the contents of two weights without touching the
+   * reference counts (use instead of assigning a temporary).
+   */
+  void Swap(MDExpectationWeight& other) {
+    std::swap(expectations_, other.expectations_);
+    const double value = Value();
+    SetValue(other.Value());
+    other.SetValue(value);
+  }
+
+  /**
+   * @brief Makes this weight share the expectations of other, which
+   * must be equal to its own (see util::InternExpectations); the
+   * value stays.
+   */
+  void ShareMDExpectations(const MDExpectationWeight& other) {
+    MDExpectations* const old = expectations_;
+    expectations_ = other.expectations_;
+    if (expectations_ != 0)
+      expectations_->incCount();
+    if (old != 0 && old->decCount() == 0) {
+      delete old;
+    }
+  }
+
+  /**
+   * @brief The shared expectations object (NULL if there are no
+   * expectations); weights that share it return the same pointer.
+   */
+  const MDExpectations* GetMDExpectationsId() const {
+    return expectations_;
+  }
+
   static const MDExpectationWeight Zero() {
     return MDExpectationWeight(fstrain::core::kPosInfinity); }
 
@@ -114,7 +156,7 @@ class MDExpectationWeight : public MDExpectationWeightBase {
     }
     const MDExpectations& e = GetMDExpectations();
     for (MDExpectations::const_iterator it = e.begin(); it != e.end(); ++it) {
-      const double neglog_val = it->second.lx;
+      const double neglog_val = it->second.lx();
       bool is_member = neglog_val == neglog_val
           && neglog_val != FloatLimits<double>::NegInfinity();
       if (!is_member) {
@@ -156,7 +198,8 @@ class MDExpectationWeight : public MDExpectationWeightBase {
       double expectation;
       ReadType(strm, &index);
       ReadType(strm, &expectation);
-      GetMDExpectations().insert(index, NeglogNum(expectation));
+      const bool sign = index >= 0; // see Write
+      GetMDExpectations().insert(sign ? index : ~index, NeglogNum(expectation, sign));
     }
     return strm;
   }
@@ -166,9 +209,12 @@ class MDExpectationWeight : public MDExpectationWeightBase {
     WriteType(strm, (int64)(GetMDExpectations().size()));
     for (MDExpectations::const_iterator it=GetMDExpectations().begin();
         it != GetMDExpectations().end(); ++it) {
-      WriteType(strm, (int64)(it->first)); // write all the expectations that fire
-      // TODO: write sign too
-      WriteType(strm, (it->second.lx));
+      // write all the expectations that fire; negative expectations
+      // have their (non-negative) index complemented, so files
+      // written before the sign was stored read the same
+      const int64 index = it->first;
+      WriteType(strm, it->second.sign_x() ? index : ~index);
+      WriteType(strm, (it->second.lx()));
     }
     return strm;
   }
@@ -178,8 +224,8 @@ class MDExpectationWeight : public MDExpectationWeightBase {
     boost::hash_combine(seed, Value());
     const MDExpectations& e = GetMDExpectations();
     for (MDExpectations::const_iterator it = e.begin(); it != e.end(); ++it) {
-      boost::hash_combine(seed, it->second.lx);
-      boost::hash_combine(seed, it->second.sign_x);
+      boost::hash_combine(seed, it->second.lx());
+      boost::hash_combine(seed, it->second.sign_x());
     }
     return seed;
   }
@@ -197,18 +243,34 @@ class MDExpectationWeight : public MDExpectationWeightBase {
 
 };
 
-inline MDExpectationWeight Plus(const MDExpectationWeight &w1, const MDExpectationWeight &w2) {
-  using namespace fstrain::core;
-  double f1 = w1.Value(), f2 = w2.Value(), f3 = 0.0f;
+namespace nsExpectationWeightUtil {
+
+inline double PlusValue(double f1, double f2) {
   if (f1 == fstrain::core::kPosInfinity)
-    f3 = f2;
+    return f2;
   else if (f2 == fstrain::core::kPosInfinity)
-    f3 = f1;
+    return f1;
   else if (f1 > f2)
-    f3 = f2 - LogExp(f1 - f2);
+    return f2 - LogExp(f1 - f2);
   else
-    f3 = f1 - LogExp(f2 - f1);
-  MDExpectationWeight w3(f3);
+    return f1 - LogExp(f2 - f1);
+}
+
+inline double TimesValue(double f1, double f2) {
+  if (f1 == fstrain::core::kPosInfinity)
+    return f1;
+  else if (f2 == fstrain::core::kPosInfinity)
+    return f2;
+  else
+    return f1 + f2;
+}
+
+} // end namespace nsExpectationWeightUtil
+
+inline MDExpectationWeight Plus(const MDExpectationWeight &w1, const MDExpectationWeight &w2) {
+  using namespace fstrain::core;
+  FSTR_COUNT_OP(kOpWeightPlus);
+  MDExpectationWeight w3(nsExpectationWeightUtil::PlusValue(w1.Value(), w2.Value()));
   fstrain::util::AddMaps(w1.GetMDExpectations().begin(), w1.GetMDExpectations().end(),
                          w2.GetMDExpectations().begin(), w2.GetMDExpectations().end(),
                          NeglogPlus,
@@ -225,6 +287,7 @@ struct NeglogTimesFct {
 
 inline MDExpectationWeight Times(const MDExpectationWeight &w1, const MDExpectationWeight &w2) {
   using namespace fstrain::core;
+  FSTR_COUNT_OP(kOpWeightTimes);
   double f1 = w1.Value();
   // speedup
   if (f1 == 0.0 && w1.GetMDExpectations().size() == 0) {
@@ -234,14 +297,7 @@ inline MDExpectationWeight Times(const MDExpectationWeight &w1, const MDExpectat
   if (f2 == 0.0 && w2.GetMDExpectations().size() == 0) {
     return w1;
   }
-  double f3;
-  if (f1 == fstrain::core::kPosInfinity)
-    f3 = f1;
-  else if (f2 == fstrain::core::kPosInfinity)
-    f3 = f2;
-  else
-    f3 = f1 + f2;
-  MDExpectationWeight w3(f3);
+  MDExpectationWeight w3(nsExpectationWeightUtil::TimesValue(f1, f2));
   // lazy multiplication with scalar:
   typedef fstrain::util::MultipliedMap<MDExpectationWeight::MDExpectations, NeglogTimesFct> MyMultipliedMap;
   MyMultipliedMap v1_times_p2(w1.GetMDExpectations(), NeglogTimesFct(), NeglogNum(w2.Value()));
@@ -253,12 +309,198 @@ inline MDExpectationWeight Times(const MDExpectationWeight &w1, const MDExpectat
   return w3;
 }
 
+/*
+ * In-place versions of Plus and Times. They update the expectations of
+ * the first weight in one pass over both sorted maps and only allocate
+ * for features it does not have yet (or to copy expectations that are
+ * shared, see GetMDExpectations). The results are the same as from
+ * Plus and Times. The weights passed must not alias each other.
+ */
+
+namespace nsExpectationWeightUtil {
+
+inline bool IsOne(const MDExpectationWeight& w) {
+  return w.Value() == 0.0 && w.GetMDExpectations().size() == 0;
+}
+
+/**
+ * @brief Calls fct(index, value) for the expectations of Times(w1, w2)
+ * in index order, without building them.
+ */
+template<class Fct>
+void ForEachTimesExpectation(const MDExpectationWeight& w1,
+                             const MDExpectationWeight& w2,
+                             Fct& fct) {
+  using namespace fstrain::core;
+  typedef MDExpectationWeight::MDExpectations MDExpectations;
+  const MDExpectations& e1 = w1.GetMDExpectations();
+  const MDExpectations& e2 = w2.GetMDExpectations();
+  const NeglogNum p1(w1.Value()), p2(w2.Value());
+  MDExpectations::const_iterator it1 = e1.begin(), it2 = e2.begin();
+  while (it1 != e1.end() && it2 != e2.end()) {
+    if (it1->first < it2->first) {
+      fct(it1->first, NeglogTimes(it1->second, p2));
+      ++it1;
+    }
+    else if (it2->first < it1->first) {
+      fct(it2->first, NeglogTimes(it2->second, p1));
+      ++it2;
+    }
+    else {
+      fct(it1->first, NeglogPlus(NeglogTimes(it1->second, p2),
+                                 NeglogTimes(it2->second, p1)));
+      ++it1;
+      ++it2;
+    }
+  }
+  for (; it1 != e1.end(); ++it1) {
+    fct(it1->first, NeglogTimes(it1->second, p2));
+  }
+  for (; it2 != e2.end(); ++it2) {
+    fct(it2->first, NeglogTimes(it2->second, p1));
+  }
+}
+
+/**
+ * @brief Adds (index, value) pairs, given in index order, to a map.
+ */
+struct AddToExpectations {
+  typedef MDExpectationWeight::MDExpectations MDExpectations;
+  MDExpectations& e;
+  MDExpectations::iterator pos;
+  explicit AddToExpectations(MDExpectations& e_) : e(e_), pos(e_.begin()) {}
+  void operator()(int index, const fstrain::core::NeglogNum& value) {
+    while (pos != e.end() && pos->first < index) {
+      ++pos;
+    }
+    if (pos != e.end() && pos->first == index) {
+      pos->second = fstrain::core::NeglogPlus(pos->second, value);
+    }
+    else {
+      pos = e.insert(pos, std::make_pair(index, value));
+    }
+  }
+};
+
+/**
+ * @brief Checks if adding (index, value) pairs, given in index order,
+ * would change a map by more than delta.
+ */
+struct AddChangesExpectations {
+  typedef MDExpectationWeight::MDExpectations MDExpectations;
+  const MDExpectations& e;
+  MDExpectations::const_iterator pos;
+  double delta;
+  bool changes;
+  AddChangesExpectations(const MDExpectations& e_, double delta_)
+      : e(e_), pos(e_.begin()), delta(delta_), changes(false) {}
+  void operator()(int index, const fstrain::core::NeglogNum& value) {
+    while (pos != e.end() && pos->first < index) {
+      ++pos;
+    }
+    if (pos == e.end() || pos->first != index) {
+      changes = true; // a new feature
+    }
+    else if (!fstrain::core::ApproxEqual(
+        pos->second, fstrain::core::NeglogPlus(pos->second, value), delta)) {
+      changes = true;
+    }
+  }
+};
+
+} // end namespace nsExpectationWeightUtil
+
+/**
+ * @brief *w1 = Plus(*w1, w2).
+ */
+inline void PlusEq(MDExpectationWeight* w1, const MDExpectationWeight& w2) {
+  using namespace nsExpectationWeightUtil;
+  FSTR_COUNT_OP(fstrain::core::kOpWeightPlus);
+  const double value = PlusValue(w1->Value(), w2.Value());
+  if (w2.GetMDExpectations().size() > 0) {
+    AddToExpectations add(w1->GetMDExpectations());
+    const MDExpectationWeight::MDExpectations& e2 = w2.GetMDExpectations();
+    for (MDExpectationWeight::MDExpectations::const_iterator it = e2.begin();
+         it != e2.end(); ++it) {
+      add(it->first, it->second);
+    }
+  }
+  w1->SetValue(value);
+}
+
+/**
+ * @brief *w1 = Times(*w1, w2).
+ */
+inline void TimesEq(MDExpectationWeight* w1, const MDExpectationWeight& w2) {
+  using namespace fstrain::core;
+  using namespace nsExpectationWeightUtil;
+  FSTR_COUNT_OP(kOpWeightTimes);
+  if (IsOne(w2)) {
+    return;
+  }
+  if (IsOne(*w1)) {
+    *w1 = w2;
+    return;
+  }
+  const NeglogNum p1(w1->Value()), p2(w2.Value());
+  const double value = TimesValue(w1->Value(), w2.Value());
+  if (w1->GetMDExpectations().size() > 0 || w2.GetMDExpectations().size() > 0) {
+    MDExpectationWeight::MDExpectations& e1 = w1->GetMDExpectations();
+    for (MDExpectationWeight::MDExpectations::iterator it = e1.begin(); it != e1.end(); ++it) {
+      it->second = NeglogTimes(it->second, p2);
+    }
+    AddToExpectations add(e1);
+    const MDExpectationWeight::MDExpectations& e2 = w2.GetMDExpectations();
+    for (MDExpectationWeight::MDExpectations::const_iterator it = e2.begin();
+         it != e2.end(); ++it) {
+      add(it->first, NeglogTimes(it->second, p1));
+    }
+  }
+  w1->SetValue(value);
+}
+
+/**
+ * @brief *w = Plus(*w, Times(w1, w2)), without building Times(w1, w2)
+ * (fused multiply-accumulate).
+ */
+inline void PlusTimesEq(MDExpectationWeight* w,
+                        const MDExpectationWeight& w1,
+                        const MDExpectationWeight& w2) {
+  using namespace nsExpectationWeightUtil;
+  FSTR_COUNT_OP(fstrain::core::kOpWeightPlus);
+  FSTR_COUNT_OP(fstrain::core::kOpWeightTimes);
+  const double value = PlusValue(w->Value(), TimesValue(w1.Value(), w2.Value()));
+  if (w1.GetMDExpectations().size() > 0 || w2.GetMDExpectations().size() > 0) {
+    AddToExpectations add(w->GetMDExpectations());
+    ForEachTimesExpectation(w1, w2, add);
+  }
+  w->SetValue(value);
+}
+
+/**
+ * @brief Same as ApproxEqual(w, Plus(w, Times(w1, w2)), delta), but
+ * without building the sum.
+ */
+inline bool ApproxEqualPlusTimes(const MDExpectationWeight& w,
+                                 const MDExpectationWeight& w1,
+                                 const MDExpectationWeight& w2,
+                                 float delta = fst::kDelta) {
+  using namespace nsExpectationWeightUtil;
+  const double value = PlusValue(w.Value(), TimesValue(w1.Value(), w2.Value()));
+  if (!fstrain::core::ApproxEqual(w.Value(), value, delta)) {
+    return false;
+  }
+  AddChangesExpectations check(w.GetMDExpectations(), delta);
+  ForEachTimesExpectation(w1, w2, check);
+  return !check.changes;
+}
+
 inline MDExpectationWeight OneOver(const MDExpectationWeight& w) {
   using namespace fstrain::core;
   NeglogNum one_over_p = NeglogDivide(NeglogNum(0.0),
                                       NeglogNum(w.Value()));
-  NeglogNum minus_one_over_p = NeglogNum(one_over_p.lx, false);
-  MDExpectationWeight result(one_over_p.lx);
+  NeglogNum minus_one_over_p = NeglogNum(one_over_p.lx(), false);
+  MDExpectationWeight result(one_over_p.lx());
   const MDExpectations& in = w.GetMDExpectations();
   MDExpectations& out = result.GetMDExpectations();
   for (MDExpectations::const_iterator it = in.begin(); it != in.end(); ++it) {
@@ -27,6 +27,7 @@
 #include <set>
 #include <cmath>
 #include <stdexcept>
+#include "fstrain/core/op-counters.h"
 #include "fstrain/core/util.h"
 #include "fst/compat.h"
 #include "fstrain/core/neg-log-of-signed-num.h"
@@ -45,9 +46,13 @@ class MDExpectations {
   typedef Container::mapped_type mapped_type; // typed of mapped data
   typedef Container::value_type value_type;   // type of key/value pair
 
-  MDExpectations() : count_(1) {}
+  MDExpectations() : count_(1), interned_(false) {
+    FSTR_COUNT_OP(kOpExpectationsAlloc);
+  }
 
-  MDExpectations(const MDExpectations& other) : count_(1) {
+  MDExpectations(const MDExpectations& other)
+      : count_(1), interned_(other.interned_) {
+    FSTR_COUNT_OP(kOpExpectationsAlloc);
     expectations_ = other.get();
   }
 
@@ -55,7 +60,8 @@ class MDExpectations {
 
   /**
    * Inserts a set of expectations
-   * @param s The string that describes the expectations, e.g. [0=0.69123,12=-3.4524]
+   * @param s The string that describes the expectations, e.g. [0=0.69123,12=-3.4524,13=!0.5]
+   * (the '!' marks a negative number)
    */
   void insert(const std::string& s) {
     char delims[] = ",";
@@ -68,8 +74,9 @@ class MDExpectations {
         std::string indexStr = entryStr.substr(0,equalSignPos);
         int index = stringToUnsignedLong(indexStr);
         std::string vStr = entryStr.substr(equalSignPos+1);
-        double v = stringToDouble(vStr);
-        insert(index, NeglogNum(v));
+        const bool sign = vStr.empty() || vStr[0] != '!'; // see operator<<(NeglogNum)
+        double v = stringToDouble(sign ? vStr : vStr.substr(1));
+        insert(index, NeglogNum(v, sign));
       }
       else{
         throw std::runtime_error("Format error in expectations");
@@ -102,6 +109,14 @@ class MDExpectations {
     expectations_.insert(first, last);
   }
 
+  /**
+   * @brief Inserts v right before hint, which must be its sorted
+   * position (amortized constant time).
+   */
+  iterator insert(iterator hint, const value_type& v) {
+    return expectations_.insert(hint, v);
+  }
+
   void insert(int i, NeglogNum d) {
     if (d == kPosInfinity) {
       expectations_.erase(i);
@@ -163,6 +178,14 @@ class MDExpectations {
 
   unsigned getCount() const { return count_; }
 
+  /**
+   * @brief Marks expectations that util::InternExpectations made
+   * shared by several arcs; copies keep the mark.
+   */
+  void setInterned() const { interned_ = true; }
+
+  bool isInterned() const { return interned_; }
+
   unsigned incCount() { return __sync_add_and_fetch(&count_, 1); }
   unsigned decCount() {
     if (count_ > 0)
@@ -188,6 +211,7 @@ class MDExpectations {
 
   Container expectations_;
   unsigned count_;
+  mutable bool interned_; // not part of the value
 
 }; // end class MDExpectations
 
@@ -197,7 +221,7 @@ inline bool ApproxEqual(double d1, double d2, double delta) {
 
 inline bool ApproxEqual(NeglogNum d1, NeglogNum d2,
                         double delta) {
-  return d1.sign_x == d2.sign_x && ApproxEqual(d1.lx, d2.lx, delta);
+  return d1.sign_x() == d2.sign_x() && ApproxEqual(d1.lx(), d2.lx(), delta);
 }
 
 inline bool ApproxEqual(const MDExpectations& e1,
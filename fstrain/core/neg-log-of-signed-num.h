@@ -18,21 +18,28 @@
 #include <climits>
 #include <cmath>
 #include <cassert>
+#include <cstring>
+#include <limits>
+#include "fst/compat.h" // uint64
+#include "fstrain/core/op-counters.h"
 #include "fstrain/core/util.h"
 
 namespace fstrain { namespace core {
 
 /**
  * @brief Represents a positive or negative number x in log space.
+ *
+ * Packed into 8 bytes: -log(abs(x)) as a double whose lowest mantissa
+ * bit holds the sign, so lx() may be off by one ulp. Zero and
+ * infinite numbers (lx() is +/-inf) and NaN are always positive.
  */
-struct NeglogNum {
-  double lx;        // -log(abs(x))
-  bool sign_x;      // sign of x (true means plus)
+class NeglogNum {
+
+ public:
 
   NeglogNum()
       // : lx(std::numeric_limits<double>::infinity()),
-      : lx(kPosInfinity),
-        sign_x(true) {}
+      : bits_(Pack(kPosInfinity, true)) {}
 
   /**
    * @brief Constructor.
@@ -44,7 +51,7 @@ struct NeglogNum {
    * negative.
    */
   NeglogNum(double lx_, bool sign_x_ = true)
-      : lx(lx_), sign_x(sign_x_) {}
+      : bits_(Pack(lx_, sign_x_)) {}
 
   static const NeglogNum Zero() {
     return NeglogNum(std::numeric_limits<double>::infinity());
@@ -53,6 +60,49 @@ struct NeglogNum {
   static const NeglogNum One() {
     return NeglogNum(0.0F);
   }
+
+  /**
+   * @brief -log(abs(x)).
+   */
+  double lx() const {
+    uint64 bits = bits_;
+    if (IsFinite(bits)) {
+      bits &= ~kSignBit;
+    }
+    double result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+  }
+
+  /**
+   * @brief Sign of x (true means plus).
+   */
+  bool sign_x() const {
+    return !IsFinite(bits_) || (bits_ & kSignBit) == 0;
+  }
+
+ private:
+
+  static const uint64 kSignBit = 1; // lowest mantissa bit; set if x < 0
+  static const uint64 kExponentMask = 0x7ff0000000000000ULL;
+
+  static bool IsFinite(uint64 bits) {
+    return (bits & kExponentMask) != kExponentMask;
+  }
+
+  static uint64 Pack(double lx, bool sign_x) {
+    uint64 bits;
+    std::memcpy(&bits, &lx, sizeof(bits));
+    if (IsFinite(bits)) {
+      bits &= ~kSignBit;
+      if (!sign_x) {
+        bits |= kSignBit;
+      }
+    }
+    return bits;
+  }
+
+  uint64 bits_;
 };
 
 //NeglogNum NeglogOfPosNum(double l) { return NeglogNum(l); }
@@ -60,7 +110,7 @@ struct NeglogNum {
 
 inline bool operator==(const NeglogNum& a,
 		       const NeglogNum& b) {
-  return a.lx == b.lx && a.sign_x == b.sign_x;
+  return a.lx() == b.lx() && a.sign_x() == b.sign_x();
 }
 inline bool operator!=(const NeglogNum& a,
 		       const NeglogNum& b) {
@@ -72,32 +122,33 @@ inline bool operator!=(const NeglogNum& a,
  * NeglogNum(-log(0.5), false).
  */
 inline double GetOrigNum(const NeglogNum& n) {
-  return (n.sign_x ? 1.0 : -1.0) * exp(-n.lx);
+  return (n.sign_x() ? 1.0 : -1.0) * exp(-n.lx());
 }
 
 inline std::ostream& operator<<(std::ostream& out, const NeglogNum& n) {
-  out << (n.sign_x || n.lx == 0 ? "" : "!") // the '!' marks that a negative num is represented
-      << n.lx;
+  out << (n.sign_x() || n.lx() == 0 ? "" : "!") // the '!' marks that a negative num is represented
+      << n.lx();
   return out;
 }
 
 inline NeglogNum NeglogPlus_(const NeglogNum& a,
 			     const NeglogNum& b) {
-  assert(a.lx <= b.lx);
-  double factor = a.sign_x == b.sign_x ? 1.0 : -1.0;
-  return NeglogNum(a.lx - log1p(factor * exp(a.lx - b.lx)),
-		   a.sign_x);
+  assert(a.lx() <= b.lx());
+  double factor = a.sign_x() == b.sign_x() ? 1.0 : -1.0;
+  return NeglogNum(a.lx() - log1p(factor * exp(a.lx() - b.lx())),
+		   a.sign_x());
 }
 
 inline NeglogNum NeglogPlus(const NeglogNum& a,
 			    const NeglogNum& b) {
-  if (a.lx == std::numeric_limits<double>::infinity()) {
+  FSTR_COUNT_OP(kOpNeglogPlus);
+  if (a.lx() == std::numeric_limits<double>::infinity()) {
     return b;
   }
-  if (b.lx == std::numeric_limits<double>::infinity()) {
+  if (b.lx() == std::numeric_limits<double>::infinity()) {
     return a;
   }
-  if (a.lx <= b.lx) {
+  if (a.lx() <= b.lx()) {
     return NeglogPlus_(a, b);
   }
   else {
@@ -106,40 +157,40 @@ inline NeglogNum NeglogPlus(const NeglogNum& a,
 }
 inline NeglogNum NeglogTimes(const NeglogNum& a,
 			     const NeglogNum& b) {
-  if (a.lx == std::numeric_limits<double>::infinity()) {
+  if (a.lx() == std::numeric_limits<double>::infinity()) {
     return a;
   }
-  if (b.lx == std::numeric_limits<double>::infinity()) {
+  if (b.lx() == std::numeric_limits<double>::infinity()) {
     return b;
   }
-  return NeglogNum(a.lx + b.lx,
-		   a.sign_x == b.sign_x);
+  return NeglogNum(a.lx() + b.lx(),
+		   a.sign_x() == b.sign_x());
 }
 
 inline NeglogNum NeglogDivide(const NeglogNum& a,
 			      const NeglogNum& b) {
-  if (b.lx == std::numeric_limits<double>::infinity()) {
+  if (b.lx() == std::numeric_limits<double>::infinity()) {
     // return NeglogNum(std::numeric_limits<double>::quiet_NaN());
     return NeglogNum(-std::numeric_limits<double>::infinity()); // x/0.0=inf
   }
-  else if (a.lx == std::numeric_limits<double>::infinity()) {
+  else if (a.lx() == std::numeric_limits<double>::infinity()) {
     return a;
   }
   else {
-    return NeglogNum(a.lx - b.lx,
-		     a.sign_x == b.sign_x);
+    return NeglogNum(a.lx() - b.lx(),
+		     a.sign_x() == b.sign_x());
   }
 }
 
 inline NeglogNum NeglogQuantize(const NeglogNum& n, double delta) {
-  if (n.lx == -std::numeric_limits<double>::infinity()
-      || n.lx == std::numeric_limits<double>::infinity()
-      || n.lx != n.lx) {
+  if (n.lx() == -std::numeric_limits<double>::infinity()
+      || n.lx() == std::numeric_limits<double>::infinity()
+      || n.lx() != n.lx()) {
     return n;
   }
   else {
-    return NeglogNum(floor(n.lx / delta + 0.5F) * delta,
-		     n.sign_x);
+    return NeglogNum(floor(n.lx() / delta + 0.5F) * delta,
+		     n.sign_x());
   }
 }
 
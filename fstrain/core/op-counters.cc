@@ -0,0 +1,106 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#include "fstrain/core/op-counters.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include <boost/shared_array.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace fstrain { namespace core {
+
+__thread uint64* tls_op_counts = NULL;
+__thread int tls_op_counts_generation = -1;
+__thread int tls_op_phase = kPhaseOther;
+volatile int op_counts_generation = 0;
+
+namespace {
+
+const int kNumCounts = kNumOpPhases * kNumOps;
+
+// the counters of all threads; kept after the threads exit
+boost::mutex registry_mutex;
+std::vector< boost::shared_array<uint64> > registry;
+
+} // end namespace
+
+const char* GetOpName(Op op) {
+  static const char* names[] = {
+    "neglog_plus", "weight_plus", "weight_times",
+    "expectations_alloc", "expectations_clone",
+    "queue_pop", "matcher_find"
+  };
+  return names[op];
+}
+
+const char* GetOpPhaseName(OpPhase phase) {
+  static const char* names[] = {
+    "other", "compose", "distance", "expectations"
+  };
+  return names[phase];
+}
+
+uint64* RegisterThreadOpCounts() {
+  boost::mutex::scoped_lock lock(registry_mutex);
+  boost::shared_array<uint64> counts(new uint64[kNumCounts]);
+  std::fill(counts.get(), counts.get() + kNumCounts, 0);
+  registry.push_back(counts);
+  tls_op_counts = counts.get();
+  tls_op_counts_generation = op_counts_generation;
+  return tls_op_counts;
+}
+
+void GetOpCounts(std::vector<uint64>* counts) {
+  boost::mutex::scoped_lock lock(registry_mutex);
+  counts->assign(kNumCounts, 0);
+  for (std::size_t t = 0; t < registry.size(); ++t) {
+    for (int i = 0; i < kNumCounts; ++i) {
+      (*counts)[i] += registry[t][i];
+    }
+  }
+}
+
+void ResetOpCounts() {
+  boost::mutex::scoped_lock lock(registry_mutex);
+  registry.clear();
+  ++op_counts_generation; // threads register new counters
+}
+
+void WriteOpCounts(std::ostream& out) {
+#ifdef FSTRAIN_COUNTERS
+  std::vector<uint64> counts;
+  GetOpCounts(&counts);
+  char buf[64];
+  out << "# Op counts:" << std::endl << "# " << std::string(18, ' ');
+  for (int p = 0; p < kNumOpPhases; ++p) {
+    snprintf(buf, sizeof(buf), " %14s", GetOpPhaseName(static_cast<OpPhase>(p)));
+    out << buf;
+  }
+  out << std::endl;
+  for (int op = 0; op < kNumOps; ++op) {
+    snprintf(buf, sizeof(buf), "# %-18s", GetOpName(static_cast<Op>(op)));
+    out << buf;
+    for (int p = 0; p < kNumOpPhases; ++p) {
+      snprintf(buf, sizeof(buf), " %14lu", (unsigned long)counts[p * kNumOps + op]);
+      out << buf;
+    }
+    out << std::endl;
+  }
+#endif
+}
+
+} } // end namespaces
@@ -0,0 +1,134 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_CORE_OP_COUNTERS_H
+#define FSTRAIN_CORE_OP_COUNTERS_H
+
+#include <iostream>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "fst/compat.h" // uint64
+
+/**
+ * Counts of hot-path operations, e.g.
+ *
+ *   FSTR_COUNT_OP(fstrain::core::kOpNeglogPlus);
+ *   FSTR_COUNT_PHASE(fstrain::core::kPhaseCompose);
+ *
+ * The first counts one operation in the current phase of the calling
+ * thread; the second sets that phase until the end of the enclosing
+ * block. Both are only compiled in with -DFSTRAIN_COUNTERS (cmake
+ * -DFSTRAIN_COUNTERS=ON). Each thread increments its own counters
+ * without locking; GetOpCounts adds them up on demand.
+ */
+#ifdef FSTRAIN_COUNTERS
+#define FSTR_COUNT_CONCAT_(a, b) a##b
+#define FSTR_COUNT_CONCAT(a, b) FSTR_COUNT_CONCAT_(a, b)
+#define FSTR_COUNT_OP(op) ++fstrain::core::GetThreadOpCounts()[fstrain::core::tls_op_phase * fstrain::core::kNumOps + (op)]
+#define FSTR_COUNT_PHASE(phase) fstrain::core::ScopedOpPhase FSTR_COUNT_CONCAT(fstr_op_phase_, __LINE__)(phase)
+#else
+#define FSTR_COUNT_OP(op)
+#define FSTR_COUNT_PHASE(phase)
+#endif
+
+namespace fstrain { namespace core {
+
+enum Op {
+  kOpNeglogPlus,         // NeglogPlus
+  kOpWeightPlus,         // Plus(MDExpectationWeight, MDExpectationWeight)
+  kOpWeightTimes,        // Times(MDExpectationWeight, MDExpectationWeight)
+  kOpExpectationsAlloc,  // new MDExpectations
+  kOpExpectationsClone,  // copy-on-write in GetMDExpectations()
+  kOpQueuePop,           // ShortestDistanceState
+  kOpMatcherFind,        // composition matchers
+  kNumOps
+};
+
+enum OpPhase {
+  kPhaseOther,
+  kPhaseCompose,
+  kPhaseShortestDistance,
+  kPhaseExpectations,
+  kNumOpPhases
+};
+
+const char* GetOpName(Op op);
+
+const char* GetOpPhaseName(OpPhase phase);
+
+// per-thread state, see GetThreadOpCounts
+extern __thread uint64* tls_op_counts;
+extern __thread int tls_op_counts_generation;
+extern __thread int tls_op_phase;
+extern volatile int op_counts_generation;
+
+/**
+ * @brief Allocates the counters of the calling thread (called on
+ * first use and after ResetOpCounts).
+ */
+uint64* RegisterThreadOpCounts();
+
+/**
+ * @brief The counters of the calling thread, kNumOpPhases x kNumOps.
+ */
+inline uint64* GetThreadOpCounts() {
+  if (tls_op_counts_generation != op_counts_generation) {
+    return RegisterThreadOpCounts();
+  }
+  return tls_op_counts;
+}
+
+/**
+ * @brief Sets the phase of the calling thread until destruction (see
+ * FSTR_COUNT_PHASE).
+ */
+class ScopedOpPhase : private boost::noncopyable {
+
+ public:
+  explicit ScopedOpPhase(OpPhase phase) : prev_phase_(tls_op_phase) {
+    tls_op_phase = phase;
+  }
+
+  ~ScopedOpPhase() {
+    tls_op_phase = prev_phase_;
+  }
+
+ private:
+  const int prev_phase_;
+};
+
+/**
+ * @brief The counts of all threads, added up; index
+ * phase * kNumOps + op.
+ */
+void GetOpCounts(std::vector<uint64>* counts);
+
+/**
+ * @brief Sets all counts to zero. Must not run while other threads
+ * are counting.
+ */
+void ResetOpCounts();
+
+/**
+ * @brief Writes the counts as a table with one row per operation and
+ * one column per phase; writes nothing if built without
+ * FSTRAIN_COUNTERS.
+ */
+void WriteOpCounts(std::ostream& out);
+
+} } // end namespaces
+
+#endif
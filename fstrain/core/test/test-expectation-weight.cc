@@ -0,0 +1,117 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include "fstrain/core/expectation-weight.h"
+
+using namespace fst;
+using fstrain::core::NeglogNum;
+
+void Test(bool b) {
+  if (b) {
+    std::cout << "OK" << std::endl;
+  }
+  else {
+    throw std::runtime_error("FAIL");
+  }
+}
+
+// The in-place functions must give exactly the same weights as Plus
+// and Times.
+bool Same(const MDExpectationWeight& a, const MDExpectationWeight& b) {
+  typedef MDExpectationWeight::MDExpectations MDExpectations;
+  const MDExpectations& ea = a.GetMDExpectations();
+  const MDExpectations& eb = b.GetMDExpectations();
+  if (a.Value() != b.Value() || ea.size() != eb.size()) {
+    return false;
+  }
+  for (MDExpectations::const_iterator ia = ea.begin(), ib = eb.begin();
+       ia != ea.end(); ++ia, ++ib) {
+    if (ia->first != ib->first || !(ia->second == ib->second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Weight with probability p and the expectations p * v_i for the
+// given features.
+MDExpectationWeight MakeWeight(double p, int num_features,
+                               const int* features, const double* values) {
+  MDExpectationWeight w(-log(p));
+  for (int i = 0; i < num_features; ++i) {
+    w.GetMDExpectations().insert(
+        features[i], NeglogNum(-log(p * fabs(values[i])), values[i] > 0));
+  }
+  return w;
+}
+
+void TestInPlace(const MDExpectationWeight& a, const MDExpectationWeight& b) {
+  std::cout << "TestPlusEq: ";
+  MDExpectationWeight w = a;
+  PlusEq(&w, b);
+  Test(Same(w, Plus(a, b)));
+
+  std::cout << "TestTimesEq: ";
+  w = a;
+  TimesEq(&w, b);
+  Test(Same(w, Times(a, b)));
+
+  std::cout << "TestPlusTimesEq: ";
+  w = a;
+  PlusTimesEq(&w, a, b);
+  Test(Same(w, Plus(a, Times(a, b))));
+
+  std::cout << "TestApproxEqualPlusTimes: ";
+  Test(ApproxEqualPlusTimes(a, a, b)
+       == ApproxEqual(a, Plus(a, Times(a, b))));
+}
+
+void TestSharedNotModified(const MDExpectationWeight& a,
+                           const MDExpectationWeight& b) {
+  std::cout << "TestSharedNotModified: ";
+  MDExpectationWeight w = a;
+  MDExpectationWeight copy = a;
+  PlusTimesEq(&w, a, b);
+  Test(Same(copy, a));
+}
+
+int main(int argc, char** argv) {
+  try {
+    const int f1[] = {1, 3, 5};
+    const double v1[] = {1.0, -2.0, 0.5};
+    const int f2[] = {0, 3, 4, 7};
+    const double v2[] = {2.0, 1.0, -1.0, 3.0};
+    MDExpectationWeight a = MakeWeight(0.3, 3, f1, v1);
+    MDExpectationWeight b = MakeWeight(0.6, 4, f2, v2);
+    MDExpectationWeight c = MakeWeight(0.1, 0, f1, v1);
+    TestInPlace(a, b);
+    TestInPlace(b, a);
+    TestInPlace(a, c);
+    TestInPlace(c, b);
+    TestInPlace(a, MDExpectationWeight::One());
+    TestInPlace(MDExpectationWeight::One(), b);
+    TestInPlace(MDExpectationWeight::Zero(), b);
+    TestInPlace(a, MDExpectationWeight::Zero());
+    TestSharedNotModified(a, b);
+  }
+  catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
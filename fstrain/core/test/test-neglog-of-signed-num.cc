@@ -41,8 +41,8 @@ void TestDivide(double a, double b) {
   NeglogNum la = NeglogNum(-log(fabs(a)), a < 0);
   NeglogNum lb = NeglogNum(-log(fabs(b)), b < 0);
   NeglogNum result = NeglogDivide(la, lb);
-  double factor = result.sign_x ? 1.0 : -1.0;
-  double exp_result = factor * exp(-result.lx);
+  double factor = result.sign_x() ? 1.0 : -1.0;
+  double exp_result = factor * exp(-result.lx());
   Test(ApproxEqual(exp_result, a/b));
   if (exp_result != 0 && a/b != 0) {
     Test(!ApproxEqual(exp_result, -a/b)); // test the sign too
@@ -55,8 +55,8 @@ void TestTimes(double a, double b) {
   NeglogNum la = NeglogNum(-log(fabs(a)), a < 0);
   NeglogNum lb = NeglogNum(-log(fabs(b)), b < 0);
   NeglogNum result = NeglogTimes(la, lb);
-  double factor = result.sign_x ? 1.0 : -1.0;
-  double exp_result = factor * exp(-result.lx);
+  double factor = result.sign_x() ? 1.0 : -1.0;
+  double exp_result = factor * exp(-result.lx());
   Test(ApproxEqual(exp_result, a*b));
   if (exp_result != 0 && a*b != 0) {
     Test(!ApproxEqual(exp_result, -a*b)); // test the sign too
@@ -69,8 +69,8 @@ void TestPlus(double a, double b) {
   NeglogNum la = NeglogNum(-log(fabs(a)), a >= 0);
   NeglogNum lb = NeglogNum(-log(fabs(b)), b >= 0);
   NeglogNum result = NeglogPlus(la, lb);
-  double factor = result.sign_x ? 1.0 : -1.0;
-  double exp_result = factor * exp(-result.lx);
+  double factor = result.sign_x() ? 1.0 : -1.0;
+  double exp_result = factor * exp(-result.lx());
   std::cout << exp_result << " == " << a+b << std::endl;
   std::cout << "result=" << result << std::endl;
   Test(ApproxEqual(exp_result, a+b));
@@ -79,8 +79,26 @@ void TestPlus(double a, double b) {
   }
 }
 
+void TestPacked(double lx, bool sign_x) {
+  using namespace fstrain::core;
+  std::cout << "TestPacked(" << lx << ", " << sign_x << "): ";
+  NeglogNum n(lx, sign_x);
+  Test(sizeof(n) == sizeof(double)
+       && ApproxEqual(n.lx(), lx, 1e-12)
+       && (n.sign_x() == sign_x || n.lx() == std::numeric_limits<double>::infinity()));
+}
+
 int main(int argc, char** argv) {
   try{
+    TestPacked(0.0, true);
+    TestPacked(0.0, false);
+    TestPacked(-log(0.5), false);
+    TestPacked(-3.7, true);
+    TestPacked(-3.7, false);
+    TestPacked(1e300, false);
+    TestPacked(std::numeric_limits<double>::infinity(), false);
+    TestPacked(-std::numeric_limits<double>::infinity(), true);
+
     TestDivide(1, 2);
     TestDivide(-1, 2);
     TestDivide(-3, 10);
@@ -30,6 +30,7 @@
 #include "fstrain/create/ngram-counter.h"
 #include "fstrain/util/data.h"
 #include "fstrain/util/print-fst.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/util/symbol-table-mapper.h"
 //#include "fstrain/create/add-backoff.h"
@@ -203,12 +204,12 @@ class ConstructLatticeFct_UpDown : public ConstructLatticeFct {
     using namespace fst;
     ComposeFstOptions<StdArc> copts;
     copts.gc_limit = 0;  // Cache only the last state for fastest copy.
-    VectorFst<StdArc> in_fst;
-    VectorFst<StdArc> out_fst;
-    util::ConvertStringToFst(in, *proj_up_->InputSymbols(), &in_fst);
-    util::ConvertStringToFst(out, *proj_down_->OutputSymbols(), &out_fst);
-    in_fst.SetOutputSymbols(proj_up_->InputSymbols());
-    out_fst.SetInputSymbols(proj_down_->OutputSymbols());
+    std::vector<StdArc::Label> in_labels;
+    std::vector<StdArc::Label> out_labels;
+    util::ConvertStringToLabels(in, *proj_up_->InputSymbols(), &in_labels);
+    util::ConvertStringToLabels(out, *proj_down_->OutputSymbols(), &out_labels);
+    util::LinearFst<StdArc> in_fst(in_labels, NULL, proj_up_->InputSymbols());
+    util::LinearFst<StdArc> out_fst(out_labels, proj_down_->OutputSymbols(), NULL);
     ProjectFst<StdArc> in_proj(ComposeFst<StdArc>(in_fst, *proj_up_, copts),
                                PROJECT_OUTPUT);
     ProjectFst<StdArc> out_proj(ComposeFst<StdArc>(*proj_down_, out_fst, copts),
@@ -228,10 +229,12 @@ class ConstructLatticeFct_UpDown : public ConstructLatticeFct {
     using namespace fst;
     ComposeFstOptions<StdArc> copts;
     copts.gc_limit = 0;  // Cache only the last state for fastest copy.
-    VectorFst<StdArc> in_fst;
-    VectorFst<StdArc> out_fst;
-    util::ConvertStringToFst(in, isymbols, &in_fst);
-    util::ConvertStringToFst(out, osymbols, &out_fst);
+    std::vector<StdArc::Label> in_labels;
+    std::vector<StdArc::Label> out_labels;
+    util::ConvertStringToLabels(in, isymbols, &in_labels);
+    util::ConvertStringToLabels(out, osymbols, &out_labels);
+    util::LinearFst<StdArc> in_fst(in_labels);
+    util::LinearFst<StdArc> out_fst(out_labels);
     VectorFst<StdArc> aligned;
     ComposeFst<StdArc> in_align(in_fst, align_fst, copts);
     Compose(in_align, out_fst, &aligned);
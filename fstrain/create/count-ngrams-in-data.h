@@ -20,8 +20,10 @@
 // #include "fst/project.h"
 #include "fst/fst.h"
 #include "fst/symbol-table.h"
+#include "fst/vector-fst.h"
 
 #include "fstrain/create/ngram-counter.h"
+#include "fstrain/create/partial-counts.h"
 //#include "fstrain/create/add-backoff.h"
 #include "fstrain/create/debug.h"
 #include "fstrain/util/align-strings.h"
@@ -39,26 +41,20 @@
 
 namespace fstrain { namespace create {
 
+namespace nsCountNgramsInDataUtil {
+
 /**
- * @brief First, determines pruned alignment alphabet by aligning the
- * data, then for each data pair, counts all alignments under the
- * pruned alignment alphabet.
+ * @brief Aligns the data and adds the symbols of the best alignments
+ * to syms.
  */
-template<class Arc>
-void CountNgramsInData(const util::Data& data,
-                       const fst::SymbolTable& isymbols,
-                       const fst::SymbolTable& osymbols,
-                       const fst::Fst<fst::StdArc>& align_fst,
-                       PruneFct* prune_fct,
-                       GetAlignmentSymbolsFct* get_alignment_symbols_fct,
-                       ConstructLatticeFct* construct_lattice_fct,
-                       int ngram_order,
-                       fst::SymbolTable*& ngram_trie_symbols,
-                       fst::MutableFst<Arc>* ngram_trie) {
-  using namespace fst;
-  typedef WeightConvertMapper<StdArc, Arc> Map_SL;
+inline void GetAlignmentSymbols(const util::Data& data,
+                                const fst::SymbolTable& isymbols,
+                                const fst::SymbolTable& osymbols,
+                                const fst::Fst<fst::StdArc>& align_fst,
+                                GetAlignmentSymbolsFct* get_alignment_symbols_fct,
+                                fst::SymbolTable* syms) {
   std::stringstream aligned_data;
-  SymbolTable align_symbols("align-symbols");
+  fst::SymbolTable align_symbols("align-symbols");
   util::AlignStringsDefaultOutputStream<std::stringstream> out(&aligned_data, &align_symbols);
   util::AlignStringsOptions opts;
   opts.n_best_alignments = 1; // one-best
@@ -66,18 +62,37 @@ void CountNgramsInData(const util::Data& data,
     opts.sigma_label = fstrain::util::options.get<int>("sigma_label");
   }
   util::AlignStrings(data, isymbols, osymbols, align_fst, &out, opts);
-  SymbolTable pruned_syms("pruned-syms");
-  (*get_alignment_symbols_fct)(aligned_data, isymbols, osymbols, &pruned_syms);
+  (*get_alignment_symbols_fct)(aligned_data, isymbols, osymbols, syms);
+}
+
+/**
+ * @brief Sets the alignment symbols for the lattice construction and
+ * returns a copy of the final ones (the trie symbols).
+ */
+inline fst::SymbolTable* SetAlignmentSymbols(const fst::SymbolTable& pruned_syms,
+                                             ConstructLatticeFct* construct_lattice_fct) {
   std::cerr << "# Extracted " << pruned_syms.NumSymbols() << " alignment symbols." << std::endl;
   FSTR_CREATE_DBG_EXEC(10,
                        pruned_syms.WriteText(std::cerr);
                        std::cerr << std::endl;
                        );
   construct_lattice_fct->SetAlignmentSymbols(&pruned_syms);
-  ngram_trie_symbols = construct_lattice_fct->GetFinalAlignmentSymbols()->Copy();
-
-  NgramCounter<Arc>* ngram_counter = new NgramCounter<Arc>(ngram_order);
+  return construct_lattice_fct->GetFinalAlignmentSymbols()->Copy();
+}
 
+/**
+ * @brief Counts all alignments of the data pairs.
+ */
+template<class Arc>
+void AddCounts(const util::Data& data,
+               const fst::SymbolTable& isymbols,
+               const fst::SymbolTable& osymbols,
+               const fst::Fst<fst::StdArc>& align_fst,
+               PruneFct* prune_fct,
+               ConstructLatticeFct* construct_lattice_fct,
+               NgramCounter<Arc>* ngram_counter) {
+  using namespace fst;
+  typedef WeightConvertMapper<StdArc, Arc> Map_SL;
   for (util::Data::const_iterator d = data.begin(); d != data.end(); ++d) {
     // std::cerr << d->first << " -- " << d->second << std::endl;
     VectorFst<StdArc> lattice;
@@ -100,9 +115,80 @@ void CountNgramsInData(const util::Data& data,
     MapFst<StdArc, Arc, Map_SL> mapped(lattice, Map_SL());
     ngram_counter->AddCounts(mapped);
   }
+}
+
+} // end namespace
+
+/**
+ * @brief First, determines pruned alignment alphabet by aligning the
+ * data, then for each data pair, counts all alignments under the
+ * pruned alignment alphabet.
+ */
+template<class Arc>
+void CountNgramsInData(const util::Data& data,
+                       const fst::SymbolTable& isymbols,
+                       const fst::SymbolTable& osymbols,
+                       const fst::Fst<fst::StdArc>& align_fst,
+                       PruneFct* prune_fct,
+                       GetAlignmentSymbolsFct* get_alignment_symbols_fct,
+                       ConstructLatticeFct* construct_lattice_fct,
+                       int ngram_order,
+                       fst::SymbolTable*& ngram_trie_symbols,
+                       fst::MutableFst<Arc>* ngram_trie) {
+  using namespace nsCountNgramsInDataUtil;
+  fst::SymbolTable pruned_syms("pruned-syms");
+  GetAlignmentSymbols(data, isymbols, osymbols, align_fst,
+                      get_alignment_symbols_fct, &pruned_syms);
+  ngram_trie_symbols = SetAlignmentSymbols(pruned_syms, construct_lattice_fct);
+
+  NgramCounter<Arc> ngram_counter(ngram_order);
+  AddCounts(data, isymbols, osymbols, align_fst, prune_fct,
+            construct_lattice_fct, &ngram_counter);
+  ngram_counter.GetResult(ngram_trie);
+}
 
-  ngram_counter->GetResult(ngram_trie);
-  delete ngram_counter;
+/**
+ * @brief Like CountNgramsInData, but reads the data file in chunks
+ * (see GetCreateChunkSize), in two passes: one to align and extract
+ * the alignment symbols, one to count. The counts of each chunk go to
+ * a file and are merged at the end, so memory does not grow with the
+ * size of the corpus.
+ */
+template<class Arc>
+void CountNgramsInDataFile(const std::string& data_filename,
+                           const fst::SymbolTable& isymbols,
+                           const fst::SymbolTable& osymbols,
+                           const fst::Fst<fst::StdArc>& align_fst,
+                           PruneFct* prune_fct,
+                           GetAlignmentSymbolsFct* get_alignment_symbols_fct,
+                           ConstructLatticeFct* construct_lattice_fct,
+                           int ngram_order,
+                           fst::SymbolTable*& ngram_trie_symbols,
+                           fst::MutableFst<Arc>* ngram_trie) {
+  using namespace nsCountNgramsInDataUtil;
+  util::DataReader reader(data_filename);
+  util::Data chunk;
+
+  fst::SymbolTable pruned_syms("pruned-syms");
+  while (reader.ReadChunk(GetCreateChunkSize(), &chunk)) {
+    GetAlignmentSymbols(chunk, isymbols, osymbols, align_fst,
+                        get_alignment_symbols_fct, &pruned_syms);
+  }
+  ngram_trie_symbols = SetAlignmentSymbols(pruned_syms, construct_lattice_fct);
+
+  reader.Rewind();
+  PartialCountFiles<Arc> partial_counts(ngram_order);
+  NgramCounter<Arc> ngram_counter(ngram_order);
+  while (reader.ReadChunk(GetCreateChunkSize(), &chunk)) {
+    AddCounts(chunk, isymbols, osymbols, align_fst, prune_fct,
+              construct_lattice_fct, &ngram_counter);
+    fst::VectorFst<Arc> chunk_trie;
+    ngram_counter.GetResult(&chunk_trie);
+    partial_counts.Add(chunk_trie);
+    ngram_counter.Reset();
+  }
+  std::cerr << "# Merging counts of " << partial_counts.size() << " chunks" << std::endl;
+  partial_counts.Merge(ngram_trie);
 }
 
 } } // end namespaces
@@ -61,7 +61,10 @@ void CreateNgramFstFromBestAlign_r2191(size_t ngram_order,
                                        fst::SymbolTable* feature_names,
                                        fst::MutableFst<fst::MDExpectationArc>* result) {
   using namespace fst;
-  util::Data data(data_filename);
+  if (util::options.has("create-counts-in")) {
+    // the alignment symbols (and trie labels) depend on the data here
+    FSTR_CREATE_EXCEPTION("Incremental creation is not supported by the old creation code");
+  }
 
   const bool symmetric = false;
   const int max_insertions_nolimit = -1;
@@ -77,12 +80,12 @@ void CreateNgramFstFromBestAlign_r2191(size_t ngram_order,
   util::Timer timer;
   SymbolTable* align_syms = NULL;
   GetAlignmentSymbolsFct_AddIdentityChars get_align_syms_fct;
-  CountNgramsInData(data, *isymbols, *osymbols,
-                    alignment_fst, prune_fct,
-                    &get_align_syms_fct, &construct_lattice_fct,
-                    ngram_order,
-                    align_syms,
-                    result);
+  CountNgramsInDataFile(data_filename, *isymbols, *osymbols,
+                        alignment_fst, prune_fct,
+                        &get_align_syms_fct, &construct_lattice_fct,
+                        ngram_order,
+                        align_syms,
+                        result);
 
   FSTR_CREATE_DBG_EXEC(10,
                        std::cerr << "Trie 1:" << std::endl;
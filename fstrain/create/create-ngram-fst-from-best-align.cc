@@ -29,12 +29,16 @@
 #include "fstrain/create/debug.h"
 #include "fstrain/create/features/extract-features.h"
 #include "fstrain/create/ngram-fsa-insert-features.h"
+#include "fstrain/create/partial-counts.h"
+#include "fstrain/create/parallel-insert-features.h" // GetCreateNumThreads
 #include "fstrain/create/prune-fct.h"
 #include "fstrain/create/v3-create-trie.h"
 
+#include "fstrain/util/data.h"
 #include "fstrain/util/options.h"
 #include "fstrain/util/print-fst.h"
 #include "fstrain/util/timer.h"
+#include "fstrain/util/memory-governor.h"
 #include "fstrain/util/memory-info.h"
 #include "fstrain/util/intersect-vec.h"
 
@@ -94,12 +98,6 @@ void CreateNgramFstFromBestAlign(size_t ngram_order,
                                  fst::SymbolTable* feature_names,
                                  fst::MutableFst<fst::MDExpectationArc>* result) {
   using namespace fst;
-  util::Data data(data_filename);
-  v3::AlignmentLatticesIterator<StdArc> lattice_iter(data.begin(), data.end(),
-                                            alignment_fst,
-                                            isymbols, osymbols);
-  lattice_iter.SetPruneFct(prune_fct);
-
   util::Timer timer;
 
   VectorFst<StdArc> proj_up;
@@ -110,11 +108,38 @@ void CreateNgramFstFromBestAlign(size_t ngram_order,
                            &proj_up, &proj_down, &wellformed_fst);
   const SymbolTable* align_syms = proj_up.OutputSymbols()->Copy();
 
+  // Aligns and counts one chunk of the data at a time; the counts of
+  // each chunk go to disk and are merged at the end.
   fst::VectorFst<fst::LogArc> counts_trie;
   const bool wellformed_has_latent = num_conjugations > 0 || num_change_regions > 0;
-  v3::AlignDataAndExtractNgramCounts(lattice_iter, ngram_order,
-                                     wellformed_fst, wellformed_has_latent,
-                                     &counts_trie);
+  {
+    util::DataReader reader(data_filename);
+    util::Data chunk;
+    PartialCountFiles<LogArc> partial_counts(ngram_order);
+    while (reader.ReadChunk(GetCreateChunkSize(), &chunk)) {
+      v3::AlignmentLatticesIterator<StdArc> lattice_iter(chunk.begin(), chunk.end(),
+                                                         alignment_fst,
+                                                         isymbols, osymbols);
+      lattice_iter.SetPruneFct(prune_fct);
+      fst::VectorFst<fst::LogArc> chunk_trie;
+      v3::AlignDataAndExtractNgramCounts(lattice_iter, ngram_order,
+                                         wellformed_fst, wellformed_has_latent,
+                                         &chunk_trie);
+      partial_counts.Add(chunk_trie);
+    }
+    // incremental: adds the new counts to those of an earlier run
+    if (util::options.has("create-counts-in")) {
+      partial_counts.AddFile(util::options.get<std::string>("create-counts-in"));
+    }
+    fprintf(stderr, "Merging counts of %d chunks [%2.2f MB]\n",
+            (int)partial_counts.size(),
+            util::MemoryInfo::instance().getSizeInMB());
+    partial_counts.Merge(&counts_trie, align_syms);
+  }
+  if (util::options.has("create-counts-out")) {
+    WriteCounts(counts_trie, *align_syms,
+                util::options.get<std::string>("create-counts-out"));
+  }
 
   fst::SymbolTable pruned_syms("pruned-syms");
   double sym_cond_prob_threshold = 0.99;
@@ -182,7 +207,19 @@ void CreateNgramFstFromBestAlign(size_t ngram_order,
     fprintf(stderr, "Adding backoff / insertion limit [%2.2f MB]\n",
             util::MemoryInfo::instance().getSizeInMB());
     combined_backoff_model = new VectorFst<MDExpectationArc>();
-    util::Intersect_vec(backoff_model_fsts, combined_backoff_model, false);
+    util::IntersectVecOptions intersect_opts(false, GetCreateNumThreads());
+    util::MemoryGovernor& governor = util::MemoryGovernor::instance();
+    intersect_opts.lazy = governor.UseLazy("backoff intersection",
+                                           util::options.has("intersect-lazy-cache-mb"));
+    if (util::options.has("intersect-lazy-cache-mb")) {
+      intersect_opts.cache_gc_limit = static_cast<std::size_t>(
+          util::options.get<double>("intersect-lazy-cache-mb") * 1048576.0);
+    }
+    if (intersect_opts.lazy) {
+      intersect_opts.cache_gc_limit =
+          governor.GetCacheLimit("backoff intersection", intersect_opts.cache_gc_limit);
+    }
+    util::Intersect_vec(backoff_model_fsts, combined_backoff_model, intersect_opts);
     BOOST_FOREACH(Fst<MDExpectationArc>* fst, backoff_model_fsts) {
       delete fst;
     }
@@ -0,0 +1,107 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#include <fstream>
+#include <limits>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "fstrain/create/debug.h"
+#include "fstrain/create/feature-hashing.h"
+#include "fstrain/create/features/feature-batch.h"
+
+namespace fstrain { namespace create {
+
+FeatureHasher::FeatureHasher(const fst::SymbolTable* feature_ids, int bits,
+                             bool keep_names)
+    : feature_ids_(feature_ids),
+      bits_(bits),
+      offset_(feature_ids == NULL ? 0 : feature_ids->NumSymbols()),
+      keep_names_(keep_names),
+      num_lookups_(0),
+      num_used_buckets_(0),
+      num_collisions_(0)
+{
+  if (feature_ids_ == NULL) {
+    FSTR_CREATE_EXCEPTION("feature_ids is NULL");
+  }
+  if (bits_ < 1 || bits_ > 30
+      || offset_ + (1LL << bits_) > std::numeric_limits<int>::max()) {
+    FSTR_CREATE_EXCEPTION("Feature hash bits must be in 1..30, got " << bits_);
+  }
+  fingerprints_.resize(1 << bits_, 0);
+}
+
+int64 FeatureHasher::GetId(const std::string& name) {
+  const int64 id = GetIdForHash(features::HashFeatureName(name));
+  if (keep_names_) {
+    names_.insert(std::make_pair(id, name));
+  }
+  return id;
+}
+
+int64 FeatureHasher::GetIdForHash(uint64 hash) {
+  const int64 bucket = hash & ((1LL << bits_) - 1);
+  uint32 fingerprint = static_cast<uint32>(hash >> 32);
+  if (fingerprint == 0) {
+    fingerprint = 1;
+  }
+  ++num_lookups_;
+  uint32& stored = fingerprints_[bucket];
+  if (stored == 0) {
+    stored = fingerprint;
+    ++num_used_buckets_;
+  }
+  else if (stored != fingerprint) {
+    ++num_collisions_;
+  }
+  return offset_ + bucket;
+}
+
+void FeatureHasher::PrintStats(std::ostream& out) const {
+  const int64 num_buckets = fingerprints_.size();
+  out << "# Feature hashing: " << num_buckets << " buckets (" << bits_
+      << " bits, offset " << offset_ << "), " << num_used_buckets_
+      << " used (" << (100.0 * num_used_buckets_ / num_buckets) << "%), "
+      << num_collisions_ << " of " << num_lookups_ << " lookups collided"
+      << std::endl;
+}
+
+void FeatureHasher::WriteNames(const std::string& filename) const {
+  if (!keep_names_) {
+    FSTR_CREATE_EXCEPTION("Feature hasher does not keep names");
+  }
+  std::ofstream out(filename.c_str());
+  if (!out) {
+    FSTR_CREATE_EXCEPTION("Could not write " << filename);
+  }
+  typedef std::set<std::pair<int64, std::string> >::const_iterator Iter;
+  for (Iter it = names_.begin(); it != names_.end(); ++it) {
+    out << it->first << '\t' << it->second << std::endl;
+  }
+}
+
+namespace {
+boost::scoped_ptr<FeatureHasher> feature_hasher;
+}
+
+void SetFeatureHasher(FeatureHasher* hasher) {
+  feature_hasher.reset(hasher);
+}
+
+FeatureHasher* GetFeatureHasher() {
+  return feature_hasher.get();
+}
+
+} } // end namespaces
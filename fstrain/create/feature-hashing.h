@@ -0,0 +1,143 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_CREATE_FEATURE_HASHING_H
+#define FSTRAIN_CREATE_FEATURE_HASHING_H
+
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fst/symbol-table.h"
+
+namespace fstrain { namespace create {
+
+/**
+ * @brief Maps feature names into a fixed-size space of 2^bits
+ * parameters by hashing them, so that the names do not need to be
+ * stored.
+ *
+ * The hasher belongs to one feature table: names that are already in
+ * that table when the hasher is created (e.g. *LENGTH_IN* and
+ * *LENGTH_OUT*, or names from --init-names) keep their IDs; all other
+ * names get the ID offset + (hash mod 2^bits), where offset is the
+ * size of the table at construction. The feature space therefore has
+ * NumParams() = offset + 2^bits entries, no matter which IDs occur.
+ *
+ * Collisions are detected with a 32-bit fingerprint per bucket; the
+ * names themselves are only kept if a reverse-lookup file is
+ * requested. Not thread-safe.
+ */
+class FeatureHasher {
+
+ public:
+
+  FeatureHasher(const fst::SymbolTable* feature_ids, int bits,
+                bool keep_names = false);
+
+  /**
+   * @brief Returns the ID of a feature that is not in the feature
+   * table.
+   */
+  int64 GetId(const std::string& name);
+
+  /**
+   * @brief Same as GetId, for a name with the given hash (see
+   * features::HashFeatureName); the name is not kept.
+   */
+  int64 GetIdForHash(uint64 hash);
+
+  bool KeepsNames() const {
+    return keep_names_;
+  }
+
+  const fst::SymbolTable* GetFeatureTable() const {
+    return feature_ids_;
+  }
+
+  int64 NumParams() const {
+    return offset_ + static_cast<int64>(fingerprints_.size());
+  }
+
+  /**
+   * @brief Number of buckets that got at least one feature.
+   */
+  int64 NumUsedBuckets() const {
+    return num_used_buckets_;
+  }
+
+  /**
+   * @brief Number of lookups that hit a bucket taken by a different
+   * name (a name that collides is counted each time it is looked up).
+   */
+  int64 NumCollisions() const {
+    return num_collisions_;
+  }
+
+  void PrintStats(std::ostream& out) const;
+
+  /**
+   * @brief Writes lines "id<TAB>name" for all hashed features, sorted
+   * by ID; a bucket with collisions has several lines. Only possible
+   * if the hasher keeps the names.
+   */
+  void WriteNames(const std::string& filename) const;
+
+ private:
+  FeatureHasher(const FeatureHasher&);  // disallowed
+  void operator=(const FeatureHasher&); // disallowed
+
+  const fst::SymbolTable* feature_ids_;
+  const int bits_;
+  const int64 offset_;
+  const bool keep_names_;
+  std::vector<uint32> fingerprints_; // 0 if bucket is unused
+  int64 num_lookups_;
+  int64 num_used_buckets_;
+  int64 num_collisions_;
+  std::set<std::pair<int64, std::string> > names_;
+
+};
+
+/**
+ * @brief Sets the hasher used by AddFeatureName (NULL turns hashing
+ * off). Takes ownership.
+ */
+void SetFeatureHasher(FeatureHasher* hasher);
+
+/**
+ * @brief Returns the current hasher, or NULL if hashing is off.
+ */
+FeatureHasher* GetFeatureHasher();
+
+/**
+ * @brief Returns the ID of a feature, adding it to the feature table
+ * if needed. If a hasher is set for this table, new names are hashed
+ * instead of added.
+ */
+inline int64 AddFeatureName(const std::string& name,
+                            fst::SymbolTable* feature_ids) {
+  FeatureHasher* hasher = GetFeatureHasher();
+  if (hasher != NULL && hasher->GetFeatureTable() == feature_ids) {
+    const int64 id = feature_ids->Find(name);
+    return id == -1 ? hasher->GetId(name) : id;
+  }
+  return feature_ids->AddSymbol(name);
+}
+
+} } // end namespaces
+
+#endif
@@ -3,19 +3,68 @@
 
 #include <string>
 #include "fstrain/create/debug.h"
+#include "fstrain/create/features/feature-batch.h"
 #include "fstrain/create/features/feature-set.h"
 #include "fstrain/util/load-library.h"
 #include <ctype.h> // isblank
+#include <algorithm>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 
 namespace fstrain { namespace create { namespace features {
 
+/**
+ * @brief Feature set used by the batch adapter: hashes each inserted
+ * name and keeps the name.
+ */
+struct HashingFeatureSet : public IFeatureSet {
+  HashingFeatureSet(FeatureBatchOutput* out) : out_(out), window_(0) {}
+  void insert(const std::string& name) {
+    FeatureKey key;
+    key.hash = HashFeatureName(name);
+    key.window = window_;
+    key.payload = out_->names.size();
+    out_->keys.push_back(key);
+    out_->names.push_back(name);
+  }
+  void SetWindow(uint32_t window) { window_ = window; }
+  FeatureBatchOutput* out_;
+  uint32_t window_;
+};
+
 // interface for function object
 struct ExtractFeaturesFct {
   typedef boost::shared_ptr<ExtractFeaturesFct> Ptr;
   virtual ~ExtractFeaturesFct() {}
   virtual void operator()(const std::string& window,
                           IFeatureSet* featset) = 0;
+
+  /**
+   * @brief Extracts the features of a batch of windows, see
+   * feature-batch.h. The default implementation adapts the string
+   * interface: it builds each window string and hashes the names.
+   */
+  virtual void ExtractBatch(const FeatureWindowBatch& batch,
+                            FeatureBatchOutput* out) {
+    out->clear();
+    HashingFeatureSet featset(out);
+    std::string window;
+    for (std::size_t i = 0; i < batch.num_windows; ++i) {
+      GetWindowString(batch, i, &window);
+      featset.SetWindow(i);
+      (*this)(window, &featset);
+      out->window_end.push_back(out->keys.size());
+    }
+  }
+
+  /**
+   * @brief Returns the name of feature i from ExtractBatch.
+   */
+  virtual std::string GetFeatureName(const FeatureWindowBatch& batch,
+                                     const FeatureBatchOutput& out,
+                                     std::size_t i) {
+    return out.names[i];
+  }
 };
 
 struct ExtractFeaturesFct_Simple : public ExtractFeaturesFct {
@@ -36,7 +85,8 @@ struct ExtractFeaturesFct_Simple : public ExtractFeaturesFct {
 
 // implementation which loads its code at runtime
 struct ExtractFeaturesFctPlugin : public ExtractFeaturesFct {
-  ExtractFeaturesFctPlugin(const std::string& libname) {
+  ExtractFeaturesFctPlugin(const std::string& libname)
+      : loaded_fct_(NULL), loaded_batch_fct_(NULL), loaded_render_fct_(NULL) {
     LoadExtractFeaturesFunction(libname);
   }
   virtual ~ExtractFeaturesFctPlugin() {}
@@ -44,6 +94,50 @@ struct ExtractFeaturesFctPlugin : public ExtractFeaturesFct {
                   IFeatureSet* featset) {
     loaded_fct_(window, featset);
   }
+
+  /**
+   * @brief Calls the plugin's ExtractFeaturesBatch_v2 if it has one,
+   * otherwise the adapter.
+   */
+  void ExtractBatch(const FeatureWindowBatch& batch,
+                    FeatureBatchOutput* out) {
+    if (loaded_batch_fct_ == NULL) {
+      ExtractFeaturesFct::ExtractBatch(batch, out);
+      return;
+    }
+    out->clear();
+    out->window_end.resize(batch.num_windows);
+    std::size_t capacity = std::max(out->keys.capacity(), 8 * batch.num_windows);
+    while (true) {
+      out->keys.resize(capacity);
+      FeatureKeyBuffer buffer;
+      buffer.keys = out->keys.empty() ? NULL : &out->keys[0];
+      buffer.capacity = capacity;
+      buffer.window_end = out->window_end.empty() ? NULL : &out->window_end[0];
+      const std::size_t num_keys = loaded_batch_fct_(&batch, &buffer);
+      if (num_keys <= capacity) {
+        out->keys.resize(num_keys);
+        break;
+      }
+      capacity = num_keys;
+    }
+  }
+
+  std::string GetFeatureName(const FeatureWindowBatch& batch,
+                             const FeatureBatchOutput& out,
+                             std::size_t i) {
+    if (loaded_batch_fct_ == NULL) {
+      return ExtractFeaturesFct::GetFeatureName(batch, out, i);
+    }
+    std::vector<char> buf(256);
+    std::size_t length = loaded_render_fct_(&batch, &out.keys[i], &buf[0], buf.size());
+    if (length > buf.size()) {
+      buf.resize(length);
+      loaded_render_fct_(&batch, &out.keys[i], &buf[0], buf.size());
+    }
+    return std::string(&buf[0], length);
+  }
+
  private:
 
   void LoadExtractFeaturesFunction(const std::string& libname) {
@@ -57,11 +151,25 @@ struct ExtractFeaturesFctPlugin : public ExtractFeaturesFct {
     if (!(loaded_fct_ = (ExtractFeatures_t)LoadProc(hMyLib, "ExtractFeatures"))) {
       FSTR_CREATE_EXCEPTION(dlerror());
     }
+    // optional: version 2 interface
+    loaded_batch_fct_ =
+        (ExtractFeaturesBatch_v2_t)LoadProc(hMyLib, "ExtractFeaturesBatch_v2");
+    loaded_render_fct_ =
+        (RenderFeature_v2_t)LoadProc(hMyLib, "RenderFeature_v2");
+    dlerror(); // clear error from missing symbols
+    if (loaded_batch_fct_ != NULL && loaded_render_fct_ == NULL) {
+      FSTR_CREATE_EXCEPTION(libname << " has ExtractFeaturesBatch_v2 but no RenderFeature_v2");
+    }
+    if (loaded_batch_fct_ != NULL) {
+      std::cerr << "# Using batch interface of '" << libname << "'" << std::endl;
+    }
   }
 
   typedef void (*ExtractFeatures_t)(const std::string&,
                                     fstrain::create::features::IFeatureSet*);
   ExtractFeatures_t loaded_fct_;
+  ExtractFeaturesBatch_v2_t loaded_batch_fct_;
+  RenderFeature_v2_t loaded_render_fct_;
 };
 
 } } } // end namespaces
@@ -0,0 +1,204 @@
+#ifndef FSTRAIN_CREATE_FEATURES_FEATURE_BATCH_H
+#define FSTRAIN_CREATE_FEATURES_FEATURE_BATCH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace fstrain { namespace create { namespace features {
+
+// Version 2 of the feature extraction plugin interface. Instead of
+// one call per arc with a string window, a plugin gets a batch of
+// windows as spans of symbol IDs and writes hashed feature keys into
+// a buffer that the caller owns. A plugin that supports it exports
+//
+//   extern "C" std::size_t ExtractFeaturesBatch_v2(
+//       const FeatureWindowBatch* batch, FeatureKeyBuffer* out);
+//   extern "C" std::size_t RenderFeature_v2(
+//       const FeatureWindowBatch* batch, const FeatureKey* key,
+//       char* buf, std::size_t capacity);
+//
+// in addition to the old ExtractFeatures function.
+//
+// ExtractFeaturesBatch_v2 returns the number of keys it needs; if
+// that is more than out->capacity it must not write past the buffer,
+// and the caller calls it again with a larger buffer. RenderFeature_v2
+// writes the name of a key (as the old interface would have inserted
+// it) and returns its length; the caller compares names, not only
+// hashes, so it is called for every key.
+
+/**
+ * @brief Read-only view of the symbol names, indexed by label;
+ * names[label] is NULL for unknown labels.
+ */
+struct FeatureSymbolView {
+  const char* const* names;
+  const std::size_t* lengths;
+  std::size_t num_symbols;
+};
+
+/**
+ * @brief Windows as label spans: window i is labels[offsets[i]]
+ * ... labels[offsets[i+1] - 1]; the last label is the arc symbol,
+ * the ones before it are the history.
+ */
+struct FeatureWindowBatch {
+  const int* labels;
+  const std::size_t* offsets; // num_windows + 1 entries
+  std::size_t num_windows;
+  const FeatureSymbolView* symbols;
+};
+
+/**
+ * @brief A feature: the hash of its name (see HashFeatureName), the
+ * window it was extracted from, and plugin-specific data to render
+ * its name (e.g. the position where it starts).
+ */
+struct FeatureKey {
+  uint64_t hash;
+  uint32_t window;
+  uint32_t payload;
+};
+
+/**
+ * @brief Caller-owned output buffer; window_end[i] is the number of
+ * keys written after processing window i.
+ */
+struct FeatureKeyBuffer {
+  FeatureKey* keys;
+  std::size_t capacity;
+  std::size_t* window_end; // num_windows entries
+};
+
+typedef std::size_t (*ExtractFeaturesBatch_v2_t)(const FeatureWindowBatch*,
+                                                 FeatureKeyBuffer*);
+typedef std::size_t (*RenderFeature_v2_t)(const FeatureWindowBatch*,
+                                          const FeatureKey*,
+                                          char*, std::size_t);
+
+// Feature names are hashed with 64-bit FNV-1a, so that plugins can
+// hash a name piece by piece from the symbol names.
+
+const uint64_t kFeatureHashInit = 14695981039346656037ULL;
+const uint64_t kFeatureHashPrime = 1099511628211ULL;
+
+inline uint64_t FeatureHashAppend(uint64_t h, const char* s, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(s[i]);
+    h *= kFeatureHashPrime;
+  }
+  return h;
+}
+
+inline uint64_t FeatureHashAppend(uint64_t h, char c) {
+  return FeatureHashAppend(h, &c, 1);
+}
+
+inline uint64_t HashFeatureName(const std::string& name) {
+  return FeatureHashAppend(kFeatureHashInit, name.data(), name.size());
+}
+
+/**
+ * @brief Key of a feature name with a prefix (e.g. "tlm:"); same as
+ * the plain hash if the prefix is empty.
+ */
+inline uint64_t PrefixFeatureHash(uint64_t prefix_hash, uint64_t h) {
+  if (prefix_hash == kFeatureHashInit) {
+    return h;
+  }
+  return (h ^ (prefix_hash * 0x9E3779B97F4A7C15ULL)) * kFeatureHashPrime;
+}
+
+/**
+ * @brief Output of one batch on the caller side; names is filled
+ * only by implementations that produce the names anyway (such as the
+ * adapter for old plugins), and then has one entry per key.
+ */
+struct FeatureBatchOutput {
+  std::vector<FeatureKey> keys;
+  std::vector<std::size_t> window_end;
+  std::vector<std::string> names;
+  void clear() {
+    keys.clear();
+    window_end.clear();
+    names.clear();
+  }
+};
+
+inline const char* GetSymbolName(const FeatureWindowBatch& batch, int label,
+                                 std::size_t* length) {
+  if (label < 0 || static_cast<std::size_t>(label) >= batch.symbols->num_symbols
+      || batch.symbols->names[label] == NULL) {
+    *length = 0;
+    return "";
+  }
+  *length = batch.symbols->lengths[label];
+  return batch.symbols->names[label];
+}
+
+/**
+ * @brief Hashes the names of labels[begin] ... labels[end - 1],
+ * separated by blanks; same as HashFeatureName on the joined string.
+ */
+inline uint64_t HashLabelSpan(const FeatureWindowBatch& batch,
+                              std::size_t begin, std::size_t end) {
+  uint64_t h = kFeatureHashInit;
+  for (std::size_t k = begin; k < end; ++k) {
+    if (k > begin) {
+      h = FeatureHashAppend(h, ' ');
+    }
+    std::size_t length;
+    const char* name = GetSymbolName(batch, batch.labels[k], &length);
+    h = FeatureHashAppend(h, name, length);
+  }
+  return h;
+}
+
+/**
+ * @brief Writes the names of labels[begin] ... labels[end - 1],
+ * separated by blanks, into buf (at most capacity chars) and returns
+ * the full length.
+ */
+inline std::size_t RenderLabelSpan(const FeatureWindowBatch& batch,
+                                   std::size_t begin, std::size_t end,
+                                   char* buf, std::size_t capacity) {
+  std::size_t n = 0;
+  for (std::size_t k = begin; k < end; ++k) {
+    if (k > begin) {
+      if (n < capacity) {
+        buf[n] = ' ';
+      }
+      ++n;
+    }
+    std::size_t length;
+    const char* name = GetSymbolName(batch, batch.labels[k], &length);
+    for (std::size_t c = 0; c < length; ++c, ++n) {
+      if (n < capacity) {
+        buf[n] = name[c];
+      }
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief Builds the window string of the old interface, e.g. "a|x
+ * b|-", from window i of the batch.
+ */
+inline void GetWindowString(const FeatureWindowBatch& batch, std::size_t i,
+                            std::string* window) {
+  window->clear();
+  for (std::size_t k = batch.offsets[i]; k < batch.offsets[i + 1]; ++k) {
+    if (k > batch.offsets[i]) {
+      window->push_back(' ');
+    }
+    std::size_t length;
+    const char* name = GetSymbolName(batch, batch.labels[k], &length);
+    window->append(name, length);
+  }
+}
+
+} } } // end namespaces
+
+#endif
@@ -1,6 +1,7 @@
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include "fstrain/create/features/feature-batch.h"
 #include "fstrain/create/features/feature-set.h"
 #include <ctype.h> // isblank
 
@@ -18,6 +19,37 @@ extern "C" {
     }
   }
 
+  /**
+   * @brief Batch version of ExtractFeatures: one feature per suffix
+   * of each window; the payload is the start of the suffix.
+   */
+  std::size_t ExtractFeaturesBatch_v2(const FeatureWindowBatch* batch,
+                                      FeatureKeyBuffer* out) {
+    std::size_t n = 0;
+    for (std::size_t w = 0; w < batch->num_windows; ++w) {
+      const std::size_t begin = batch->offsets[w];
+      const std::size_t end = batch->offsets[w + 1];
+      for (std::size_t j = begin; j < end; ++j, ++n) {
+        if (n < out->capacity) {
+          FeatureKey& key = out->keys[n];
+          key.hash = HashLabelSpan(*batch, j, end);
+          key.window = w;
+          key.payload = j - begin;
+        }
+      }
+      out->window_end[w] = n;
+    }
+    return n;
+  }
+
+  std::size_t RenderFeature_v2(const FeatureWindowBatch* batch,
+                               const FeatureKey* key,
+                               char* buf, std::size_t capacity) {
+    const std::size_t begin = batch->offsets[key->window];
+    const std::size_t end = batch->offsets[key->window + 1];
+    return RenderLabelSpan(*batch, begin + key->payload, end, buf, capacity);
+  }
+
 }
 
 } } } // end namespaces
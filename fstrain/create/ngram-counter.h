@@ -39,6 +39,7 @@
 #include "fstrain/create/debug.h"
 #include "fstrain/util/determinized-union.h"
 #include "fstrain/util/string-to-fst.h"
+#include "fstrain/util/trace.h"
 // #include "fstrain/util/print-fst.h"
 // #include "fstrain/util/misc.h" // IsTrie
 // #include "fstrain/create/add-fst-to-trie.h" // incorrect
@@ -62,6 +63,12 @@ class NgramCounter {
    */
   void AddCounts(const fst::Fst<Arc>& fst);
 
+  /**
+   * @brief Adds the counts from a trie that GetResult returned
+   * (e.g. the counts of another part of the data).
+   */
+  void AddTrie(const fst::Fst<Arc>& trie);
+
   /**
    * @brief Writes all counts as a trie into the result FST
    */
@@ -190,6 +197,7 @@ NgramCounter<Arc>::~NgramCounter() {
 
 template<class Arc>
 void NgramCounter<Arc>::AddCounts(const fst::Fst<Arc>& fst) {
+  FSTR_TRACE_SPAN("ngram_count");
   fst::VectorFst<Arc> result;
   nsNgramCounterUtil::CountNgrams(fst, *count_fst_, kSigmaLabel_, &result);
   // AddFstToTrie(result, trie_); // TEST
@@ -200,6 +208,14 @@ void NgramCounter<Arc>::AddCounts(const fst::Fst<Arc>& fst) {
                                SortFst(result, IComp()));
 }
 
+template<class Arc>
+void NgramCounter<Arc>::AddTrie(const fst::Fst<Arc>& trie) {
+  typedef typename fst::ILabelCompare<Arc> IComp;
+  typedef typename fst::ArcSortFst<Arc, IComp> SortFst;
+  fst::ArcSort(trie_, IComp());
+  util::DeterminizedUnion<Arc>(trie_, SortFst(trie, IComp()));
+}
+
 template<class Arc>
 void NgramCounter<Arc>::Reset() {
   delete trie_;
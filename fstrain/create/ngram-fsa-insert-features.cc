@@ -27,7 +27,7 @@
 #include "fstrain/core/expectation-arc.h"
 #include "fstrain/util/string-weight-mapper.h"
 #include "fstrain/util/print-fst.h"
-#include "fstrain/create/trie-insert-features.h" // MyFeatureSet
+#include "fstrain/create/parallel-insert-features.h"
 #include "fstrain/create/debug.h"
 
 #include <string>
@@ -58,35 +58,26 @@ void NgramFsaInsertFeatures(const fst::SymbolTable& symbols,
   std::vector<StrWeight> alphas;
   fst::ShortestDistance(mapped, &alphas);
 
+  ParallelFeatureInserter<MDExpectationArc> inserter(symbols, feature_ids,
+                                                     extract_feats_fct, prefix);
+  std::vector<int> state_history;
   for (StateIterator< Fst<MDExpectationArc> > siter(*fst); !siter.Done();
       siter.Next()) {
     MDExpectationArc::StateId s = siter.Value();
-    std::stringstream state_history;
-    bool first = true;
+    state_history.clear();
     for (StringWeightIterator<int, STRING_RIGHT> iter(alphas[s]); !iter.Done();
         iter.Next()) {
-      if (!first) {
-        // state_history.push_back(' ');
-        state_history << " ";
-      }
-      // state_history.push_back(iter.Value());
-      state_history << symbols.Find(iter.Value());
-      first = false;
+      state_history.push_back(iter.Value());
     }
-    const std::string state_history_str = state_history.str();
-    FSTR_CREATE_DBG_MSG(10, "history(" << s << ") = " << state_history_str << std::endl);
-    for (MutableArcIterator< MutableFst<MDExpectationArc> > aiter(fst, s);
-        !aiter.Done(); aiter.Next()) {
-      MDExpectationArc arc = aiter.Value();
-      const std::string blank = (state_history_str.empty() ? "" : " ");
-      const std::string window = state_history_str + blank + symbols.Find(arc.olabel);
-      typedef fstrain::create::nsTrieInsertFeaturesUtil::MyFeatureSet FeatSet;
-      FeatSet feat_set(feature_ids, &arc.weight.GetMDExpectations());
-      feat_set.SetPrefix(prefix);
-      extract_feats_fct(window, &feat_set);
-      aiter.SetValue(arc);
+    const ParallelFeatureInserter<MDExpectationArc>::History hist =
+        inserter.AddHistory(state_history);
+    std::size_t arc_pos = 0;
+    for (ArcIterator< Fst<MDExpectationArc> > aiter(*fst, s);
+        !aiter.Done(); aiter.Next(), ++arc_pos) {
+      inserter.AddArc(s, arc_pos, aiter.Value().olabel, hist);
     }
   }
+  inserter.Run(fst);
 
 }
 
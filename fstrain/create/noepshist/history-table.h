@@ -0,0 +1,313 @@
+#ifndef FSTRAIN_CREATE_NOEPSHIST_HISTORY_TABLE_H
+#define FSTRAIN_CREATE_NOEPSHIST_HISTORY_TABLE_H
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+#include <tr1/unordered_map>
+
+#include "fst/symbol-table.h"
+#include "fstrain/create/debug.h"
+#include "fstrain/create/noepshist/history-filter.h"
+
+namespace fstrain { namespace create { namespace noepshist {
+
+typedef int HistoryId;
+const HistoryId kNoHistoryId = -1;
+
+/**
+ * @brief Interns histories like "ab|xy" as integers.
+ *
+ * Each side of a history is a node in a character trie; a node is
+ * found from its parent and its last character through one hash
+ * lookup on the packed (parent, char) key. A history is the packed
+ * (left node, right node) pair. Extending a history, removing its
+ * oldest character on either side, and enumerating its backoffs are
+ * integer operations; backoff lists, filtered backoffs and history
+ * strings are memoized per history ID.
+ */
+class HistoryTable {
+
+  typedef int SeqId;
+  static const SeqId kEmptySeq = 0;
+
+  struct SeqNode {
+    SeqId parent;
+    SeqId drop_first; // same sequence without its oldest char
+    char last;
+    int length;
+  };
+
+  struct HistNode {
+    SeqId left;
+    SeqId right;
+  };
+
+  typedef std::tr1::unordered_map<uint64, int> PackedIdMap;
+
+  const char sep_char_;
+  const char eps_char_;
+
+  std::vector<SeqNode> seqs_;
+  PackedIdMap seq_ids_;
+
+  std::vector<HistNode> hists_;
+  PackedIdMap hist_ids_;
+
+  // deques, so that returned references survive new histories
+  std::deque<std::vector<HistoryId> > backoffs_;
+  std::deque<std::string> strings_;
+
+  const HistoryFilter* filtered_for_;
+  std::vector<HistoryId> filtered_backoff_;
+
+  static uint64 Pack(int a, int b) {
+    return (static_cast<uint64>(static_cast<uint32>(a)) << 32)
+        | static_cast<uint32>(b);
+  }
+
+  SeqId ExtendSeq(SeqId parent, char c) {
+    const uint64 key = Pack(parent, static_cast<unsigned char>(c));
+    PackedIdMap::const_iterator found = seq_ids_.find(key);
+    if (found != seq_ids_.end()) {
+      return found->second;
+    }
+    // The parent's suffix is interned before the new node is added,
+    // so seqs_ must not be referenced across this call.
+    const SeqId drop_first = parent == kEmptySeq
+        ? kEmptySeq
+        : ExtendSeq(seqs_[parent].drop_first, c);
+    SeqNode node;
+    node.parent = parent;
+    node.drop_first = drop_first;
+    node.last = c;
+    node.length = seqs_[parent].length + 1;
+    const SeqId id = seqs_.size();
+    seqs_.push_back(node);
+    seq_ids_.insert(std::make_pair(key, id));
+    return id;
+  }
+
+  void AppendSeq(SeqId seq, std::string* out) const {
+    const std::string::size_type begin = out->size();
+    for (; seq != kEmptySeq; seq = seqs_[seq].parent) {
+      out->push_back(seqs_[seq].last);
+    }
+    std::reverse(out->begin() + begin, out->end());
+  }
+
+  HistoryId FindHist(SeqId left, SeqId right) {
+    const uint64 key = Pack(left, right);
+    PackedIdMap::const_iterator found = hist_ids_.find(key);
+    if (found != hist_ids_.end()) {
+      return found->second;
+    }
+    HistNode node;
+    node.left = left;
+    node.right = right;
+    const HistoryId id = hists_.size();
+    hists_.push_back(node);
+    hist_ids_.insert(std::make_pair(key, id));
+    backoffs_.push_back(std::vector<HistoryId>());
+    strings_.push_back(std::string());
+    if (filtered_for_ != NULL) {
+      filtered_backoff_.push_back(kNoHistoryId);
+    }
+    return id;
+  }
+
+  void PushBackoff(HistoryId h, std::vector<HistoryId>* queue) const {
+    if (std::find(queue->begin(), queue->end(), h) == queue->end()) {
+      queue->push_back(h);
+    }
+  }
+
+ public:
+
+  HistoryTable(const char sep_char = '|', const char eps_char = '-')
+      : sep_char_(sep_char), eps_char_(eps_char), filtered_for_(NULL) {
+    SeqNode empty;
+    empty.parent = kEmptySeq;
+    empty.drop_first = kEmptySeq;
+    empty.last = '\0';
+    empty.length = 0;
+    seqs_.push_back(empty);
+  }
+
+  /**
+   * @brief Interns a history string, e.g. "ab|xy".
+   */
+  HistoryId Find(const std::string& hist) {
+    const std::string::size_type sep_pos = hist.find(sep_char_);
+    const std::string::size_type left_end =
+        sep_pos == std::string::npos ? hist.length() : sep_pos;
+    SeqId left = kEmptySeq;
+    for (std::string::size_type i = 0; i < left_end; ++i) {
+      left = ExtendSeq(left, hist[i]);
+    }
+    SeqId right = kEmptySeq;
+    if (sep_pos != std::string::npos) {
+      for (std::string::size_type i = sep_pos + 1;
+           i < hist.length() && hist[i] != sep_char_; ++i) {
+        right = ExtendSeq(right, hist[i]);
+      }
+    }
+    return FindHist(left, right);
+  }
+
+  /**
+   * @brief Extends history by one alignment symbol; same as
+   * ExtendHistory, e.g. "ab|xy" + "c|-" = "abc|xy".
+   */
+  HistoryId Extend(HistoryId h, char lchar, char rchar) {
+    SeqId left = hists_[h].left;
+    SeqId right = hists_[h].right;
+    if (lchar != eps_char_) {
+      left = ExtendSeq(left, lchar);
+    }
+    if (rchar != eps_char_) {
+      right = ExtendSeq(right, rchar);
+    }
+    return FindHist(left, right);
+  }
+
+  /**
+   * @brief Returns all backoffs of a history, in the same order as
+   * BackoffIterator: first the history itself, last the empty
+   * history "|".
+   */
+  const std::vector<HistoryId>& Backoffs(HistoryId h) {
+    if (backoffs_[h].empty()) {
+      std::vector<HistoryId> queue;
+      queue.push_back(h);
+      for (std::size_t head = 0; head < queue.size(); ++head) {
+        const SeqId left = hists_[queue[head]].left;
+        const SeqId right = hists_[queue[head]].right;
+        const SeqId left0 = seqs_[left].drop_first;
+        const SeqId right0 = seqs_[right].drop_first;
+        const HistoryId a = FindHist(left0, right);
+        const HistoryId b = FindHist(left, right0);
+        if (seqs_[left0].length + seqs_[right].length >=
+            seqs_[left].length + seqs_[right0].length) {
+          PushBackoff(a, &queue);
+          PushBackoff(b, &queue);
+        }
+        else {
+          PushBackoff(b, &queue);
+          PushBackoff(a, &queue);
+        }
+      }
+      backoffs_[h].swap(queue);
+    }
+    return backoffs_[h];
+  }
+
+  /**
+   * @brief Returns the first backoff of h that is allowed by the
+   * filter (h itself if filter is NULL); same as GetBackoffHistory.
+   * Results are memoized for the most recently used filter.
+   */
+  HistoryId Backoff(HistoryId h, HistoryFilter* filter) {
+    if (filter == NULL) {
+      return h;
+    }
+    if (filter != filtered_for_) {
+      filtered_for_ = filter;
+      filtered_backoff_.assign(hists_.size(), kNoHistoryId);
+    }
+    if (filtered_backoff_[h] != kNoHistoryId) {
+      return filtered_backoff_[h];
+    }
+    const std::vector<HistoryId>& backoffs = Backoffs(h);
+    for (std::size_t i = 0; i < backoffs.size(); ++i) {
+      if ((*filter)(ToString(backoffs[i]))) {
+        filtered_backoff_[h] = backoffs[i];
+        return backoffs[i];
+      }
+    }
+    FSTR_CREATE_EXCEPTION("Could not find any allowed backoff for '"
+                          << ToString(h) << "'");
+  }
+
+  /**
+   * @brief Returns the history as string, e.g. "ab|xy".
+   */
+  const std::string& ToString(HistoryId h) {
+    std::string& str = strings_[h];
+    if (str.empty()) {
+      AppendSeq(hists_[h].left, &str);
+      str.push_back(sep_char_);
+      AppendSeq(hists_[h].right, &str);
+    }
+    return str;
+  }
+
+  int LeftLength(HistoryId h) const {
+    return seqs_[hists_[h].left].length;
+  }
+
+  int RightLength(HistoryId h) const {
+    return seqs_[hists_[h].right].length;
+  }
+
+  std::size_t NumHistories() const {
+    return hists_.size();
+  }
+
+}; // end class
+
+/**
+ * @brief An alignment symbol like "a|x" split into its left and
+ * right characters.
+ */
+struct AlignSym {
+  int64 label;
+  std::string sym;
+  char lchar;
+  char rchar;
+  AlignSym() : label(-1), lchar('\0'), rchar('\0') {}
+  AlignSym(int64 l, const std::string& s)
+      : label(l), sym(s),
+        lchar(s.length() > 0 ? s[0] : '\0'),
+        rchar(s.length() > 2 ? s[2] : '\0') {}
+};
+
+/**
+ * @brief Splits all alignment symbols once, so that arcs can be
+ * looked up by label instead of calling SymbolTable::Find per arc.
+ */
+class AlignSymTable {
+  std::vector<AlignSym> syms_;   // in symbol table order, without eps
+  std::vector<int> label2index_;
+ public:
+  explicit AlignSymTable(const fst::SymbolTable& align_syms) {
+    fst::SymbolTableIterator sit(align_syms);
+    sit.Next(); // ignore eps sym
+    for (; !sit.Done(); sit.Next()) {
+      const int64 label = sit.Value();
+      if (label >= static_cast<int64>(label2index_.size())) {
+        label2index_.resize(label + 1, -1);
+      }
+      label2index_[label] = syms_.size();
+      syms_.push_back(AlignSym(label, sit.Symbol()));
+    }
+  }
+
+  const std::vector<AlignSym>& Symbols() const {
+    return syms_;
+  }
+
+  const AlignSym& Get(int64 label) const {
+    if (label < 0 || label >= static_cast<int64>(label2index_.size())
+        || label2index_[label] < 0) {
+      FSTR_CREATE_EXCEPTION("unknown alignment symbol label " << label);
+    }
+    return syms_[label2index_[label]];
+  }
+};
+
+} } } // end namespaces
+
+#endif
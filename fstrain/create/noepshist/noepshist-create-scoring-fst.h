@@ -8,6 +8,7 @@
 #include <string>
 #include "fstrain/create/debug.h"
 #include "fstrain/create/feature-functions.h"
+#include "fstrain/create/feature-hashing.h"
 #include "fstrain/util/symbol-table-mapper.h"
 #include "fstrain/util/misc.h" // HasOutArcs
 #include "fstrain/util/print-fst.h"
@@ -17,6 +18,7 @@
 
 #include "fstrain/create/noepshist/backoff-iterator.h"
 #include "fstrain/create/noepshist/history-filter.h"
+#include "fstrain/create/noepshist/history-table.h"
 #include "fstrain/create/create-scoring-fst-from-trie.h"
 #include "fstrain/util/options.h"
 #include "fstrain/create/get-alignment-symbols-fct.h"
@@ -92,58 +94,55 @@ void GetStateHistories(const fst::Fst<Arc>& fst,
   typedef typename Arc::StateId StateId;
   typedef typename Arc::Weight Weight;
 
+  HistoryTable table(sep_char, eps_char);
+  const AlignSymTable arc_syms(align_syms);
+  const HistoryId end_hist = table.Find(end_align_sym);
   std::queue<StateId> states_todo;
   StateId start_id = fst.Start();
   states_todo.push(start_id);
-  const std::string start_hist = GetBackoffHistory(start_hist0, hist_filter,
-                                                   sep_char);
-  // histories->AddSymbol(start_hist, start_id);
-  histories->insert(start_hist);
-  typedef std::map<StateId, std::string> Id2HistMap;
-  typedef typename Id2HistMap::const_iterator Id2HistMapIter;
-  Id2HistMap id2hist;
-  id2hist.insert(std::make_pair(start_id, start_hist));
+  const HistoryId start_hist = table.Backoff(table.Find(start_hist0),
+                                             hist_filter);
+  histories->insert(table.ToString(start_hist));
+  std::vector<HistoryId> id2hist(start_id + 1, kNoHistoryId);
+  id2hist[start_id] = start_hist;
   while (!states_todo.empty()) {
     StateId state_id = states_todo.front();
     states_todo.pop();
-    // const std::string state_hist = histories->Find(state_id);
-    Id2HistMapIter found = id2hist.find(state_id);
-    if (found == id2hist.end()) {
+    const HistoryId state_hist = id2hist[state_id];
+    if (state_hist == kNoHistoryId) {
       FSTR_CREATE_EXCEPTION("Could not find history of state " << state_id);
     }
-    const std::string state_hist = found->second;
-    FSTR_CREATE_DBG_MSG(10, "hist("<<state_id<<")=" << state_hist << std::endl);
+    FSTR_CREATE_DBG_MSG(10, "hist("<<state_id<<")=" << table.ToString(state_hist) << std::endl);
     ArcIterator<Fst<Arc> > aiter(fst, state_id);
     for (; !aiter.Done(); aiter.Next() ) {
       const Arc& arc = aiter.Value();
-      const std::string sym = align_syms.Find(arc.ilabel);
+      const AlignSym& sym = arc_syms.Get(arc.ilabel);
       bool next_state_is_leaf = !util::HasOutArcs(fst, arc.nextstate);
       if (next_state_is_leaf && !store_leaves_histories) {
         continue;
       }
-      const std::string arc_hist = ExtendHistory(state_hist, sym,
-                                                 sep_char, eps_char);
-      FSTR_CREATE_DBG_MSG(10, "arc_hist=" << arc_hist << std::endl);
-      std::string next_state_hist = GetBackoffHistory(arc_hist, hist_filter,
-                                                      sep_char);
+      const HistoryId arc_hist = table.Extend(state_hist, sym.lchar, sym.rchar);
+      FSTR_CREATE_DBG_MSG(10, "arc_hist=" << table.ToString(arc_hist) << std::endl);
+      HistoryId next_state_hist = table.Backoff(arc_hist, hist_filter);
       if (next_state_is_leaf && all_final_states_have_same_history) {
-        next_state_hist = end_align_sym;
+        next_state_hist = end_hist;
       }
-      //std::string next_state_hist_lookup = histories->Find(arc.nextstate);
-      //if (next_state_hist_lookup == "") { // not contained
-      Id2HistMapIter found = id2hist.find(arc.nextstate);
-      if (found == id2hist.end()) {
-        std::cerr << "Adding hist " << next_state_hist
+      if (arc.nextstate >= static_cast<StateId>(id2hist.size())) {
+        id2hist.resize(arc.nextstate + 1, kNoHistoryId);
+      }
+      if (id2hist[arc.nextstate] == kNoHistoryId) {
+        const std::string& next_state_hist_str = table.ToString(next_state_hist);
+        std::cerr << "Adding hist " << next_state_hist_str
                   << " (id=" << arc.nextstate << ")" << std::endl;
-        // histories->AddSymbol(next_state_hist, arc.nextstate);
-        histories->insert(next_state_hist);
-        id2hist.insert(std::make_pair(arc.nextstate, next_state_hist));
+        histories->insert(next_state_hist_str);
+        id2hist[arc.nextstate] = next_state_hist;
         states_todo.push(arc.nextstate);
       }
-      else if (next_state_hist != found->second) {
+      else if (next_state_hist != id2hist[arc.nextstate]) {
         FSTR_CREATE_EXCEPTION("histories for state " << arc.nextstate
                               << " do not agree: "
-                              << next_state_hist << " != " << found->second);
+                              << table.ToString(next_state_hist) << " != "
+                              << table.ToString(id2hist[arc.nextstate]));
       }
     }
   }
@@ -162,6 +161,25 @@ class InsertFeaturesFct {
                           Container* container,
                           fst::SymbolTable* feature_ids) = 0;
   virtual void SetFilter(HistoryFilter*) = 0;
+
+  /**
+   * @brief Same as operator(), but with the state history interned
+   * in the given table. The default falls back to the string
+   * version.
+   */
+  virtual void operator()(HistoryTable* table,
+                          HistoryId state_history,
+                          const AlignSym& arcsym,
+                          Container* container,
+                          fst::SymbolTable* feature_ids) {
+    (*this)(table->ToString(state_history), arcsym.sym, container, feature_ids);
+  }
+
+  /**
+   * @brief Drops anything cached per history ID; called whenever a
+   * new HistoryTable is used.
+   */
+  virtual void ClearCache() {}
 };
 
 /**
@@ -174,6 +192,24 @@ class InsertFeaturesFct_Default : public InsertFeaturesFct<Container> {
   virtual ~InsertFeaturesFct_Default() {}
   HistoryFilter* hist_filter_;
 
+  // Caches for the interned version, indexed by HistoryId
+  std::vector<signed char> filter_ok_;  // -1: unknown
+  std::vector<int64> feature_id_;       // -1: unknown
+
+  void GrowCaches(const HistoryTable& table) {
+    if (filter_ok_.size() < table.NumHistories()) {
+      filter_ok_.resize(table.NumHistories(), -1);
+      feature_id_.resize(table.NumHistories(), -1);
+    }
+  }
+
+  struct StringPtrLess {
+    bool operator()(const std::pair<const std::string*, HistoryId>& a,
+                    const std::pair<const std::string*, HistoryId>& b) const {
+      return *a.first < *b.first;
+    }
+  };
+
  public:
 
   explicit InsertFeaturesFct_Default(const char sep_char, const char eps_char)
@@ -205,13 +241,68 @@ class InsertFeaturesFct_Default : public InsertFeaturesFct<Container> {
       // AddInsDelFeatures(arcsym, sep_char_, eps_char_, &new_feats);
     }
     for (StringSet::const_iterator it = new_feats.begin(); it != new_feats.end(); ++it) {
-      const int64 feature_id = feature_ids->AddSymbol(*it);
+      const int64 feature_id = AddFeatureName(*it, feature_ids);
       container->insert(feature_id, 0.0);
     }
   }
 
+  /**
+   * @brief Interned version: filter decisions and feature IDs are
+   * cached per history ID. New feature names are added in sorted
+   * order, so the IDs are the same as from the string version.
+   */
+  void operator()(HistoryTable* table,
+                  HistoryId state_history,
+                  const AlignSym& arcsym,
+                  Container* container,
+                  fst::SymbolTable* feature_ids) {
+    if (fstrain::util::options.has("fstrain.create.lengthPenaltyFeatures")
+        || fstrain::util::options.has("fstrain.create.insDelFeatures")) {
+      (*this)(table->ToString(state_history), arcsym.sym, container, feature_ids);
+      return;
+    }
+    if (feature_ids == NULL) {
+      FSTR_CREATE_EXCEPTION("feature_ids is NULL");
+    }
+    typedef std::pair<const std::string*, HistoryId> NewFeat;
+    std::vector<NewFeat> new_feats;
+    const std::vector<HistoryId>& backoffs = table->Backoffs(state_history);
+    for (std::size_t i = 0; i < backoffs.size(); ++i) {
+      const HistoryId backoff = backoffs[i];
+      const HistoryId new_feat = table->Extend(backoff, arcsym.lchar, arcsym.rchar);
+      GrowCaches(*table);
+      if (hist_filter_ != NULL) {
+        if (filter_ok_[backoff] < 0) {
+          filter_ok_[backoff] = (*hist_filter_)(table->ToString(backoff)) ? 1 : 0;
+        }
+        if (!filter_ok_[backoff]) {
+          continue;
+        }
+      }
+      if (feature_id_[new_feat] >= 0) {
+        container->insert(feature_id_[new_feat], 0.0);
+      }
+      else {
+        new_feats.push_back(NewFeat(&table->ToString(new_feat), new_feat));
+      }
+    }
+    std::sort(new_feats.begin(), new_feats.end(), StringPtrLess());
+    for (std::size_t i = 0; i < new_feats.size(); ++i) {
+      if (feature_id_[new_feats[i].second] < 0) { // may be a duplicate
+        feature_id_[new_feats[i].second] = AddFeatureName(*new_feats[i].first, feature_ids);
+      }
+      container->insert(feature_id_[new_feats[i].second], 0.0);
+    }
+  }
+
   void SetFilter(HistoryFilter* filter) {
     hist_filter_ = filter;
+    filter_ok_.clear();
+  }
+
+  void ClearCache() {
+    filter_ok_.clear();
+    feature_id_.clear();
   }
 
 }; // end class
@@ -223,26 +314,48 @@ class ScoringFstBuilder {
  private:
 
   typedef typename Arc::Weight::MDExpectations FeaturesContainer;
+  typedef typename Arc::StateId StateId;
 
   const char eps_char_;
   const char start_char_;
   const char sep_char_;
   InsertFeaturesFct<FeaturesContainer>* insert_features_fct_;
 
+  // State of the current CreateScoringFst call
+  HistoryTable* table_;
+  std::vector<StateId> hist2state_;  // indexed by HistoryId
+  std::vector<HistoryId> state2hist_;
+
+  StateId FindState(HistoryId h) const {
+    return h < static_cast<HistoryId>(hist2state_.size())
+        ? hist2state_[h] : fst::kNoStateId;
+  }
+
+  void SetState(HistoryId h, StateId s) {
+    if (h >= static_cast<HistoryId>(hist2state_.size())) {
+      hist2state_.resize(h + 1, fst::kNoStateId);
+    }
+    hist2state_[h] = s;
+    if (s >= static_cast<StateId>(state2hist_.size())) {
+      state2hist_.resize(s + 1, kNoHistoryId);
+    }
+    state2hist_[s] = h;
+  }
+
  public:
 
   ScoringFstBuilder(InsertFeaturesFct<FeaturesContainer>* iff =
                     new InsertFeaturesFct_Default<FeaturesContainer>('|', '-')
                     )
       : eps_char_('-'), start_char_('S'), sep_char_('|'),
-        insert_features_fct_(iff)
+        insert_features_fct_(iff), table_(NULL)
   {}
 
   ScoringFstBuilder(
       const char eps_char, const char start_char, const char sep_char,
       InsertFeaturesFct<FeaturesContainer>* iff)
       : eps_char_(eps_char), start_char_(start_char), sep_char_(sep_char),
-        insert_features_fct_(iff)
+        insert_features_fct_(iff), table_(NULL)
   {}
 
   ~ScoringFstBuilder() {
@@ -253,60 +366,54 @@ class ScoringFstBuilder {
     insert_features_fct_->SetFilter(filter);
   }
 
-  void AddArc(typename Arc::StateId state_id_from,
-              typename Arc::StateId state_id_to,
-              typename Arc::Label label,
-              const std::string& state_history,
-              const std::string& arcsym,
+  void AddArc(StateId state_id_from,
+              StateId state_id_to,
+              HistoryId state_history,
+              const AlignSym& arcsym,
               fst::MutableFst<Arc>* result,
               fst::SymbolTable* feature_ids)
   {
     typedef typename Arc::Weight Weight;
     Weight w(1e-32);
-    (*insert_features_fct_)(state_history, arcsym,
+    (*insert_features_fct_)(table_, state_history, arcsym,
                             &(w.GetMDExpectations()), feature_ids);
     result->AddArc(state_id_from,
-                   Arc(label, label, w, state_id_to));
+                   Arc(arcsym.label, arcsym.label, w, state_id_to));
   }
 
   /**
    * @brief Adds arcs to a state, finds out the target states and adds
    * them to the queue.
    */
-  void AddArcs(const fst::SymbolTable& align_syms,
-               const std::string& end_align_sym,
-               const typename Arc::StateId state_id,
-               fst::SymbolTable* state_ids,
-               std::queue<typename Arc::StateId>* states_todo,
+  void AddArcs(const AlignSymTable& align_syms,
+               const int64 end_label,
+               const HistoryId end_hist,
+               const StateId state_id,
+               std::queue<StateId>* states_todo,
                HistoryFilter* hist_filter,
                fst::SymbolTable* feature_ids,
                fst::MutableFst<Arc>* result) {
     FSTR_CREATE_DBG_MSG(10, "State " << state_id << ": AddArcs" << std::endl);
-    typedef typename Arc::StateId StateId;
     typedef typename Arc::Weight Weight;
-    std::string state_hist = state_ids->Find(state_id);
-    if (state_hist.length() == 0) {
+    const HistoryId state_hist =
+        state_id < static_cast<StateId>(state2hist_.size())
+        ? state2hist_[state_id] : kNoHistoryId;
+    if (state_hist == kNoHistoryId) {
       FSTR_CREATE_EXCEPTION("no history for state " << state_id);
     }
-    fst::SymbolTableIterator aiter(align_syms);
-    aiter.Next(); // ignore eps sym
-    for ( ; !aiter.Done(); aiter.Next()) {
-      const std::string sym = aiter.Symbol();
-      bool target_state_is_final = sym == end_align_sym;
-      std::string target_state_hist = ExtendHistory(state_hist, sym,
-                                                    sep_char_, eps_char_);
-      const std::string full_history = target_state_hist;
-      if (target_state_is_final) {
-        target_state_hist = end_align_sym;
-      }
-      else {
-        target_state_hist =
-            GetBackoffHistory(target_state_hist, hist_filter, sep_char_);
-      }
-      StateId target_state_id = state_ids->Find(target_state_hist);
+    const std::vector<AlignSym>& syms = align_syms.Symbols();
+    for (std::size_t i = 0; i < syms.size(); ++i) {
+      const AlignSym& sym = syms[i];
+      bool target_state_is_final = sym.label == end_label;
+      HistoryId target_state_hist =
+          target_state_is_final
+          ? end_hist
+          : table_->Backoff(table_->Extend(state_hist, sym.lchar, sym.rchar),
+                            hist_filter);
+      StateId target_state_id = FindState(target_state_hist);
       if (target_state_id == fst::kNoStateId) {
         target_state_id = result->AddState();
-        state_ids->AddSymbol(target_state_hist, target_state_id);
+        SetState(target_state_hist, target_state_id);
         if (!target_state_is_final) {
           states_todo->push(target_state_id);
         }
@@ -314,13 +421,12 @@ class ScoringFstBuilder {
       if (target_state_is_final) {
         result->SetFinal(target_state_id, Weight::One());
       }
-      FSTR_CREATE_DBG_MSG(10, "Found history " << target_state_hist
+      FSTR_CREATE_DBG_MSG(10, "Found history " << table_->ToString(target_state_hist)
                           << "(id="<<target_state_id<<")" << std::endl);
-      AddArc(state_id, target_state_id, aiter.Value(), state_hist, sym,
-             result, feature_ids);
-      FSTR_CREATE_DBG_MSG(10, "Arc " << state_id << "[" << state_hist << "]\t"
-                          << target_state_id << "[" << target_state_hist << "]\t"
-                          << sym << std::endl);
+      AddArc(state_id, target_state_id, state_hist, sym, result, feature_ids);
+      FSTR_CREATE_DBG_MSG(10, "Arc " << state_id << "[" << table_->ToString(state_hist) << "]\t"
+                          << target_state_id << "[" << table_->ToString(target_state_hist) << "]\t"
+                          << sym.sym << std::endl);
     }
   }
 
@@ -341,30 +447,37 @@ class ScoringFstBuilder {
       fst::MutableFst<Arc>* result)
   {
     using namespace fst;
-    typedef typename Arc::StateId StateId;
     std::queue<StateId> states_todo;
-    SymbolTable state_ids("state_ids");
+    HistoryTable table(sep_char_, eps_char_);
+    table_ = &table;
+    insert_features_fct_->ClearCache();
+    hist2state_.clear();
+    state2hist_.clear();
+    const AlignSymTable arc_syms(align_syms);
+    const int64 end_label = align_syms.Find(end_align_sym);
+    const HistoryId end_hist = table.Find(end_align_sym);
     std::stringstream start_hist_ss;
     start_hist_ss << start_char_ << sep_char_ << start_char_;
-    std::string start_hist = GetBackoffHistory(start_hist_ss.str(),
-                                               hist_filter, sep_char_);
+    const HistoryId start_hist = table.Backoff(table.Find(start_hist_ss.str()),
+                                               hist_filter);
     StateId start_state_id = result->AddState();
-    state_ids.AddSymbol(start_hist, start_state_id);
+    SetState(start_hist, start_state_id);
     states_todo.push(start_state_id);
     result->SetStart(start_state_id);
     while (!states_todo.empty()) {
       StateId sid = states_todo.front();
       states_todo.pop();
-      AddArcs(align_syms, end_align_sym,
-              sid, &state_ids, &states_todo,
+      AddArcs(arc_syms, end_label, end_hist,
+              sid, &states_todo,
               hist_filter,
               feature_ids, result);
     }
+    FSTR_CREATE_DBG_MSG(1, "Scoring FST: " << state2hist_.size() << " states, "
+                        << table.NumHistories() << " interned histories" << std::endl);
 
     FSTR_CREATE_DBG_EXEC(10,
                          if (hist_filter != NULL) {
                            std::cerr << "Running GetStateHistories" << std::endl;
-                           // SymbolTable histories("histories");
                            std::set<std::string> histories;
                            std::stringstream start_hist_ss;
                            start_hist_ss << start_char_ << sep_char_ << start_char_;
@@ -372,20 +485,20 @@ class ScoringFstBuilder {
                                              sep_char_, eps_char_,
                                              align_syms, end_align_sym, true, true, &histories);
                            std::cerr << "NEW:" << std::endl;
-                           //for (SymbolTableIterator siter(histories); !siter.Done(); siter.Next()) {
-                           // std::cerr << siter.Value() << "\t" << siter.Symbol() << std::endl;
-                           //}
                            for (std::set<std::string>::const_iterator it = histories.begin();
                                it != histories.end(); ++it) {
                              std::cerr << *it << std::endl;
                            }
                            std::cerr << "ORIG:" << std::endl;
-                           for (fst::SymbolTableIterator siter(state_ids); !siter.Done(); siter.Next()) {
-                             std::cerr << siter.Value() << "\t" << siter.Symbol() << std::endl;
+                           for (std::size_t s = 0; s < state2hist_.size(); ++s) {
+                             std::cerr << s << "\t" << table.ToString(state2hist_[s]) << std::endl;
                            }
                          }
                          );
-
+    table_ = NULL;
+    insert_features_fct_->ClearCache();
+    hist2state_.clear();
+    state2hist_.clear();
   }
 
 }; // end class
@@ -405,7 +518,10 @@ void CreateNgramFstFromBestAlign(size_t ngram_order,
                                  fst::MutableFst<fst::MDExpectationArc>* result)
 {
   using namespace fst;
-  util::Data data(data_filename);
+  if (util::options.has("create-counts-in") || util::options.has("create-counts-out")) {
+    // the alignment symbols (and trie labels) depend on the data here
+    FSTR_CREATE_EXCEPTION("Incremental creation is not supported with the noepshist topology");
+  }
 
   const char sep_char = '|';
 
@@ -425,12 +541,12 @@ void CreateNgramFstFromBestAlign(size_t ngram_order,
   Fst<StdArc>* wellformed_fst = construct_lattice_fct.GetWellformedFst();
 
   SymbolTable* align_syms = NULL;
-  CountNgramsInData(data, *isymbols, *osymbols, alignment_fst, NULL,
-                    &get_align_syms_fct, &construct_lattice_fct,
-                    // ngram_order,
-                    ngram_order + 2,
-                    align_syms,
-                    result);
+  CountNgramsInDataFile(data_filename, *isymbols, *osymbols, alignment_fst, NULL,
+                        &get_align_syms_fct, &construct_lattice_fct,
+                        // ngram_order,
+                        ngram_order + 2,
+                        align_syms,
+                        result);
   const std::string end_sym = "E|E";
   // SymbolTable state_histories("state-histories");
   std::set<std::string> state_histories;
@@ -0,0 +1,336 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_CREATE_PARALLEL_INSERT_FEATURES_H
+#define FSTRAIN_CREATE_PARALLEL_INSERT_FEATURES_H
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "fst/fst.h"
+#include "fst/mutable-fst.h"
+#include "fst/symbol-table.h"
+#include "fstrain/core/expectations.h"
+#include "fstrain/create/debug.h"
+#include "fstrain/create/feature-hashing.h"
+#include "fstrain/create/features/extract-features.h"
+#include "fstrain/create/features/feature-batch.h"
+#include "fstrain/create/sharded-feature-names.h"
+#include "fstrain/util/memory-governor.h"
+#include "fstrain/util/memory-info.h"
+#include "fstrain/util/options.h"
+#include "fstrain/util/timer.h"
+#include "fstrain/util/trace.h"
+
+namespace fstrain { namespace create {
+
+/**
+ * @brief Returns the number of threads to use for model creation,
+ * as set in option "create-num-threads" (default 1), or fewer if
+ * memory is short (see util::MemoryGovernor).
+ */
+inline int GetCreateNumThreads() {
+  if (util::options.has("create-num-threads")) {
+    const int n = util::options.get<int>("create-num-threads");
+    return util::MemoryGovernor::instance().GetNumThreads("model creation", n > 0 ? n : 1);
+  }
+  return 1;
+}
+
+/**
+ * @brief Inserts features into the arcs of an FST; the features are
+ * extracted in several threads.
+ *
+ * The caller adds all arcs (with their histories as label spans) in
+ * the order a serial pass would visit them. Run then splits that
+ * list into one block per thread. Each thread passes its windows in
+ * batches of label spans to ExtractFeaturesFct::ExtractBatch and
+ * interns the returned features in a ShardedFeatureNames, by hash
+ * and name (a hash alone could merge two features whose names
+ * collide). Finally, the feature IDs are assigned
+ * in the original arc order. The resulting IDs therefore do not
+ * depend on the number of threads. The feature extraction function
+ * is called from several threads at once; the plugins in features/
+ * are stateless and safe to use.
+ */
+template<class Arc>
+class ParallelFeatureInserter {
+
+ public:
+
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Label Label;
+  typedef ShardedFeatureNames::Key Key;
+
+  /**
+   * @brief A history, given as span [begin, end) into the stored
+   * history labels.
+   */
+  struct History {
+    std::size_t begin;
+    std::size_t end;
+    History() : begin(0), end(0) {}
+  };
+
+  ParallelFeatureInserter(const fst::SymbolTable& syms,
+                          fst::SymbolTable* feature_ids,
+                          features::ExtractFeaturesFct& extract_features_fct,
+                          const std::string& prefix,
+                          int num_threads = GetCreateNumThreads())
+      : feature_ids_(feature_ids),
+        extract_features_fct_(extract_features_fct),
+        prefix_(prefix),
+        num_threads_(num_threads),
+        names_dict_(GetHasherWithoutNames(feature_ids))
+  {
+    if (feature_ids_ == NULL) {
+      FSTR_CREATE_EXCEPTION("feature_ids is NULL");
+    }
+    for (fst::SymbolTableIterator sit(syms); !sit.Done(); sit.Next()) {
+      const int64 label = sit.Value();
+      if (label >= static_cast<int64>(names_.size())) {
+        names_.resize(label + 1);
+        has_name_.resize(label + 1, false);
+      }
+      names_[label] = sit.Symbol();
+      has_name_[label] = true;
+    }
+    for (std::size_t i = 0; i < names_.size(); ++i) {
+      name_ptrs_.push_back(has_name_[i] ? names_[i].c_str() : NULL);
+      name_lengths_.push_back(names_[i].length());
+    }
+    symbol_view_.names = name_ptrs_.empty() ? NULL : &name_ptrs_[0];
+    symbol_view_.lengths = name_lengths_.empty() ? NULL : &name_lengths_[0];
+    symbol_view_.num_symbols = names_.size();
+    prefix_hash_ = features::HashFeatureName(prefix_);
+  }
+
+  bool HasSymbol(Label label) const {
+    return label >= 0 && label < static_cast<Label>(has_name_.size())
+        && has_name_[label];
+  }
+
+  /**
+   * @brief Stores a history.
+   */
+  History AddHistory(const std::vector<Label>& labels) {
+    History h;
+    h.begin = hist_labels_.size();
+    hist_labels_.insert(hist_labels_.end(), labels.begin(), labels.end());
+    h.end = hist_labels_.size();
+    return h;
+  }
+
+  /**
+   * @brief Schedules the arc at position arc_pos of state s; its
+   * window is the history followed by label.
+   */
+  void AddArc(StateId s, std::size_t arc_pos, Label label, const History& h) {
+    ArcJob job;
+    job.state = s;
+    job.arc_pos = arc_pos;
+    job.label = label;
+    job.hist = h;
+    jobs_.push_back(job);
+  }
+
+  /**
+   * @brief Extracts the features of all scheduled arcs and inserts
+   * them into the arc weights.
+   */
+  void Run(fst::MutableFst<Arc>* fst) {
+    FSTR_TRACE_SPAN("insert_features");
+    util::Timer timer;
+    const int num_threads = std::max(1, std::min(num_threads_,
+                                                 static_cast<int>(jobs_.size())));
+    std::vector<Block> blocks(num_threads);
+    const std::size_t block_size = jobs_.size() / num_threads;
+    std::size_t first = 0;
+    for (int i = 0; i < num_threads; ++i) {
+      blocks[i].first = first;
+      blocks[i].last = i < num_threads - 1 ? first + block_size : jobs_.size();
+      first = blocks[i].last;
+    }
+    if (num_threads == 1) {
+      ExtractBlock_Fct f(this, &blocks[0]);
+      f();
+    }
+    else {
+      std::vector<boost::shared_ptr<boost::thread> > threads;
+      for (int i = 0; i < num_threads; ++i) {
+        ExtractBlock_Fct f(this, &blocks[i]);
+        threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(f)));
+      }
+      for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->join();
+      }
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      if (!blocks[i].error.empty()) {
+        FSTR_CREATE_EXCEPTION("Feature extraction failed: " << blocks[i].error);
+      }
+    }
+    InsertFeatures(blocks, fst);
+    timer.stop();
+    fprintf(stderr, "# Inserted %d distinct features into %d arcs (%d threads) [%2.2f ms, %2.2f MB]\n",
+            static_cast<int>(names_dict_.Size()), static_cast<int>(jobs_.size()),
+            num_threads, timer.get_elapsed_time_millis(),
+            util::MemoryInfo::instance().getSizeInMB());
+    jobs_.clear();
+    hist_labels_.clear();
+  }
+
+ private:
+
+  struct ArcJob {
+    StateId state;
+    std::size_t arc_pos;
+    Label label;
+    History hist;
+  };
+
+  /**
+   * @brief The jobs [first, last) of one thread and their features;
+   * the features of job first + i end at keys[arc_end[i]].
+   */
+  struct Block {
+    std::size_t first;
+    std::size_t last;
+    std::vector<Key> keys;
+    std::vector<std::size_t> arc_end;
+    std::string error;
+  };
+
+  struct ExtractBlock_Fct {
+    ParallelFeatureInserter* obj;
+    Block* block;
+    ExtractBlock_Fct(ParallelFeatureInserter* obj_, Block* block_)
+        : obj(obj_), block(block_) {}
+    void operator()() {
+      try {
+        obj->ExtractBlock(block);
+      }
+      catch (std::exception& e) {
+        block->error = e.what();
+      }
+    }
+  };
+
+  void ExtractBlock(Block* block) {
+    FSTR_TRACE_SPAN("extract_features");
+    std::vector<int> labels;
+    std::vector<std::size_t> offsets;
+    features::FeatureBatchOutput out;
+    std::string name;
+    block->arc_end.reserve(block->last - block->first);
+    for (std::size_t j0 = block->first; j0 < block->last; j0 += kBatchSize) {
+      const std::size_t j1 = std::min(j0 + kBatchSize, block->last);
+      labels.clear();
+      offsets.clear();
+      for (std::size_t j = j0; j < j1; ++j) {
+        const ArcJob& job = jobs_[j];
+        offsets.push_back(labels.size());
+        labels.insert(labels.end(), hist_labels_.begin() + job.hist.begin,
+                      hist_labels_.begin() + job.hist.end);
+        labels.push_back(job.label);
+      }
+      offsets.push_back(labels.size());
+      features::FeatureWindowBatch batch;
+      batch.labels = &labels[0];
+      batch.offsets = &offsets[0];
+      batch.num_windows = j1 - j0;
+      batch.symbols = &symbol_view_;
+      extract_features_fct_.ExtractBatch(batch, &out);
+      for (std::size_t i = 0; i < out.keys.size(); ++i) {
+        const uint64 hash = features::PrefixFeatureHash(prefix_hash_, out.keys[i].hash);
+        name.assign(prefix_);
+        name.append(extract_features_fct_.GetFeatureName(batch, out, i));
+        block->keys.push_back(names_dict_.Insert(hash, name));
+      }
+      const std::size_t keys_before = block->keys.size() - out.keys.size();
+      for (std::size_t w = 0; w < batch.num_windows; ++w) {
+        block->arc_end.push_back(keys_before + out.window_end[w]);
+      }
+    }
+  }
+
+  // Serial: assigns the final IDs in job order.
+  void InsertFeatures(const std::vector<Block>& blocks,
+                      fst::MutableFst<Arc>* fst) {
+    typedef fst::MutableArcIterator< fst::MutableFst<Arc> > MArcIter;
+    StateId current = fst::kNoStateId;
+    MArcIter* aiter = NULL;
+    for (std::size_t b = 0; b < blocks.size(); ++b) {
+      const Block& block = blocks[b];
+      std::size_t k = 0;
+      for (std::size_t j = block.first; j < block.last; ++j) {
+        const ArcJob& job = jobs_[j];
+        if (job.state != current) {
+          delete aiter;
+          aiter = new MArcIter(fst, job.state);
+          current = job.state;
+        }
+        aiter->Seek(job.arc_pos);
+        Arc arc = aiter->Value();
+        core::MDExpectations& expectations = arc.weight.GetMDExpectations();
+        const std::size_t end = block.arc_end[j - block.first];
+        for (; k < end; ++k) {
+          expectations.insert(names_dict_.Merge(block.keys[k], feature_ids_), 0.0);
+        }
+        aiter->SetValue(arc);
+      }
+    }
+    delete aiter;
+  }
+
+  /**
+   * @brief The hasher of feature_ids, if it does not keep the names
+   * (then names_dict_ does not store them either), or NULL.
+   */
+  static FeatureHasher* GetHasherWithoutNames(const fst::SymbolTable* feature_ids) {
+    FeatureHasher* hasher = GetFeatureHasher();
+    if (hasher != NULL && hasher->GetFeatureTable() == feature_ids
+        && !hasher->KeepsNames()) {
+      return hasher;
+    }
+    return NULL;
+  }
+
+  static const std::size_t kBatchSize = 256;
+
+  fst::SymbolTable* feature_ids_;
+  features::ExtractFeaturesFct& extract_features_fct_;
+  const std::string prefix_;
+  uint64 prefix_hash_;
+  const int num_threads_;
+  std::vector<std::string> names_;  // indexed by label
+  std::vector<bool> has_name_;
+  std::vector<const char*> name_ptrs_;
+  std::vector<std::size_t> name_lengths_;
+  features::FeatureSymbolView symbol_view_;
+  std::vector<Label> hist_labels_;
+  std::vector<ArcJob> jobs_;
+  ShardedFeatureNames names_dict_;
+
+};
+
+} } // end namespaces
+
+#endif
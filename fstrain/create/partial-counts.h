@@ -0,0 +1,184 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_CREATE_PARTIAL_COUNTS_H
+#define FSTRAIN_CREATE_PARTIAL_COUNTS_H
+
+#include <unistd.h> // close
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "fst/fst.h"
+#include "fst/mutable-fst.h"
+#include "fst/symbol-table.h"
+#include "fst/vector-fst.h"
+
+#include "fstrain/create/debug.h"
+#include "fstrain/create/ngram-counter.h"
+#include "fstrain/util/encoded-data.h" // GetFingerprint
+#include "fstrain/util/memory-governor.h"
+#include "fstrain/util/options.h"
+
+namespace fstrain { namespace create {
+
+/**
+ * @brief Returns the number of data pairs that model creation reads
+ * and aligns at a time, as set in option "create-chunk-size" (default
+ * 100000). Asked again for each chunk: if memory is short (see
+ * util::MemoryGovernor) the chunks get smaller, so the counts go to
+ * disk sooner.
+ */
+inline std::size_t GetCreateChunkSize() {
+  std::size_t n = 100000;
+  if (util::options.has("create-chunk-size")) {
+    const int n0 = util::options.get<int>("create-chunk-size");
+    n = n0 > 0 ? n0 : 1;
+  }
+  return util::MemoryGovernor::instance().GetChunkSize("model creation chunks", n);
+}
+
+/**
+ * @brief Returns the directory for the partial count files, as set in
+ * option "create-tmp-dir" (default $TMPDIR or /tmp).
+ */
+inline std::string GetCreateTmpDir() {
+  if (util::options.has("create-tmp-dir")) {
+    return util::options.get<std::string>("create-tmp-dir");
+  }
+  const char* tmpdir = getenv("TMPDIR");
+  return tmpdir != NULL ? tmpdir : "/tmp";
+}
+
+/**
+ * @brief Writes the counts trie of all the data, with the alignment
+ * symbols it was counted over, so that a later run can add counts of
+ * new data to it (see PartialCountFiles::AddFile).
+ */
+template<class Arc>
+void WriteCounts(const fst::Fst<Arc>& trie, const fst::SymbolTable& syms,
+                 const std::string& filename) {
+  fst::VectorFst<Arc> tmp(trie);
+  tmp.SetInputSymbols(&syms);
+  tmp.SetOutputSymbols(&syms);
+  if (!tmp.Write(filename)) {
+    FSTR_CREATE_EXCEPTION("Could not write counts to " << filename);
+  }
+}
+
+/**
+ * @brief Ngram count tries of parts of the data, kept in files until
+ * they are merged. Counting a chunk of data at a time and merging the
+ * tries at the end needs memory for one chunk and for the distinct
+ * ngrams, not for the whole corpus.
+ *
+ * The files written by Add are removed when the object goes away.
+ */
+template<class Arc>
+class PartialCountFiles : private boost::noncopyable {
+
+ public:
+
+  PartialCountFiles(int ngram_order,
+                    const std::string& dir = GetCreateTmpDir())
+      : ngram_order_(ngram_order), dir_(dir) {}
+
+  ~PartialCountFiles() {
+    for (std::size_t i = 0; i < filenames_.size(); ++i) {
+      if (is_tmp_file_[i]) {
+        std::remove(filenames_[i].c_str());
+      }
+    }
+  }
+
+  /**
+   * @brief Writes the counts trie (as returned by
+   * NgramCounter::GetResult) to the next file.
+   */
+  void Add(const fst::Fst<Arc>& trie) {
+    // unique even with several instances in one process
+    std::string pattern = dir_ + "/fstrain-counts-XXXXXX";
+    std::vector<char> buf(pattern.begin(), pattern.end());
+    buf.push_back('\0');
+    const int fd = mkstemp(&buf[0]);
+    if (fd < 0) {
+      FSTR_CREATE_EXCEPTION("Could not create a partial counts file in " << dir_);
+    }
+    close(fd);
+    const std::string filename(&buf[0]);
+    filenames_.push_back(filename); // removed by the destructor even if Write fails
+    is_tmp_file_.push_back(true);
+    if (!fst::VectorFst<Arc>(trie).Write(filename)) {
+      FSTR_CREATE_EXCEPTION("Could not write partial counts to " << filename);
+    }
+  }
+
+  /**
+   * @brief Adds counts from a file written by WriteCounts in an earlier
+   * run (incremental model creation); the file is kept.
+   */
+  void AddFile(const std::string& filename) {
+    filenames_.push_back(filename);
+    is_tmp_file_.push_back(false);
+  }
+
+  std::size_t size() const {
+    return filenames_.size();
+  }
+
+  /**
+   * @brief Merges all tries into one, which has the counts of all the
+   * data. If syms is given, throws if a file from AddFile has no
+   * symbol table or was counted over symbols other than syms.
+   */
+  void Merge(fst::MutableFst<Arc>* result,
+             const fst::SymbolTable* syms = NULL) const {
+    NgramCounter<Arc> counter(ngram_order_);
+    for (std::size_t i = 0; i < filenames_.size(); ++i) {
+      boost::scoped_ptr< fst::VectorFst<Arc> > trie(
+          fst::VectorFst<Arc>::Read(filenames_[i]));
+      if (trie.get() == NULL) {
+        FSTR_CREATE_EXCEPTION("Could not read partial counts from " << filenames_[i]);
+      }
+      if (syms != NULL && !is_tmp_file_[i] && trie->InputSymbols() == NULL) {
+        FSTR_CREATE_EXCEPTION("Counts in " << filenames_[i]
+                              << " have no symbol table (not written by WriteCounts?)");
+      }
+      if (syms != NULL && trie->InputSymbols() != NULL
+          && util::EncodedData::GetFingerprint(*trie->InputSymbols())
+          != util::EncodedData::GetFingerprint(*syms)) {
+        FSTR_CREATE_EXCEPTION("Counts in " << filenames_[i]
+                              << " were counted over different alignment symbols");
+      }
+      counter.AddTrie(*trie);
+    }
+    counter.GetResult(result);
+  }
+
+ private:
+  const int ngram_order_;
+  const std::string dir_;
+  std::vector<std::string> filenames_;
+  std::vector<bool> is_tmp_file_;
+};
+
+} } // end namespaces
+
+#endif
@@ -18,6 +18,7 @@
 #include <iostream>
 #include <fstream>
 #include "fst/symbol-table.h"
+#include "fstrain/create/feature-hashing.h"
 #include <boost/shared_ptr.hpp>
 #include "fstrain/util/options.h"
 
@@ -32,6 +33,15 @@ extern "C" {
       for (fst::SymbolTableIterator it(*feature_names); !it.Done(); it.Next()) {
         out << it.Symbol() << std::endl;
       }
+      // hashed features are not in the table
+      fstrain::create::FeatureHasher* hasher = fstrain::create::GetFeatureHasher();
+      if (hasher != NULL && hasher->GetFeatureTable() == feature_names.get()) {
+        if (fstrain::util::options.has("write-hashed-feature-names")) {
+          const std::string hashed_filename = std::string(*filename) + ".hashed";
+          std::cerr << "Writing " << hashed_filename << std::endl;
+          hasher->WriteNames(hashed_filename);
+        }
+      }
     }
     else {
       std::cerr << "Feature names not available. "
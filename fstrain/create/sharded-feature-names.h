@@ -0,0 +1,225 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_CREATE_SHARDED_FEATURE_NAMES_H
+#define FSTRAIN_CREATE_SHARDED_FEATURE_NAMES_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <tr1/unordered_map>
+
+#include <boost/thread/mutex.hpp>
+
+#include "fst/symbol-table.h"
+#include "fstrain/create/debug.h"
+#include "fstrain/create/feature-hashing.h"
+#include "fstrain/create/features/feature-batch.h"
+
+namespace fstrain { namespace create {
+
+/**
+ * @brief Thread-safe dictionary of feature names.
+ *
+ * Names are looked up by their 64-bit hash (see
+ * features::HashFeatureName), and the hash is only used to find the
+ * candidates: a name matches an entry only if the stored name is the
+ * same, so different names with the same hash get different keys.
+ * Names are spread over shards by hash value, and each shard has its
+ * own lock, so threads that intern different names rarely wait for
+ * each other. Insert returns a provisional key; the final dense
+ * feature IDs are assigned by Merge, after all threads are done, in
+ * an order that does not depend on thread scheduling.
+ *
+ * With a FeatureHasher, the names are not stored: an entry only keeps
+ * what the hasher needs to find the ID, i.e. the full hash of the
+ * name (HashFeatureName, which is compared instead of the name) and,
+ * for the names that are in the feature table already, their ID.
+ */
+class ShardedFeatureNames {
+
+  typedef std::tr1::unordered_multimap<uint64, int64> KeysByHash;
+
+  struct Shard {
+    boost::mutex mutex;
+    KeysByHash keys; // by name hash
+    std::deque<std::string> names;
+    std::deque<uint64> name_hashes; // instead of names, with a hasher
+    std::tr1::unordered_map<int64, int64> fixed_ids; // by index, with a hasher
+    std::vector<int64> final_ids;
+  };
+
+  static const int kShardBits = 6;
+  static const int64 kNumShards = 1 << kShardBits;
+
+  std::vector<Shard*> shards_;
+  FeatureHasher* hasher_;
+
+ public:
+
+  typedef int64 Key;
+
+  /**
+   * @brief If hasher is given, Merge gets the IDs from it, and the
+   * names are not stored.
+   */
+  explicit ShardedFeatureNames(FeatureHasher* hasher = NULL)
+      : hasher_(hasher) {
+    for (int64 i = 0; i < kNumShards; ++i) {
+      shards_.push_back(new Shard());
+    }
+  }
+
+  ~ShardedFeatureNames() {
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+      delete shards_[i];
+    }
+  }
+
+  /**
+   * @brief Returns the provisional key of the name, which has the
+   * given hash, or -1 if it is not interned yet. May be called from
+   * several threads at once.
+   */
+  Key Find(uint64 hash, const std::string& name) {
+    Shard& shard = *shards_[hash & (kNumShards - 1)];
+    if (hasher_ == NULL) {
+      boost::mutex::scoped_lock lock(shard.mutex);
+      return FindName(shard, hash, name);
+    }
+    const uint64 name_hash = features::HashFeatureName(name);
+    const int64 fixed_id = hasher_->GetFeatureTable()->Find(name);
+    boost::mutex::scoped_lock lock(shard.mutex);
+    return FindHashedName(shard, hash, name_hash, fixed_id);
+  }
+
+  /**
+   * @brief Interns a name with the given hash and returns its
+   * provisional key. May be called from several threads at once.
+   */
+  Key Insert(uint64 hash, const std::string& name) {
+    const int64 shard_id = hash & (kNumShards - 1);
+    Shard& shard = *shards_[shard_id];
+    if (hasher_ == NULL) {
+      boost::mutex::scoped_lock lock(shard.mutex);
+      const Key found = FindName(shard, hash, name);
+      if (found >= 0) {
+        return found;
+      }
+      const Key key = NewKey(shard_id, hash, &shard);
+      shard.names.push_back(name);
+      return key;
+    }
+    const uint64 name_hash = features::HashFeatureName(name);
+    const int64 fixed_id = hasher_->GetFeatureTable()->Find(name);
+    boost::mutex::scoped_lock lock(shard.mutex);
+    const Key found = FindHashedName(shard, hash, name_hash, fixed_id);
+    if (found >= 0) {
+      return found;
+    }
+    const Key key = NewKey(shard_id, hash, &shard);
+    if (fixed_id >= 0) {
+      shard.fixed_ids[shard.name_hashes.size()] = fixed_id;
+    }
+    shard.name_hashes.push_back(name_hash);
+    return key;
+  }
+
+  /**
+   * @brief Assigns the final ID of a provisional key by adding its
+   * name to the given symbol table (see AddFeatureName), unless that
+   * was done already; with a hasher, the ID comes from the hasher
+   * (feature_ids must be its feature table).
+   * Calling Merge on the keys in a fixed order gives the same IDs as
+   * adding the names serially in that order. Not thread-safe.
+   */
+  int64 Merge(Key key, fst::SymbolTable* feature_ids) {
+    Shard& shard = *shards_[key & (kNumShards - 1)];
+    const std::size_t index = key >> kShardBits;
+    if (shard.final_ids.size() < shard.keys.size()) {
+      shard.final_ids.resize(shard.keys.size(), -1);
+    }
+    int64& final_id = shard.final_ids[index];
+    if (final_id >= 0) {
+      return final_id;
+    }
+    if (hasher_ == NULL) {
+      final_id = AddFeatureName(shard.names[index], feature_ids);
+      return final_id;
+    }
+    if (hasher_->GetFeatureTable() != feature_ids) {
+      FSTR_CREATE_EXCEPTION("Feature hasher is for another feature table");
+    }
+    std::tr1::unordered_map<int64, int64>::const_iterator fixed =
+        shard.fixed_ids.find(index);
+    final_id = fixed != shard.fixed_ids.end()
+        ? fixed->second : hasher_->GetIdForHash(shard.name_hashes[index]);
+    return final_id;
+  }
+
+  std::size_t Size() const {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+      size += shards_[i]->keys.size();
+    }
+    return size;
+  }
+
+ private:
+
+  Key NewKey(int64 shard_id, uint64 hash, Shard* shard) {
+    const Key key = (static_cast<int64>(shard->keys.size()) << kShardBits) | shard_id;
+    shard->keys.insert(std::make_pair(hash, key));
+    return key;
+  }
+
+  Key FindName(const Shard& shard, uint64 hash, const std::string& name) const {
+    std::pair<KeysByHash::const_iterator, KeysByHash::const_iterator> range =
+        shard.keys.equal_range(hash);
+    for (KeysByHash::const_iterator it = range.first; it != range.second; ++it) {
+      if (shard.names[it->second >> kShardBits] == name) {
+        return it->second;
+      }
+    }
+    return -1;
+  }
+
+  // With a hasher: names with the same full hash get the same ID
+  // (unless only one is in the feature table).
+  Key FindHashedName(const Shard& shard, uint64 hash,
+                     uint64 name_hash, int64 fixed_id) const {
+    std::pair<KeysByHash::const_iterator, KeysByHash::const_iterator> range =
+        shard.keys.equal_range(hash);
+    for (KeysByHash::const_iterator it = range.first; it != range.second; ++it) {
+      const int64 index = it->second >> kShardBits;
+      if (shard.name_hashes[index] != name_hash) {
+        continue;
+      }
+      std::tr1::unordered_map<int64, int64>::const_iterator fixed =
+          shard.fixed_ids.find(index);
+      if ((fixed == shard.fixed_ids.end() ? -1 : fixed->second) == fixed_id) {
+        return it->second;
+      }
+    }
+    return -1;
+  }
+
+  ShardedFeatureNames(const ShardedFeatureNames&);  // disallowed
+  void operator=(const ShardedFeatureNames&);       // disallowed
+
+};
+
+} } // end namespaces
+
+#endif
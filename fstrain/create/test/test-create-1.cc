@@ -22,6 +22,9 @@
 #include "fstrain/create/noepshist/noepshist-create-scoring-fst.h"
 #include "fstrain/create/noepshist/backoff-iterator.h"
 #include "fstrain/create/noepshist/history-filter.h"
+#include "fstrain/create/noepshist/history-table.h"
+#include "fstrain/create/parallel-insert-features.h"
+#include "fstrain/create/sharded-feature-names.h"
 #include "fstrain/util/print-fst.h"
 
 BOOST_AUTO_TEST_SUITE(noepshist)
@@ -187,6 +190,94 @@ BOOST_AUTO_TEST_CASE( ExtendHistory_5 ) {
   BOOST_CHECK_EQUAL( hist, "ab|");
 }
 
+BOOST_AUTO_TEST_CASE( HistoryTable_1 ) {
+  using namespace fstrain::create::noepshist;
+  HistoryTable table('|', '-');
+  const HistoryId h = table.Find("ab|xy");
+  BOOST_CHECK_EQUAL(table.Find("ab|xy"), h);
+  BOOST_CHECK_EQUAL(table.ToString(h), "ab|xy");
+  BOOST_CHECK_EQUAL(table.ToString(table.Extend(h, 'c', 'z')), "abc|xyz");
+  BOOST_CHECK_EQUAL(table.ToString(table.Extend(h, '-', 'z')), "ab|xyz");
+  BOOST_CHECK_EQUAL(table.Extend(table.Find("a|"), 'b', '-'), table.Find("ab|"));
+  BOOST_CHECK_EQUAL(table.LeftLength(h), 2);
+  BOOST_CHECK_EQUAL(table.RightLength(table.Find("|")), 0);
+}
+
+BOOST_AUTO_TEST_CASE( HistoryTable_2 ) {
+  using namespace fstrain::create::noepshist;
+  HistoryTable table('|', '-');
+  const std::vector<HistoryId>& backoffs = table.Backoffs(table.Find("Sab|Sxy"));
+  BackoffIterator biter("Sab|Sxy");
+  for (std::size_t i = 0; i < backoffs.size(); ++i, biter.Next()) {
+    BOOST_CHECK_EQUAL(biter.Done(), false);
+    BOOST_CHECK_EQUAL(table.ToString(backoffs[i]), biter.Value());
+  }
+  BOOST_CHECK_EQUAL(biter.Done(), true);
+  HistoryFilter_Length hist_filter(2, 2, '|');
+  BOOST_CHECK_EQUAL(table.ToString(table.Backoff(table.Find("Sa|xyz"), &hist_filter)),
+                    "Sa|yz");
+}
+
+BOOST_AUTO_TEST_CASE( ShardedFeatureNames_Collision ) {
+  using fstrain::create::ShardedFeatureNames;
+  ShardedFeatureNames names;
+  const ShardedFeatureNames::Key a = names.Insert(42, "a");
+  BOOST_CHECK_EQUAL(names.Find(42, "a"), a);
+  BOOST_CHECK_EQUAL(names.Find(42, "b"), -1); // same hash, other name
+  const ShardedFeatureNames::Key b = names.Insert(42, "b");
+  BOOST_CHECK(a != b);
+  BOOST_CHECK_EQUAL(names.Insert(42, "a"), a);
+  BOOST_CHECK_EQUAL(names.Insert(42, "b"), b);
+  BOOST_CHECK_EQUAL(names.Find(42, "b"), b);
+  fst::SymbolTable feature_ids("feature-ids");
+  BOOST_CHECK(names.Merge(a, &feature_ids) != names.Merge(b, &feature_ids));
+}
+
+// Gives all features the same hash.
+struct CollidingFeaturesFct : public fstrain::create::features::ExtractFeaturesFct {
+  void operator()(const std::string& window,
+                  fstrain::create::features::IFeatureSet* featset) {
+    featset->insert(window);
+  }
+  void ExtractBatch(const fstrain::create::features::FeatureWindowBatch& batch,
+                    fstrain::create::features::FeatureBatchOutput* out) {
+    ExtractFeaturesFct::ExtractBatch(batch, out);
+    for (std::size_t i = 0; i < out->keys.size(); ++i) {
+      out->keys[i].hash = 42;
+    }
+  }
+};
+
+BOOST_AUTO_TEST_CASE( ParallelFeatureInserter_Collision ) {
+  using namespace fstrain::create;
+  using namespace fst;
+  SymbolTable syms("syms");
+  syms.AddSymbol("-");
+  const int a = syms.AddSymbol("a");
+  const int b = syms.AddSymbol("b");
+  VectorFst<MDExpectationArc> fst;
+  const int s = fst.AddState();
+  fst.SetStart(s);
+  fst.AddArc(s, MDExpectationArc(a, a, MDExpectationWeight::One(), s));
+  fst.AddArc(s, MDExpectationArc(b, b, MDExpectationWeight::One(), s));
+  SymbolTable feature_ids("feature-ids");
+  CollidingFeaturesFct extract_features_fct;
+  ParallelFeatureInserter<MDExpectationArc> inserter(syms, &feature_ids,
+                                                     extract_features_fct, "", 2);
+  const ParallelFeatureInserter<MDExpectationArc>::History hist =
+      inserter.AddHistory(std::vector<int>());
+  inserter.AddArc(s, 0, a, hist);
+  inserter.AddArc(s, 1, b, hist);
+  inserter.Run(&fst);
+  BOOST_CHECK_EQUAL(feature_ids.NumSymbols(), 2); // not merged
+  ArcIterator< VectorFst<MDExpectationArc> > aiter(fst, s);
+  const int feat_a = aiter.Value().weight.GetMDExpectations().begin()->first;
+  aiter.Next();
+  const int feat_b = aiter.Value().weight.GetMDExpectations().begin()->first;
+  BOOST_CHECK_EQUAL(feature_ids.Find(feat_a), "a");
+  BOOST_CHECK_EQUAL(feature_ids.Find(feat_b), "b");
+}
+
 BOOST_AUTO_TEST_CASE( CreateScoringFst ) {
   using namespace fstrain::create::noepshist;
   using namespace fst;
@@ -16,7 +16,10 @@
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 
+#include "fst/symbol-table.h"
+#include "fstrain/create/feature-hashing.h"
 #include "fstrain/create/get-features.h"
+#include "fstrain/create/sharded-feature-names.h"
 
 BOOST_AUTO_TEST_SUITE(features)
 
@@ -52,6 +55,62 @@ BOOST_AUTO_TEST_CASE( GetFeatures_4 ) {
   BOOST_CHECK_EQUAL(n, 0);
 }
 
+BOOST_AUTO_TEST_CASE( FeatureHashing_1 ) {
+  using namespace fstrain::create;
+  fst::SymbolTable feature_ids("feature-ids");
+  feature_ids.AddSymbol("*LENGTH_IN*");
+  feature_ids.AddSymbol("*LENGTH_OUT*");
+  SetFeatureHasher(new FeatureHasher(&feature_ids, 4));
+  BOOST_CHECK_EQUAL(GetFeatureHasher()->NumParams(), 2 + 16);
+  // fixed features keep their IDs
+  BOOST_CHECK_EQUAL(AddFeatureName("*LENGTH_OUT*", &feature_ids), 1);
+  const int64 id = AddFeatureName("a|x b|y", &feature_ids);
+  BOOST_CHECK(id >= 2 && id < 2 + 16);
+  BOOST_CHECK_EQUAL(AddFeatureName("a|x b|y", &feature_ids), id);
+  BOOST_CHECK_EQUAL(feature_ids.Find("a|x b|y"), -1); // not stored
+  // other tables are not affected
+  fst::SymbolTable other_ids("other-ids");
+  BOOST_CHECK_EQUAL(AddFeatureName("a|x b|y", &other_ids), 0);
+  SetFeatureHasher(NULL);
+  BOOST_CHECK_EQUAL(AddFeatureName("a|x b|y", &feature_ids), 2);
+}
+
+BOOST_AUTO_TEST_CASE( FeatureHashing_2 ) {
+  using namespace fstrain::create;
+  fst::SymbolTable feature_ids("feature-ids");
+  FeatureHasher hasher(&feature_ids, 1);
+  hasher.GetId("a|x");
+  hasher.GetId("b|y");
+  hasher.GetId("c|z");
+  hasher.GetId("a|x");
+  // three names in two buckets
+  BOOST_CHECK(hasher.NumUsedBuckets() >= 1 && hasher.NumUsedBuckets() <= 2);
+  BOOST_CHECK(hasher.NumCollisions() >= 1);
+}
+
+BOOST_AUTO_TEST_CASE( FeatureHashing_ShardedFeatureNames ) {
+  using namespace fstrain::create;
+  fst::SymbolTable feature_ids("feature-ids");
+  feature_ids.AddSymbol("*LENGTH_IN*");
+  FeatureHasher hasher(&feature_ids, 4);
+  ShardedFeatureNames names(&hasher); // does not store the names
+  const ShardedFeatureNames::Key a = names.Insert(42, "a|x");
+  const ShardedFeatureNames::Key b = names.Insert(42, "b|y"); // same hash
+  const ShardedFeatureNames::Key len = names.Insert(7, "*LENGTH_IN*");
+  BOOST_CHECK(a != b);
+  BOOST_CHECK_EQUAL(names.Insert(42, "a|x"), a);
+  BOOST_CHECK_EQUAL(names.Find(42, "b|y"), b);
+  BOOST_CHECK_EQUAL(names.Find(42, "c|z"), -1);
+  BOOST_CHECK_EQUAL(names.Size(), 3);
+  fst::SymbolTable expected_ids("expected-ids");
+  expected_ids.AddSymbol("*LENGTH_IN*");
+  FeatureHasher expected_hasher(&expected_ids, 4);
+  BOOST_CHECK_EQUAL(names.Merge(a, &feature_ids), expected_hasher.GetId("a|x"));
+  BOOST_CHECK_EQUAL(names.Merge(b, &feature_ids), expected_hasher.GetId("b|y"));
+  BOOST_CHECK_EQUAL(names.Merge(len, &feature_ids), 0); // keeps its ID
+  BOOST_CHECK_EQUAL(feature_ids.NumSymbols(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
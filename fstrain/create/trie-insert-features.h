@@ -20,13 +20,16 @@
 #include "fst/symbol-table.h"
 #include "fstrain/core/expectations.h"
 #include "fstrain/create/debug.h"
+#include "fstrain/create/feature-hashing.h"
 // #include "fstrain/create/feature-functions.h"
 // #include "fstrain/create/get-features.h"
 // #include "fstrain/util/options.h"
 #include "fstrain/create/features/extract-features.h"
 #include "fstrain/create/features/feature-set.h"
+#include "fstrain/create/parallel-insert-features.h"
 
 #include <set>
+#include <vector>
 
 namespace fstrain { namespace create {
 
@@ -39,7 +42,7 @@ struct FeatureSetWrapper {
       : syms_(syms), expectations_(expectations) {}
 
   void insert(const std::string& str) {
-    int64 id = syms_->AddSymbol(str);
+    int64 id = AddFeatureName(str, syms_);
     expectations_->insert(id, 0.0);
   }
 
@@ -70,34 +73,32 @@ struct MyFeatureSet : public features::IFeatureSet {
   std::string prefix_;
 };
 
+/**
+ * @brief Schedules the arcs of the trie below state in depth-first
+ * order, each with the labels on its path as history.
+ */
 template<class Arc>
-void TrieInsertFeatures0(const fst::SymbolTable& syms,
-                         std::string history,
-                         fst::SymbolTable* feature_ids,
-                         features::ExtractFeaturesFct& extract_features_fct,
-                         const std::string prefix,
-                         fst::MutableFst<Arc>* trie,
-                         typename Arc::StateId state) {
+void TrieInsertFeatures0(std::vector<typename Arc::Label>* history,
+                         const fst::Fst<Arc>& trie,
+                         typename Arc::StateId state,
+                         ParallelFeatureInserter<Arc>* inserter) {
   using namespace fst;
-  typedef typename Arc::StateId StateId;
-  for (fst::MutableArcIterator< MutableFst<Arc> > ait(trie, state);
-      !ait.Done(); ait.Next()) {
-    Arc arc = ait.Value();
-    const std::string symbol = syms.Find(arc.ilabel);
-    if (symbol == "") {
+  typedef typename ParallelFeatureInserter<Arc>::History History;
+  if (trie.NumArcs(state) == 0) {
+    return;
+  }
+  const History hist = inserter->AddHistory(*history);
+  std::size_t arc_pos = 0;
+  for (fst::ArcIterator< Fst<Arc> > ait(trie, state);
+      !ait.Done(); ait.Next(), ++arc_pos) {
+    const Arc& arc = ait.Value();
+    if (!inserter->HasSymbol(arc.ilabel)) {
       FSTR_CREATE_EXCEPTION("Could not find label " << arc.ilabel);
     }
-    const std::string nexthist = history + (history.length() ? " " : "")
-        + symbol;
-    core::MDExpectations& expectations = arc.weight.GetMDExpectations();
-    MyFeatureSet featset(feature_ids, &expectations);
-    featset.SetPrefix(prefix);
-    // GetFeatures(nexthist, &featset);
-    extract_features_fct(nexthist, &featset);
-    ait.SetValue(arc);
-    TrieInsertFeatures0(syms, nexthist, feature_ids, extract_features_fct,
-                        prefix, trie, arc.nextstate);
-
+    inserter->AddArc(state, arc_pos, arc.ilabel, hist);
+    history->push_back(arc.ilabel);
+    TrieInsertFeatures0(history, trie, arc.nextstate, inserter);
+    history->pop_back();
   }
 }
 
@@ -105,7 +106,8 @@ void TrieInsertFeatures0(const fst::SymbolTable& syms,
 
 /**
  * @brief Inserts features into trie by expressing history as string
- * (e.g. S|S-c1 a|x-c1) and getting features using GetFeatures.
+ * (e.g. S|S-c1 a|x-c1) and getting features using GetFeatures. The
+ * features are extracted in parallel, see ParallelFeatureInserter.
  */
 template<class Arc>
 void TrieInsertFeatures(const fst::SymbolTable& syms,
@@ -114,12 +116,11 @@ void TrieInsertFeatures(const fst::SymbolTable& syms,
                         const std::string prefix,
                         fst::MutableFst<Arc>* trie) {
   using namespace nsTrieInsertFeaturesUtil;
-  std::string history;
-  TrieInsertFeatures0(syms, history,
-                      feature_ids,
-                      extract_features_fct,
-                      prefix,
-                      trie, trie->Start());
+  ParallelFeatureInserter<Arc> inserter(syms, feature_ids,
+                                        extract_features_fct, prefix);
+  std::vector<typename Arc::Label> history;
+  TrieInsertFeatures0(&history, *trie, trie->Start(), &inserter);
+  inserter.Run(trie);
 }
 
 } } // end namespaces fstrain::create
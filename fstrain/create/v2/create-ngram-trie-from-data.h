@@ -7,6 +7,7 @@
 #include "fst/symbol-table.h"
 #include "fst/mutable-fst.h"
 #include "fstrain/util/data.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/create/ngram-counter.h"
 #include "fstrain/create/v2/create-lattice.h"
@@ -32,14 +33,16 @@ void CreateNgramTrieFromData(
   using util::Data;
   NgramCounter<Arc>* ngram_counter = new NgramCounter<Arc>(ngram_order);
   int cnt = 0;
+  std::vector<typename Arc::Label> input_labels;
+  std::vector<typename Arc::Label> output_labels;
   for (Data::const_iterator it = data.begin(); it != data.end(); ++it, ++cnt) {
     if (cnt % 1000 == 0) {
       std::cerr << cnt << std::endl;
     }
-    VectorFst<Arc> input;
-    VectorFst<Arc> output;
-    util::ConvertStringToFst(it->first, isyms, &input);
-    util::ConvertStringToFst(it->second, osyms, &output);
+    util::ConvertStringToLabels(it->first, isyms, &input_labels);
+    util::ConvertStringToLabels(it->second, osyms, &output_labels);
+    util::LinearFst<Arc> input(input_labels);
+    util::LinearFst<Arc> output(output_labels);
     VectorFst<Arc> lattice;
     CreateLattice(input, output, proj_up, proj_down, &lattice);
     ngram_counter->AddCounts(lattice);
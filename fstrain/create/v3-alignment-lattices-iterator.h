@@ -24,6 +24,7 @@
 
 #include "fstrain/util/data.h"
 #include "fstrain/util/options.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 
 #include "fstrain/create/prune-fct.h"
@@ -76,10 +77,12 @@ class AlignmentLatticesIterator {
 
   FstPtr Value() const {
     using namespace fst;
-    VectorFst<Arc> in_fst;
-    VectorFst<Arc> out_fst;
-    util::ConvertStringToFst(curr_->first, *isymbols_, &in_fst);
-    util::ConvertStringToFst(curr_->second, *osymbols_, &out_fst);
+    std::vector<typename Arc::Label> in_labels;
+    std::vector<typename Arc::Label> out_labels;
+    util::ConvertStringToLabels(curr_->first, *isymbols_, &in_labels);
+    util::ConvertStringToLabels(curr_->second, *osymbols_, &out_labels);
+    util::LinearFst<Arc> in_fst(in_labels);
+    util::LinearFst<Arc> out_fst(out_labels);
     MutableFst<Arc>* aligned = new VectorFst<Arc>();
 
     if (use_sigma_label_) {
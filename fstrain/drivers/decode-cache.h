@@ -0,0 +1,269 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_DRIVERS_DECODE_CACHE_H
+#define FSTRAIN_DRIVERS_DECODE_CACHE_H
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <sstream>
+#include <string>
+#include <tr1/unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "fst/fst.h"
+
+#include "fstrain/drivers/debug.h"
+#include "fstrain/drivers/decode-util.h"
+
+namespace fstrain { namespace drivers {
+
+/**
+ * @brief LRU cache from input label sequences to decoded outputs,
+ * bounded by an (estimated) size in bytes. Safe to share between
+ * threads.
+ *
+ * The cache can be written to a file and read back, so that a
+ * restarted decoder does not start cold. The file starts with a tag
+ * line; entries are only read back if the tag matches, so the tag
+ * should identify the model and decoder options (see
+ * GetModelFingerprint).
+ */
+class DecodeCache {
+
+ public:
+  typedef fst::StdArc::Label Label;
+
+  DecodeCache(std::size_t max_bytes, const std::string& tag = "")
+      : max_bytes_(max_bytes), tag_(tag), num_bytes_(0),
+        num_hits_(0), num_misses_(0) {}
+
+  /**
+   * @brief Path, size and modification time of the model file, for
+   * the tag; a model retrained at the same path gets a new one.
+   */
+  static std::string GetModelFingerprint(const std::string& filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+      FSTR_DRIVERS_EXCEPTION("Could not stat " << filename);
+    }
+    std::stringstream ss;
+    ss << filename << " " << st.st_size << " " << st.st_mtime;
+    return ss.str();
+  }
+
+  bool Lookup(const std::vector<Label>& input,
+              std::vector<DecodedOutput>* outputs) {
+    const std::string key = GetKey(input);
+    boost::mutex::scoped_lock lock(mutex_);
+    Index::iterator found = index_.find(key);
+    if (found == index_.end()) {
+      ++num_misses_;
+      return false;
+    }
+    ++num_hits_;
+    entries_.splice(entries_.begin(), entries_, found->second); // most recent
+    *outputs = found->second->second;
+    return true;
+  }
+
+  void Insert(const std::vector<Label>& input,
+              const std::vector<DecodedOutput>& outputs) {
+    Insert(GetKey(input), outputs);
+  }
+
+  std::size_t NumEntries() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return entries_.size();
+  }
+
+  std::size_t NumBytes() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return num_bytes_;
+  }
+
+  long NumHits() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return num_hits_;
+  }
+
+  long NumMisses() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return num_misses_;
+  }
+
+  double HitRate() {
+    boost::mutex::scoped_lock lock(mutex_);
+    const long total = num_hits_ + num_misses_;
+    return total == 0 ? 0.0 : num_hits_ / (double)total;
+  }
+
+  /**
+   * @brief Writes the entries, most recent last (so that reading them
+   * back restores the order). Writes to a temporary file first.
+   */
+  void Write(const std::string& filename) {
+    const std::string tmp_filename = filename + ".tmp";
+    {
+      std::ofstream out(tmp_filename.c_str());
+      if (!out) {
+        FSTR_DRIVERS_EXCEPTION("Could not write " << tmp_filename);
+      }
+      out.precision(10);
+      out << "# " << tag_ << "\n";
+      boost::mutex::scoped_lock lock(mutex_);
+      for (Entries::reverse_iterator it = entries_.rbegin();
+           it != entries_.rend(); ++it) {
+        out << it->first;
+        for (std::size_t i = 0; i < it->second.size(); ++i) {
+          out << "\t" << it->second[i].output << "\t" << it->second[i].neglogprob
+              << "\t" << it->second[i].logposterior;
+        }
+        out << "\n";
+      }
+    }
+    if (rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+      FSTR_DRIVERS_EXCEPTION("Could not rename " << tmp_filename);
+    }
+  }
+
+  /**
+   * @brief Reads entries written by Write(); returns the number of
+   * entries read (0 if the file is missing or has a different tag).
+   */
+  std::size_t Read(const std::string& filename) {
+    std::ifstream in(filename.c_str());
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+      return 0;
+    }
+    if (line != "# " + tag_) {
+      std::cerr << "Warning: Ignoring cache file " << filename
+                << " (written for a different model or options)" << std::endl;
+      return 0;
+    }
+    std::size_t num_read = 0;
+    while (std::getline(in, line)) {
+      std::vector<std::string> fields;
+      std::string::size_type pos = 0;
+      while (true) {
+        const std::string::size_type tab = line.find('\t', pos);
+        fields.push_back(line.substr(pos, tab == std::string::npos ? tab : tab - pos));
+        if (tab == std::string::npos) {
+          break;
+        }
+        pos = tab + 1;
+      }
+      if (fields.size() % 3 != 1) {
+        FSTR_DRIVERS_EXCEPTION("Bad line in " << filename << ": " << line);
+      }
+      std::vector<DecodedOutput> outputs;
+      for (std::size_t i = 1; i + 2 < fields.size(); i += 3) {
+        DecodedOutput out;
+        out.output = fields[i];
+        std::stringstream ss(fields[i + 1] + " " + fields[i + 2]);
+        ss >> out.neglogprob >> out.logposterior;
+        outputs.push_back(out);
+      }
+      Insert(fields[0], outputs);
+      ++num_read;
+    }
+    return num_read;
+  }
+
+ private:
+  typedef std::pair<std::string, std::vector<DecodedOutput> > Entry;
+  typedef std::list<Entry> Entries;
+  typedef std::tr1::unordered_map<std::string, Entries::iterator> Index;
+
+  static std::string GetKey(const std::vector<Label>& input) {
+    std::stringstream ss;
+    for (std::size_t i = 0; i < input.size(); ++i) {
+      if (i > 0) {
+        ss << " ";
+      }
+      ss << input[i];
+    }
+    return ss.str();
+  }
+
+  /**
+   * @brief Rough memory use of an entry, including the list node and
+   * the index entry.
+   */
+  static std::size_t GetNumBytes(const Entry& entry) {
+    std::size_t n = 2 * entry.first.capacity() + 96;
+    for (std::size_t i = 0; i < entry.second.size(); ++i) {
+      n += sizeof(DecodedOutput) + entry.second[i].output.capacity();
+    }
+    return n;
+  }
+
+  void Insert(const std::string& key, const std::vector<DecodedOutput>& outputs) {
+    boost::mutex::scoped_lock lock(mutex_);
+    Index::iterator found = index_.find(key);
+    if (found != index_.end()) { // decoded by another thread meanwhile
+      entries_.splice(entries_.begin(), entries_, found->second);
+      return;
+    }
+    entries_.push_front(Entry(key, outputs));
+    index_[key] = entries_.begin();
+    num_bytes_ += GetNumBytes(entries_.front());
+    while (num_bytes_ > max_bytes_ && !entries_.empty()) {
+      const Entry& last = entries_.back();
+      num_bytes_ -= GetNumBytes(last);
+      index_.erase(last.first);
+      entries_.pop_back();
+    }
+  }
+
+  const std::size_t max_bytes_;
+  const std::string tag_;
+  boost::mutex mutex_;
+  Entries entries_; // most recent first
+  Index index_;
+  std::size_t num_bytes_;
+  long num_hits_;
+  long num_misses_;
+};
+
+/**
+ * @brief DecodeLabels with a cache (which may be NULL). Results that
+ * depend on the decoder's time limit are not cached.
+ */
+inline bool DecodeLabelsCached(const std::vector<fst::StdArc::Label>& input,
+                               const util::LabelIndexedFst<fst::StdArc>& model,
+                               const fst::SymbolTable& osymbols,
+                               const util::MapStringDecoderOptions& opts,
+                               DecodeCache* cache,
+                               std::vector<DecodedOutput>* result) {
+  if (cache != NULL && cache->Lookup(input, result)) {
+    return true;
+  }
+  const bool exact = DecodeLabels(input, model, osymbols, opts, result);
+  if (cache != NULL && !result->empty() && (exact || opts.timelimit_ms < 0)) {
+    cache->Insert(input, *result);
+  }
+  return exact;
+}
+
+} } // end namespaces
+
+#endif
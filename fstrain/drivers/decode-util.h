@@ -0,0 +1,132 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_DRIVERS_DECODE_UTIL_H
+#define FSTRAIN_DRIVERS_DECODE_UTIL_H
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fst/compose.h"
+#include "fst/fst.h"
+#include "fst/project.h"
+#include "fst/symbol-table.h"
+#include "fst/vector-fst.h"
+
+#include "fstrain/util/map-string-decoder.h"
+#include "fstrain/util/print-path.h"
+#include "fstrain/util/string-compose.h"
+#include "fstrain/util/string-to-fst.h"
+
+namespace fstrain { namespace drivers {
+
+/**
+ * @brief A decoded output string, its negative log probability and
+ * its log posterior given the input (normalized by the path sum of
+ * input o model).
+ */
+struct DecodedOutput {
+  std::string output;
+  double neglogprob;
+  double logposterior;
+};
+
+namespace nsDecodeUtil {
+
+inline void GetOutputs(const std::vector<util::DecodedString<fst::StdArc::Label> >& best,
+                       double total_weight,
+                       const fst::SymbolTable& osymbols,
+                       std::vector<DecodedOutput>* result) {
+  result->clear();
+  for (std::size_t i = 0; i < best.size(); ++i) {
+    std::stringstream ss;
+    for (std::size_t j = 0; j < best[i].labels.size(); ++j) {
+      if (j > 0) {
+        ss << " ";
+      }
+      util::PrintLabel(best[i].labels[j], &osymbols, &ss);
+    }
+    DecodedOutput out;
+    out.output = ss.str();
+    out.neglogprob = best[i].neglogprob;
+    out.logposterior = total_weight - best[i].neglogprob;
+    result->push_back(out);
+  }
+}
+
+} // end namespace nsDecodeUtil
+
+/**
+ * @brief Decodes an input FST with the model; the outputs are the
+ * most probable output strings, best first (see
+ * util::MapStringDecoder). Returns false if the decoder was cut by
+ * its beam or time limit.
+ */
+inline bool DecodeFst(const fst::Fst<fst::StdArc>& input,
+                      const fst::Fst<fst::StdArc>& model,
+                      const fst::SymbolTable& osymbols,
+                      const util::MapStringDecoderOptions& opts,
+                      std::vector<DecodedOutput>* result) {
+  using namespace fst;
+  ComposeFst<StdArc> composed(input, model);
+  ProjectFst<StdArc> all_output_paths(composed, PROJECT_OUTPUT);
+  std::vector<util::DecodedString<StdArc::Label> > best;
+  double total_weight;
+  const bool exact =
+      util::DecodeMapStrings(all_output_paths, opts, &best, &total_weight);
+  nsDecodeUtil::GetOutputs(best, total_weight, osymbols, result);
+  return exact;
+}
+
+/**
+ * @brief Same as DecodeFst, for an input label sequence and an
+ * indexed model (see util::ComposeString).
+ */
+inline bool DecodeLabels(const std::vector<fst::StdArc::Label>& input,
+                         const util::LabelIndexedFst<fst::StdArc>& model,
+                         const fst::SymbolTable& osymbols,
+                         const util::MapStringDecoderOptions& opts,
+                         std::vector<DecodedOutput>* result) {
+  using namespace fst;
+  VectorFst<StdArc> all_output_paths;
+  util::ComposeString(input, model, &all_output_paths);
+  Project(&all_output_paths, PROJECT_OUTPUT);
+  std::vector<util::DecodedString<StdArc::Label> > best;
+  double total_weight;
+  const bool exact =
+      util::DecodeMapStrings(all_output_paths, opts, &best, &total_weight);
+  nsDecodeUtil::GetOutputs(best, total_weight, osymbols, result);
+  return exact;
+}
+
+/**
+ * @brief Same as DecodeLabels, for an input string like "a b c";
+ * unknown input symbols are removed.
+ */
+inline bool DecodeString(const std::string& input,
+                         const util::LabelIndexedFst<fst::StdArc>& model,
+                         const fst::SymbolTable& isymbols,
+                         const fst::SymbolTable& osymbols,
+                         const util::MapStringDecoderOptions& opts,
+                         std::vector<DecodedOutput>* result) {
+  std::vector<fst::StdArc::Label> labels;
+  const bool delete_unknown_chars = true;
+  util::ConvertStringToLabels(input, isymbols, &labels, delete_unknown_chars);
+  return DecodeLabels(labels, model, osymbols, opts, result);
+}
+
+} } // end namespaces
+
+#endif
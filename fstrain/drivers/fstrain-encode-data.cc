@@ -0,0 +1,115 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+// Converts a text data file (input and output strings on alternating
+// lines) to the binary format of util::EncodedData, which the trainer
+// maps into memory instead of parsing. Unknown tokens are an error
+// here rather than during training.
+
+#include "fst/symbol-table.h"
+
+#include "fstrain/util/data.h"
+#include "fstrain/util/encoded-data.h"
+#include "fstrain/util/memory-info.h"
+#include "fstrain/util/timer.h"
+
+#include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace po = boost::program_options;
+
+using namespace fst;
+using namespace fstrain;
+
+int main(int ac, char** av) {
+  try{
+
+    po::options_description generic("Allowed options");
+    generic.add_options()
+        ("help", "produce help message")
+        ("isymbols", po::value<std::string>(), "symbol table for input words")
+        ("osymbols", po::value<std::string>(), "symbol table for output words")
+        ;
+
+    po::options_description hidden("Hidden options");
+    hidden.add_options()
+        ("input-file", po::value< std::string >(), "input file")
+        ("output-file", po::value< std::string >(), "output file")
+        ;
+
+    po::options_description cmdline_options;
+    cmdline_options.add(generic).add(hidden);
+
+    po::positional_options_description p;
+    p.add("input-file", 1);
+    p.add("output-file", 1);
+
+    po::variables_map vm;
+    store(po::command_line_parser(ac, av).
+	  options(cmdline_options).positional(p).run(), vm);
+
+    if (vm.count("help")) {
+      std::cout << "Usage: " << av[0] << " [options] text-data encoded-data\n";
+      std::cout << generic << "\n";
+      return EXIT_FAILURE;
+    }
+
+    if (vm.count("isymbols") == 0) {
+      std::cerr << "Please specify symbol table with --isymbols" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (vm.count("osymbols") == 0) {
+      std::cerr << "Please specify symbol table with --osymbols" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (vm.count("input-file") == 0 || vm.count("output-file") == 0) {
+      std::cerr << "Please give input and output file as arguments" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    boost::scoped_ptr<SymbolTable> isymbols(
+        SymbolTable::ReadText(vm["isymbols"].as<std::string>()));
+    boost::scoped_ptr<SymbolTable> osymbols(
+        SymbolTable::ReadText(vm["osymbols"].as<std::string>()));
+
+    const std::string input_filename = vm["input-file"].as<std::string>();
+    const std::string output_filename = vm["output-file"].as<std::string>();
+
+    util::Timer timer;
+    util::Data data(input_filename);
+    if (data.IsEncoded()) {
+      std::cerr << input_filename << " is already encoded" << std::endl;
+      return EXIT_FAILURE;
+    }
+    util::EncodedData::Write(data, *isymbols, *osymbols, output_filename);
+    timer.stop();
+    fprintf(stderr, "# Encoded %d examples [%2.2f ms, %2.2f MB]\n",
+            (int)data.size(), timer.get_elapsed_time_millis(),
+            util::MemoryInfo::instance().getSizeInMB());
+
+  }
+  catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
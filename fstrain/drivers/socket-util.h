@@ -0,0 +1,236 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_DRIVERS_SOCKET_UTIL_H
+#define FSTRAIN_DRIVERS_SOCKET_UTIL_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "fstrain/drivers/debug.h"
+
+namespace fstrain { namespace drivers {
+
+/**
+ * @brief Address of a local socket: a Unix domain socket if path is
+ * set, otherwise localhost TCP on the given port.
+ */
+struct SocketAddress {
+  std::string path;
+  int port;
+  SocketAddress() : port(-1) {}
+  SocketAddress(const std::string& path_, int port_)
+      : path(path_), port(port_) {}
+  bool IsSet() const {
+    return !path.empty() || port > 0;
+  }
+  std::string ToString() const {
+    if (!path.empty()) {
+      return "unix:" + path;
+    }
+    std::stringstream ss;
+    ss << "127.0.0.1:" << port;
+    return ss.str();
+  }
+};
+
+/**
+ * @brief Opens a listening socket; throws on error.
+ */
+inline int Listen(const SocketAddress& addr, int backlog = 128) {
+  int fd = -1;
+  if (!addr.path.empty()) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      FSTR_DRIVERS_EXCEPTION("socket: " << strerror(errno));
+    }
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (addr.path.length() >= sizeof(sa.sun_path)) {
+      close(fd);
+      FSTR_DRIVERS_EXCEPTION("Socket path too long: " << addr.path);
+    }
+    strncpy(sa.sun_path, addr.path.c_str(), sizeof(sa.sun_path) - 1);
+    unlink(addr.path.c_str()); // left over from an earlier run
+    if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+      close(fd);
+      FSTR_DRIVERS_EXCEPTION("bind " << addr.path << ": " << strerror(errno));
+    }
+  }
+  else {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      FSTR_DRIVERS_EXCEPTION("socket: " << strerror(errno));
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = htons(addr.port);
+    if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+      close(fd);
+      FSTR_DRIVERS_EXCEPTION("bind port " << addr.port << ": " << strerror(errno));
+    }
+  }
+  if (listen(fd, backlog) < 0) {
+    close(fd);
+    FSTR_DRIVERS_EXCEPTION("listen: " << strerror(errno));
+  }
+  return fd;
+}
+
+/**
+ * @brief Connects to a listening socket; throws on error.
+ */
+inline int Connect(const SocketAddress& addr) {
+  int fd = -1;
+  if (!addr.path.empty()) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, addr.path.c_str(), sizeof(sa.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      FSTR_DRIVERS_EXCEPTION("connect " << addr.path << ": " << strerror(errno));
+    }
+  }
+  else {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = htons(addr.port);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      FSTR_DRIVERS_EXCEPTION("connect port " << addr.port << ": " << strerror(errno));
+    }
+  }
+  return fd;
+}
+
+/**
+ * @brief Writes all of str; returns false if the peer is gone.
+ */
+inline bool WriteAll(int fd, const std::string& str) {
+  std::size_t written = 0;
+  while (written < str.length()) {
+    const ssize_t n = write(fd, str.data() + written, str.length() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+/**
+ * @brief Makes reads on the socket fail after the given number of
+ * seconds without data, so a stalled peer cannot block a reader
+ * forever.
+ */
+inline bool SetReadTimeout(int fd, long seconds) {
+  struct timeval tv;
+  tv.tv_sec = seconds;
+  tv.tv_usec = 0;
+  return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+/**
+ * @brief Reads newline-delimited lines from a socket.
+ */
+class LineReader {
+ public:
+  static const std::string::size_type kDefaultMaxLineLength = 1 << 20;
+
+  explicit LineReader(int fd,
+                      std::string::size_type max_line_length =
+                      kDefaultMaxLineLength)
+      : fd_(fd), pos_(0), max_line_length_(max_line_length) {}
+
+  /**
+   * @brief Reads the next line (without the newline); returns false
+   * at end of input, on a read error or timeout, or if the line is
+   * longer than the maximum line length.
+   */
+  bool ReadLine(std::string* line) {
+    while (true) {
+      const std::string::size_type nl = buf_.find('\n', pos_);
+      if (nl != std::string::npos) {
+        if (nl - pos_ > max_line_length_) {
+          return false;
+        }
+        line->assign(buf_, pos_, nl - pos_);
+        pos_ = nl + 1;
+        if (pos_ > 4096) {
+          buf_.erase(0, pos_);
+          pos_ = 0;
+        }
+        return true;
+      }
+      if (buf_.length() - pos_ > max_line_length_) {
+        return false;
+      }
+      char tmp[4096];
+      const ssize_t n = read(fd_, tmp, sizeof(tmp));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) { // error, or SO_RCVTIMEO expired
+        return false;
+      }
+      if (n == 0) {
+        if (pos_ < buf_.length()) { // last line without newline
+          line->assign(buf_, pos_, std::string::npos);
+          buf_.clear();
+          pos_ = 0;
+          return true;
+        }
+        return false;
+      }
+      buf_.append(tmp, n);
+    }
+  }
+
+ private:
+  int fd_;
+  std::string buf_;
+  std::string::size_type pos_;
+  std::string::size_type max_line_length_;
+};
+
+} } // end namespaces
+
+#endif
@@ -25,6 +25,7 @@
 #include "fstrain/util/data.h"
 #include "fstrain/util/get-vector-fst.h"
 #include "fstrain/util/print-path.h"
+#include "fstrain/util/string-compose.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/drivers/debug.h"
 
@@ -33,7 +34,10 @@
 #include <boost/algorithm/string/iter_find.hpp>
 #include <boost/foreach.hpp>
 #include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <iomanip>
@@ -41,6 +45,7 @@
 #include <list>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace po = boost::program_options;
 
@@ -69,8 +74,9 @@ struct DecodeDataOptions {
   std::ostream* out;
   const SymbolTable& isymbols;
   const SymbolTable& osymbols;
+  int num_threads;
   DecodeDataOptions(const SymbolTable& isymbols_, const SymbolTable& osymbols_)
-      : out(&std::cout), isymbols(isymbols_), osymbols(osymbols_)
+      : out(&std::cout), isymbols(isymbols_), osymbols(osymbols_), num_threads(1)
   {}
 };
 
@@ -83,58 +89,111 @@ LogArc::Weight GetPathsum(const Fst<LogArc>& fst) {
   return betas[0];
 }
 
-LogArc::Weight GetLoglik(const Fst<LogArc>& input_fst,
-                         const Fst<LogArc>& output_fst,
-                         const Fst<LogArc>& model_fst) {
-  ComposeFst<LogArc> denominator(input_fst, model_fst);
-  LogWeight denominator_sum = GetPathsum(denominator);
+/**
+ * @brief -log p(output | input) of the most probable of the
+ * alternative outputs. The input is composed with the model once;
+ * the lattice and its path sum (the denominator) are shared by all
+ * alternatives.
+ */
+LogArc::Weight GetBestLoglik(const std::string& input_string,
+                             const std::list<std::string>& alternatives,
+                             const util::LabelIndexedFst<LogArc>& model_index,
+                             const DecodeDataOptions& opts) {
+  std::vector<LogArc::Label> input;
+  try{
+    util::ConvertStringToLabels(input_string, opts.isymbols, &input);
+  }
+  catch(...) {
+    std::cerr << "WARNING: Could not decode " << input_string << std::endl;
+    return LogWeight::Zero();
+  }
+  VectorFst<LogArc> lattice;
+  util::ComposeString(input, model_index, &lattice);
+  const LogWeight denominator_sum = GetPathsum(lattice);
   if (denominator_sum == LogWeight::Zero()) {
     std::cerr << "WARNING: Even input received 0 prob" << std::endl;
+    return LogWeight::Zero();
+  }
+  LogWeight best_of_multiple(LogWeight::Zero());
+  BOOST_FOREACH(const std::string& output_alternative, alternatives) {
+    std::vector<LogArc::Label> output;
+    try{
+      util::ConvertStringToLabels(output_alternative, opts.osymbols, &output);
+    }
+    catch(...) {
+      std::cerr << "WARNING: Could not decode "
+                << input_string << " / " << output_alternative << std::endl;
+      continue;
+    }
+    VectorFst<LogArc> composed;
+    util::ComposeWithString(lattice, output, &composed);
+    const LogWeight loglik = Divide(GetPathsum(composed), denominator_sum);
+    if (loglik.Value() < best_of_multiple.Value()) { // neg.loglik: smaller cost
+      best_of_multiple = loglik;
+    }
   }
-  VectorFst<LogArc> composed;
-  Compose(denominator, output_fst, &composed);
-  LogWeight numerator_sum = GetPathsum(composed);
-  return Divide(numerator_sum, denominator_sum);
+  return best_of_multiple;
 }
 
+/**
+ * @brief Computes the log-likelihoods of the examples first, first +
+ * step, ...
+ */
+struct GetLoglik_Fct {
+  const util::Data* data;
+  const util::LabelIndexedFst<LogArc>* model_index;
+  const DecodeDataOptions* opts;
+  std::string separator;
+  std::size_t first;
+  std::size_t step;
+  std::vector<LogWeight>* result;
+  void operator()() {
+    for (std::size_t i = first; i < data->size(); i += step) {
+      std::list<std::string> alternatives_list;
+      boost::iter_split(alternatives_list, (*data)[i].second,
+                        boost::first_finder(separator));
+      (*result)[i] = GetBestLoglik((*data)[i].first, alternatives_list,
+                                   *model_index, *opts);
+    }
+  }
+};
+
 template<class EqualFct>
 void DecodeData(const util::Data& data,
 		const Fst<LogArc>& model_fst,
                 EqualFct equal_fct,
 		DecodeDataOptions opts) {
   const std::string separator = " ### "; // TODO: pass in
-  int num_correct = 0;
+  const util::LabelIndexedFst<LogArc> model_index(model_fst);
+  std::vector<LogWeight> logliks(data.size(), LogWeight::Zero());
+  const int num_threads = std::max(1, std::min(opts.num_threads,
+                                               static_cast<int>(data.size())));
+  std::vector<boost::shared_ptr<boost::thread> > threads;
+  for (int t = 0; t < num_threads; ++t) {
+    GetLoglik_Fct f;
+    f.data = &data;
+    f.model_index = &model_index;
+    f.opts = &opts;
+    f.separator = separator;
+    f.first = t;
+    f.step = num_threads;
+    f.result = &logliks;
+    if (num_threads == 1) {
+      f();
+    }
+    else {
+      threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(f)));
+    }
+  }
+  for (std::size_t t = 0; t < threads.size(); ++t) {
+    threads[t]->join();
+  }
+  // sum in data order, so the result does not depend on the threads
   LogWeight corpus_loglik(LogWeight::One());
   int excluded_count = 0;
-  for (util::Data::const_iterator it = data.begin(); it != data.end(); ++it) {
-    const std::string input_string = it->first;
-    const std::string output_string = it->second;
-    LogWeight best_of_multiple(LogWeight::Zero());
-    std::list<std::string> alternatives_list;
-    boost::iter_split(alternatives_list, output_string,
-                      boost::first_finder(separator));
-    int cnt = 1;
-    BOOST_FOREACH(std::string output_alternative, alternatives_list) {
-      // std::cerr << cnt << ": " << input_string << " / " << output_alternative
-      //   << std::endl;
-      VectorFst<LogArc> input_fst;
-      VectorFst<LogArc> output_fst;
-      try{
-        util::ConvertStringToFst(input_string, opts.isymbols, &input_fst);
-        util::ConvertStringToFst(output_alternative, opts.isymbols, &output_fst);
-      }
-      catch(...) {
-        std::cerr << "WARNING: Could not decode "
-                  << input_string << " / " << output_alternative << std::endl;
-      }
-      LogWeight loglik = GetLoglik(input_fst, output_fst, model_fst);
-      if (loglik.Value() < best_of_multiple.Value()) { // neg.loglik: smaller cost
-        best_of_multiple = loglik;
-      }
-      ++cnt;
-    }
-    if (best_of_multiple != LogWeight::Zero()) {
-      corpus_loglik = Times(corpus_loglik, best_of_multiple);
+  for (std::size_t i = 0; i < logliks.size(); ++i) {
+    if (logliks[i] != LogWeight::Zero()) {
+      corpus_loglik = Times(corpus_loglik, logliks[i]);
     }
     else {
       ++excluded_count;
@@ -158,6 +217,8 @@ int main(int ac, char** av) {
         ("fst", po::value<std::string>(), "tranducer file name for decoding")
         ("multiple-truths", po::value<bool>()->default_value(true),
          "multiple truths, separated by ' ### '")
+        ("num-threads", po::value<int>()->default_value(1),
+         "number of threads")
         ;
 
     po::options_description hidden("Hidden options");
@@ -216,8 +277,14 @@ int main(int ac, char** av) {
     const std::string fst_filename = vm["fst"].as<std::string>();
 
     util::Data data(data_filename);
+    if (data.IsEncoded()) { // the strings are needed
+      std::cerr << "Encoded data files are not supported, please use the text file"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
     const Fst<LogArc>* fst = util::GetVectorFst<LogArc>(fst_filename);
     DecodeDataOptions opts(*isymbols, *osymbols);
+    opts.num_threads = vm["num-threads"].as<int>();
     if (vm["multiple-truths"].as<bool>()) {
       const std::string separator = " ### ";
       DecodeData(data, *fst, MultipleAnswersCompare(separator), opts);
@@ -0,0 +1,198 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+// Client for transducer-decode-server. By default, sends each line of
+// the input (file or stdin) and prints the response. With
+// --load-threads, acts as a load generator: each thread opens its own
+// connection and sends --requests lines (cycling through the input),
+// then latency percentiles and throughput are printed.
+
+#include <signal.h>
+#include <sys/time.h>
+
+#include "fstrain/drivers/debug.h"
+#include "fstrain/drivers/socket-util.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+using namespace fstrain;
+
+double GetTimeMillis() {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+}
+
+struct Load_Fct {
+  drivers::SocketAddress addr;
+  const std::vector<std::string>* inputs;
+  std::size_t first;
+  long num_requests;
+  std::vector<double>* latencies;
+  std::string* error;
+  void operator()() {
+    try {
+      const int fd = drivers::Connect(addr);
+      drivers::LineReader reader(fd);
+      std::string response;
+      for (long i = 0; i < num_requests; ++i) {
+        const std::string& input = (*inputs)[(first + i) % inputs->size()];
+        const double start = GetTimeMillis();
+        if (!drivers::WriteAll(fd, input + "\n") || !reader.ReadLine(&response)) {
+          close(fd);
+          FSTR_DRIVERS_EXCEPTION("Connection closed by server");
+        }
+        latencies->push_back(GetTimeMillis() - start);
+      }
+      close(fd);
+    }
+    catch (std::exception& e) {
+      *error = e.what();
+    }
+  }
+};
+
+double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  std::size_t i = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+int main(int ac, char** av) {
+  try{
+
+    po::options_description generic("Allowed options");
+    generic.add_options()
+        ("help", "produce help message")
+        ("socket", po::value<std::string>(), "connect to this Unix domain socket")
+        ("port", po::value<int>(), "connect to this localhost TCP port")
+        ("load-threads", po::value<int>()->default_value(0),
+         "run as load generator with this many connections")
+        ("requests", po::value<long>()->default_value(1000),
+         "number of requests per load generator connection")
+        ;
+    po::options_description hidden("Hidden options");
+    hidden.add_options()
+        ("input-file", po::value<std::string>(), "input file");
+    po::options_description cmdline_options;
+    cmdline_options.add(generic).add(hidden);
+    po::positional_options_description p;
+    p.add("input-file", -1);
+
+    po::variables_map vm;
+    store(po::command_line_parser(ac, av).options(cmdline_options).positional(p).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << "Usage: " << av[0] << " [options] [input-file]" << std::endl;
+      std::cout << generic << "\n";
+      return EXIT_FAILURE;
+    }
+    drivers::SocketAddress addr(vm.count("socket") ? vm["socket"].as<std::string>() : "",
+                                vm.count("port") ? vm["port"].as<int>() : -1);
+    if (!addr.IsSet()) {
+      std::cerr << "Please specify --socket or --port" << std::endl;
+      return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::ifstream file;
+    if (vm.count("input-file")) {
+      file.open(vm["input-file"].as<std::string>().c_str());
+      if (!file) {
+        FSTR_DRIVERS_EXCEPTION("Could not open " << vm["input-file"].as<std::string>());
+      }
+    }
+    std::istream& in = vm.count("input-file") ? file : std::cin;
+
+    const int num_threads = vm["load-threads"].as<int>();
+    if (num_threads <= 0) {
+      const int fd = drivers::Connect(addr);
+      drivers::LineReader reader(fd);
+      std::string line, response;
+      while (std::getline(in, line)) {
+        if (!drivers::WriteAll(fd, line + "\n") || !reader.ReadLine(&response)) {
+          close(fd);
+          FSTR_DRIVERS_EXCEPTION("Connection closed by server");
+        }
+        std::cout << response << std::endl;
+      }
+      close(fd);
+      return EXIT_SUCCESS;
+    }
+
+    std::vector<std::string> inputs;
+    std::string line;
+    while (std::getline(in, line)) {
+      inputs.push_back(line);
+    }
+    if (inputs.empty()) {
+      FSTR_DRIVERS_EXCEPTION("No input");
+    }
+    const long num_requests = vm["requests"].as<long>();
+    std::vector<std::vector<double> > latencies(num_threads);
+    std::vector<std::string> errors(num_threads);
+    std::vector<boost::shared_ptr<boost::thread> > threads;
+    const double start = GetTimeMillis();
+    for (int t = 0; t < num_threads; ++t) {
+      Load_Fct f;
+      f.addr = addr;
+      f.inputs = &inputs;
+      f.first = t * num_requests;
+      f.num_requests = num_requests;
+      f.latencies = &latencies[t];
+      f.error = &errors[t];
+      threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(f)));
+    }
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+      threads[t]->join();
+    }
+    const double elapsed_ms = GetTimeMillis() - start;
+    std::vector<double> all;
+    for (int t = 0; t < num_threads; ++t) {
+      if (!errors[t].empty()) {
+        std::cerr << "Connection " << t << ": " << errors[t] << std::endl;
+      }
+      all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+    }
+    std::sort(all.begin(), all.end());
+    fprintf(stdout, "requests: %d\n", static_cast<int>(all.size()));
+    fprintf(stdout, "throughput: %2.2f requests/s\n", all.size() / (elapsed_ms / 1000.0));
+    fprintf(stdout, "latency p50: %2.2f ms\n", Percentile(all, 0.50));
+    fprintf(stdout, "latency p90: %2.2f ms\n", Percentile(all, 0.90));
+    fprintf(stdout, "latency p99: %2.2f ms\n", Percentile(all, 0.99));
+    fprintf(stdout, "latency max: %2.2f ms\n", all.empty() ? 0.0 : all.back());
+
+  }
+  catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,493 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+// Decode server: loads the model once and decodes newline-delimited
+// input strings sent over a Unix domain socket or localhost TCP. Each
+// request line gets one response line, the best output string
+// (followed by a tab and its -log probability with --scores).
+// Requests from all connections are collected into small batches
+// for a pool of worker threads. Health and metrics are served on a
+// separate socket, as plain text or over HTTP (GET /health, GET
+// /metrics).
+
+#include <signal.h>
+#include <sys/time.h>
+
+#include "fst/fst.h"
+#include "fst/symbol-table.h"
+#include "fst/vector-fst.h"
+
+#include "fstrain/drivers/debug.h"
+#include "fstrain/drivers/decode-cache.h"
+#include "fstrain/drivers/decode-util.h"
+#include "fstrain/drivers/socket-util.h"
+#include "fstrain/util/get-vector-fst.h"
+#include "fstrain/util/map-string-decoder.h"
+#include "fstrain/util/string-compose.h"
+#include "fstrain/util/string-to-fst.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+using namespace fst;
+using namespace fstrain;
+
+long GetTimeMicros() {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec * 1000000L + t.tv_usec;
+}
+
+/**
+ * @brief One input line; the connection thread waits until a worker
+ * has filled in the result.
+ */
+struct Request {
+  std::string input;
+  std::string response;
+  bool done;
+  long submit_time_us;
+  boost::mutex mutex;
+  boost::condition_variable cond;
+  Request() : done(false), submit_time_us(0) {}
+};
+
+/**
+ * @brief Request counts and a latency histogram (time from receiving
+ * a request to having its response).
+ */
+class Metrics {
+
+ public:
+
+  explicit Metrics(drivers::DecodeCache* cache = NULL)
+      : cache_(cache), start_time_us_(GetTimeMicros()), num_requests_(0),
+        num_errors_(0), num_batches_(0), latency_sum_ms_(0.0) {
+    const double bounds[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+    bounds_.assign(bounds, bounds + sizeof(bounds) / sizeof(bounds[0]));
+    counts_.resize(bounds_.size() + 1, 0);
+  }
+
+  void AddRequest(double latency_ms, bool error) {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++num_requests_;
+    if (error) {
+      ++num_errors_;
+    }
+    latency_sum_ms_ += latency_ms;
+    std::size_t b = 0;
+    while (b < bounds_.size() && latency_ms > bounds_[b]) {
+      ++b;
+    }
+    ++counts_[b];
+  }
+
+  void AddBatch() {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++num_batches_;
+  }
+
+  /**
+   * @brief Metrics in Prometheus text format.
+   */
+  std::string ToString() {
+    boost::mutex::scoped_lock lock(mutex_);
+    std::stringstream ss;
+    ss << "decode_uptime_seconds " << (GetTimeMicros() - start_time_us_) / 1e6 << "\n"
+       << "decode_requests_total " << num_requests_ << "\n"
+       << "decode_errors_total " << num_errors_ << "\n"
+       << "decode_batches_total " << num_batches_ << "\n";
+    long cumulative = 0;
+    for (std::size_t b = 0; b < bounds_.size(); ++b) {
+      cumulative += counts_[b];
+      ss << "decode_latency_ms_bucket{le=\"" << bounds_[b] << "\"} " << cumulative << "\n";
+    }
+    cumulative += counts_.back();
+    ss << "decode_latency_ms_bucket{le=\"+Inf\"} " << cumulative << "\n"
+       << "decode_latency_ms_sum " << latency_sum_ms_ << "\n"
+       << "decode_latency_ms_count " << num_requests_ << "\n";
+    if (cache_ != NULL) {
+      ss << "decode_cache_hits_total " << cache_->NumHits() << "\n"
+         << "decode_cache_misses_total " << cache_->NumMisses() << "\n"
+         << "decode_cache_entries " << cache_->NumEntries() << "\n"
+         << "decode_cache_bytes " << cache_->NumBytes() << "\n";
+    }
+    return ss.str();
+  }
+
+ private:
+  drivers::DecodeCache* cache_;
+  boost::mutex mutex_;
+  const long start_time_us_;
+  long num_requests_;
+  long num_errors_;
+  long num_batches_;
+  double latency_sum_ms_;
+  std::vector<double> bounds_;
+  std::vector<long> counts_;
+};
+
+/**
+ * @brief Queue of pending requests. Workers take them out in
+ * micro-batches: a batch is closed when it is full or when its first
+ * request has waited batch_wait_ms.
+ */
+class RequestQueue {
+
+ public:
+
+  RequestQueue(std::size_t max_batch_size, long batch_wait_ms)
+      : max_batch_size_(max_batch_size), batch_wait_ms_(batch_wait_ms) {}
+
+  void Submit(Request* request) {
+    boost::mutex::scoped_lock lock(mutex_);
+    request->submit_time_us = GetTimeMicros();
+    pending_.push_back(request);
+    cond_.notify_one();
+  }
+
+  void NextBatch(std::vector<Request*>* batch) {
+    batch->clear();
+    boost::mutex::scoped_lock lock(mutex_);
+    while (pending_.empty()) {
+      cond_.wait(lock);
+    }
+    const boost::system_time deadline = boost::get_system_time()
+        + boost::posix_time::milliseconds(batch_wait_ms_);
+    while (pending_.size() < max_batch_size_) {
+      if (!cond_.timed_wait(lock, deadline)) {
+        break;
+      }
+    }
+    while (!pending_.empty() && batch->size() < max_batch_size_) {
+      batch->push_back(pending_.front());
+      pending_.pop_front();
+    }
+    if (!pending_.empty()) {
+      cond_.notify_one(); // more work for another worker
+    }
+  }
+
+ private:
+  const std::size_t max_batch_size_;
+  const long batch_wait_ms_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  std::deque<Request*> pending_;
+};
+
+struct ServerOptions {
+  const SymbolTable* isymbols;
+  const SymbolTable* osymbols;
+  util::MapStringDecoderOptions decoder_opts;
+  drivers::DecodeCache* cache; // may be NULL
+  bool print_scores;
+};
+
+/**
+ * @brief Decodes batches of requests. All workers share the model
+ * index, which is read-only.
+ */
+struct Worker_Fct {
+  const util::LabelIndexedFst<StdArc>* model;
+  RequestQueue* queue;
+  Metrics* metrics;
+  const ServerOptions* opts;
+  void operator()() {
+    std::vector<Request*> batch;
+    while (true) {
+      queue->NextBatch(&batch);
+      metrics->AddBatch();
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        Request* request = batch[i];
+        std::stringstream ss;
+        bool error = false;
+        try {
+          std::vector<StdArc::Label> input;
+          const bool delete_unknown_chars = true;
+          util::ConvertStringToLabels(request->input, *opts->isymbols, &input,
+                                      delete_unknown_chars);
+          std::vector<drivers::DecodedOutput> best;
+          drivers::DecodeLabelsCached(input, *model, *opts->osymbols,
+                                      opts->decoder_opts, opts->cache, &best);
+          if (best.empty()) {
+            ss << "<NO OUTPUT>";
+            error = true;
+          }
+          else {
+            ss << best[0].output;
+            if (opts->print_scores) {
+              ss << "\t" << best[0].neglogprob;
+            }
+          }
+        }
+        catch (std::exception& e) {
+          ss << "<NO OUTPUT>";
+          error = true;
+        }
+        metrics->AddRequest((GetTimeMicros() - request->submit_time_us) / 1000.0, error);
+        boost::mutex::scoped_lock lock(request->mutex);
+        request->response = ss.str();
+        request->done = true;
+        request->cond.notify_one();
+      }
+    }
+  }
+};
+
+/**
+ * @brief Writes the cache to its file every few seconds.
+ */
+struct SaveCache_Fct {
+  drivers::DecodeCache* cache;
+  std::string filename;
+  long interval_s;
+  void operator()() {
+    while (true) {
+      boost::this_thread::sleep(boost::posix_time::seconds(interval_s));
+      try {
+        cache->Write(filename);
+      }
+      catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+      }
+    }
+  }
+};
+
+struct Connection_Fct {
+  int fd;
+  RequestQueue* queue;
+  void operator()() {
+    drivers::LineReader reader(fd);
+    std::string line;
+    while (reader.ReadLine(&line)) {
+      Request request;
+      request.input = line;
+      queue->Submit(&request);
+      {
+        boost::mutex::scoped_lock lock(request.mutex);
+        while (!request.done) {
+          request.cond.wait(lock);
+        }
+      }
+      if (!drivers::WriteAll(fd, request.response + "\n")) {
+        break;
+      }
+    }
+    close(fd);
+  }
+};
+
+/**
+ * @brief Answers "health" and "metrics" (or the HTTP requests GET
+ * /health and GET /metrics), one per connection.
+ */
+struct MetricsServer_Fct {
+  // Clients are served one at a time, so a client that stalls or
+  // sends garbage is dropped rather than blocking the endpoint.
+  static const long kMetricsReadTimeoutSeconds = 5;
+  static const std::string::size_type kMetricsMaxLineLength = 8192;
+  int listen_fd;
+  Metrics* metrics;
+  void operator()() {
+    while (true) {
+      const int fd = accept(listen_fd, NULL, NULL);
+      if (fd < 0) {
+        continue;
+      }
+      drivers::SetReadTimeout(fd, kMetricsReadTimeoutSeconds);
+      drivers::LineReader reader(fd, kMetricsMaxLineLength);
+      std::string line;
+      if (!reader.ReadLine(&line)) {
+        close(fd);
+        continue;
+      }
+      const bool http = line.compare(0, 4, "GET ") == 0;
+      const bool health = line.find("health") != std::string::npos;
+      if (http) { // skip headers
+        std::string header;
+        while (reader.ReadLine(&header) && header != "" && header != "\r") {}
+      }
+      const std::string body = health ? "ok\n" : metrics->ToString();
+      std::stringstream ss;
+      if (http) {
+        ss << "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: "
+           << body.length() << "\r\n\r\n";
+      }
+      ss << body;
+      drivers::WriteAll(fd, ss.str());
+      close(fd);
+    }
+  }
+};
+
+int main(int ac, char** av) {
+  try{
+
+    po::options_description generic("Allowed options");
+    generic.add_options()
+        ("help", "produce help message")
+        ("isymbols", po::value<std::string>(), "symbol table for input words")
+        ("osymbols", po::value<std::string>(), "symbol table for output words")
+        ("fst", po::value<std::string>(), "tranducer file name for decoding")
+        ("socket", po::value<std::string>(), "listen on this Unix domain socket")
+        ("port", po::value<int>(), "listen on this localhost TCP port")
+        ("metrics-socket", po::value<std::string>(), "serve health and metrics on this Unix domain socket")
+        ("metrics-port", po::value<int>(), "serve health and metrics on this localhost TCP port")
+        ("num-workers", po::value<int>()->default_value(4), "number of decoding threads")
+        ("max-batch-size", po::value<std::size_t>()->default_value(16), "max. requests per batch")
+        ("batch-wait-ms", po::value<long>()->default_value(2), "max. time to wait for a batch to fill")
+        ("scores", "print -log probability after each output")
+        ("max-queue-size", po::value<std::size_t>()->default_value(0),
+         "decoder beam width (0: unlimited)")
+        ("beam", po::value<double>()->default_value(std::numeric_limits<double>::infinity()),
+         "decoder beam (-log prob. difference to the best prefix)")
+        ("timelimit-ms", po::value<long>()->default_value(-1),
+         "decoder time limit per input (-1: none)")
+        ("cache-mb", po::value<double>()->default_value(0.0),
+         "size of the cache for repeated inputs (0: no cache)")
+        ("cache-file", po::value<std::string>(),
+         "warm-start the cache from this file and save it there periodically")
+        ("cache-save-interval-s", po::value<long>()->default_value(300),
+         "how often to save the cache")
+        ("client-timeout-s", po::value<long>()->default_value(300),
+         "close client connections that send nothing for this long (0: never)")
+        ;
+
+    po::variables_map vm;
+    store(po::command_line_parser(ac, av).options(generic).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << generic << "\n";
+      return EXIT_FAILURE;
+    }
+    if (vm.count("isymbols") == 0 || vm.count("osymbols") == 0
+        || vm.count("fst") == 0) {
+      std::cerr << "Please specify --isymbols, --osymbols and --fst" << std::endl;
+      return EXIT_FAILURE;
+    }
+    drivers::SocketAddress addr(vm.count("socket") ? vm["socket"].as<std::string>() : "",
+                                vm.count("port") ? vm["port"].as<int>() : -1);
+    if (!addr.IsSet()) {
+      std::cerr << "Please specify --socket or --port" << std::endl;
+      return EXIT_FAILURE;
+    }
+    drivers::SocketAddress metrics_addr(
+        vm.count("metrics-socket") ? vm["metrics-socket"].as<std::string>() : "",
+        vm.count("metrics-port") ? vm["metrics-port"].as<int>() : -1);
+
+    signal(SIGPIPE, SIG_IGN); // clients may go away any time
+
+    ServerOptions opts;
+    opts.isymbols = SymbolTable::ReadText(vm["isymbols"].as<std::string>());
+    opts.osymbols = SymbolTable::ReadText(vm["osymbols"].as<std::string>());
+    opts.print_scores = vm.count("scores") > 0;
+    opts.decoder_opts.max_queue_size = vm["max-queue-size"].as<std::size_t>();
+    opts.decoder_opts.beam = vm["beam"].as<double>();
+    opts.decoder_opts.timelimit_ms = vm["timelimit-ms"].as<long>();
+    const Fst<StdArc>* model = util::GetVectorFst<StdArc>(vm["fst"].as<std::string>());
+    if (model == NULL) {
+      FSTR_DRIVERS_EXCEPTION("Could not read " << vm["fst"].as<std::string>());
+    }
+
+    boost::scoped_ptr<drivers::DecodeCache> cache;
+    if (vm["cache-mb"].as<double>() > 0.0) {
+      std::stringstream tag;
+      tag << drivers::DecodeCache::GetModelFingerprint(vm["fst"].as<std::string>())
+          << " " << opts.decoder_opts.max_queue_size
+          << " " << opts.decoder_opts.beam << " " << opts.decoder_opts.timelimit_ms;
+      cache.reset(new drivers::DecodeCache(
+          static_cast<std::size_t>(vm["cache-mb"].as<double>() * 1024 * 1024), tag.str()));
+      if (vm.count("cache-file")) {
+        const std::size_t n = cache->Read(vm["cache-file"].as<std::string>());
+        std::cerr << "# Read " << n << " cached inputs" << std::endl;
+      }
+    }
+    opts.cache = cache.get();
+
+    Metrics metrics(cache.get());
+    RequestQueue queue(std::max<std::size_t>(1, vm["max-batch-size"].as<std::size_t>()),
+                       vm["batch-wait-ms"].as<long>());
+    const int num_workers = std::max(1, vm["num-workers"].as<int>());
+    const util::LabelIndexedFst<StdArc> model_index(*model);
+    delete model;
+    std::vector<boost::shared_ptr<boost::thread> > threads;
+    for (int i = 0; i < num_workers; ++i) {
+      Worker_Fct f;
+      f.model = &model_index;
+      f.queue = &queue;
+      f.metrics = &metrics;
+      f.opts = &opts;
+      threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(f)));
+    }
+
+    if (cache && vm.count("cache-file")) {
+      SaveCache_Fct f;
+      f.cache = cache.get();
+      f.filename = vm["cache-file"].as<std::string>();
+      f.interval_s = std::max(1L, vm["cache-save-interval-s"].as<long>());
+      threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(f)));
+    }
+
+    if (metrics_addr.IsSet()) {
+      MetricsServer_Fct f;
+      f.listen_fd = drivers::Listen(metrics_addr);
+      f.metrics = &metrics;
+      threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(f)));
+      std::cerr << "# Metrics on " << metrics_addr.ToString() << std::endl;
+    }
+
+    const long client_timeout_s = vm["client-timeout-s"].as<long>();
+    const int listen_fd = drivers::Listen(addr);
+    std::cerr << "# Decoding with " << num_workers << " workers on "
+              << addr.ToString() << std::endl;
+    while (true) {
+      const int fd = accept(listen_fd, NULL, NULL);
+      if (fd < 0) {
+        continue;
+      }
+      if (client_timeout_s > 0) { // idle clients would keep their thread forever
+        drivers::SetReadTimeout(fd, client_timeout_s);
+      }
+      Connection_Fct f;
+      f.fd = fd;
+      f.queue = &queue;
+      boost::thread t(f);
+      t.detach();
+    }
+
+  }
+  catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
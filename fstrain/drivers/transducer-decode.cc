@@ -18,14 +18,16 @@
 #include "fst/map.h"
 #include "fst/mutable-fst.h"
 #include "fst/project.h"
-#include "fst/shortest-path.h"
 #include "fst/symbol-table.h"
 #include "fst/vector-fst.h"
 
-#include "fstrain/util/approx-determinize.h"
+#include "fstrain/drivers/debug.h"
+#include "fstrain/drivers/decode-cache.h"
+#include "fstrain/drivers/decode-util.h"
 #include "fstrain/util/data.h"
 #include "fstrain/util/get-vector-fst.h"
-#include "fstrain/util/print-path.h"
+#include "fstrain/util/map-string-decoder.h"
+#include "fstrain/util/string-compose.h"
 #include "fstrain/util/string-to-fst.h"
 
 #include <boost/algorithm/string.hpp>
@@ -33,14 +35,20 @@
 #include <boost/algorithm/string/iter_find.hpp>
 #include <boost/foreach.hpp>
 #include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <list>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace po = boost::program_options;
 
@@ -69,25 +77,54 @@ struct DecodeDataOptions {
   std::ostream* out;
   const SymbolTable& isymbols;
   const SymbolTable& osymbols;
-  size_t kbest_paths;
+  util::MapStringDecoderOptions decoder_opts;
+  drivers::DecodeCache* cache; // may be NULL
   bool do_evaluate;
   DecodeDataOptions(const SymbolTable& isymbols_, const SymbolTable& osymbols_)
-      : out(&std::cout), isymbols(isymbols_), osymbols(osymbols_), kbest_paths(1000),
-        do_evaluate(false)
+      : out(&std::cout), isymbols(isymbols_), osymbols(osymbols_),
+        cache(NULL), do_evaluate(false)
   {}
 };
 
-void PrintTransducerOutput(const Fst<StdArc>& input, const Fst<StdArc>& model,
+/**
+ * @brief Prints the most probable output string, summed over all
+ * paths (see util::MapStringDecoder).
+ */
+void PrintTransducerOutput(const std::vector<StdArc::Label>& input,
+                           const util::LabelIndexedFst<StdArc>& model,
 			   DecodeDataOptions opts) {
-  ComposeFst<StdArc> composed(input, model);
-  ProjectFst<StdArc> all_output_paths(composed, PROJECT_OUTPUT);
-  VectorFst<StdArc> determinized;
-  util::approxDeterminize(all_output_paths, &determinized, opts.kbest_paths, kDelta);
-  VectorFst<StdArc> best;
-  ShortestPath(determinized, &best, 1);
-  util::PrintAcceptorArcFct<StdArc> print_fst_fct(&opts.osymbols, opts.out);
-  util::PrintPath(best, print_fst_fct);
-  // (*opts.out) << std::endl;
+  std::vector<drivers::DecodedOutput> best;
+  const bool exact =
+      drivers::DecodeLabelsCached(input, model, opts.osymbols, opts.decoder_opts,
+                                  opts.cache, &best);
+  if (best.empty()) {
+    FSTR_DRIVERS_EXCEPTION("No output");
+  }
+  if (!exact) {
+    FSTR_DRIVERS_DBG_MSG(1, "Decoding was cut by beam or time limit" << std::endl);
+  }
+  (*opts.out) << best[0].output;
+}
+
+/**
+ * @brief Prints the n best output strings, one per line: input, rank,
+ * output and log posterior, separated by tabs.
+ */
+void PrintNbestOutput(const std::string& input_string,
+                      const std::vector<StdArc::Label>& input,
+                      const util::LabelIndexedFst<StdArc>& model,
+                      DecodeDataOptions opts,
+                      std::vector<drivers::DecodedOutput>* nbest) {
+  drivers::DecodeLabelsCached(input, model, opts.osymbols, opts.decoder_opts,
+                              opts.cache, nbest);
+  if (nbest->empty()) {
+    (*opts.out) << input_string << "\t1\t<NO OUTPUT>\t-inf\n";
+  }
+  for (std::size_t i = 0; i < nbest->size(); ++i) {
+    (*opts.out) << input_string << "\t" << (i + 1) << "\t" << (*nbest)[i].output
+                << "\t" << (*nbest)[i].logposterior << "\n";
+  }
+  opts.out->flush();
 }
 
 template<class EqualFct>
@@ -96,18 +133,31 @@ void DecodeData(const util::Data& data,
                 EqualFct equal_fct,
 		DecodeDataOptions opts) {
   int num_correct = 0;
+  const util::LabelIndexedFst<StdArc> model(model_fst);
   for (util::Data::const_iterator it = data.begin(); it != data.end(); ++it) {
     const std::string input_string = it->first;
-    VectorFst<StdArc> input_fst;
+    std::vector<StdArc::Label> input;
     const bool delete_unknown_chars = true;
-    util::ConvertStringToFst(input_string, opts.isymbols,
-                             &input_fst, delete_unknown_chars);
-    if (opts.do_evaluate) {
+    util::ConvertStringToLabels(input_string, opts.isymbols,
+                                &input, delete_unknown_chars);
+    if (opts.decoder_opts.nbest > 1) {
+      std::vector<drivers::DecodedOutput> nbest;
+      try{
+        PrintNbestOutput(input_string, input, model, opts, &nbest);
+      } catch(...) {
+        nbest.clear();
+        (*opts.out) << input_string << "\t1\t<NO OUTPUT>\t-inf" << std::endl;
+      }
+      if (opts.do_evaluate && !nbest.empty() && equal_fct(nbest[0].output, it->second)) {
+        ++num_correct;
+      }
+    }
+    else if (opts.do_evaluate) {
       std::stringstream ss;
       std::ostream* out = opts.out;
       opts.out = &ss;
       try{
-	PrintTransducerOutput(input_fst, model_fst, opts);
+	PrintTransducerOutput(input, model, opts);
       } catch(...) {
 	ss << "<NO OUTPUT>";
       }
@@ -118,7 +168,7 @@ void DecodeData(const util::Data& data,
       }
     }
     else {
-      PrintTransducerOutput(input_fst, model_fst, opts);
+      PrintTransducerOutput(input, model, opts);
       (*opts.out) << std::endl;
     }
   }
@@ -142,6 +192,19 @@ int main(int ac, char** av) {
         ("multiple-truths-separator", po::value<std::string>()->default_value(" ### "),
          "multiple truths separator")
         ("evaluate", po::value<bool>()->default_value(true), "evaluate accuracy?")
+        ("nbest", po::value<std::size_t>()->default_value(1),
+         "print the n most probable unique outputs with their log posteriors, "
+         "as tab-separated input, rank, output, log posterior")
+        ("max-queue-size", po::value<std::size_t>()->default_value(0),
+         "decoder beam width (0: unlimited)")
+        ("beam", po::value<double>()->default_value(std::numeric_limits<double>::infinity()),
+         "decoder beam (-log prob. difference to the best prefix)")
+        ("timelimit-ms", po::value<long>()->default_value(-1),
+         "decoder time limit per input (-1: none)")
+        ("cache-mb", po::value<double>()->default_value(0.0),
+         "size of the cache for repeated inputs (0: no cache)")
+        ("cache-file", po::value<std::string>(),
+         "read the cache from this file at start and write it back at the end")
         ;
 
     po::options_description hidden("Hidden options");
@@ -200,12 +263,36 @@ int main(int ac, char** av) {
       const std::string data_filename = vm["input-file"].as<std::string>();
       data = new util::Data(data_filename);
     }
+    if (data->IsEncoded()) {
+      std::cerr << "Encoded data files are not supported, please use the text file"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
 
     const std::string fst_filename = vm["fst"].as<std::string>();
 
     const Fst<StdArc>* fst = util::GetVectorFst<StdArc>(fst_filename);
     DecodeDataOptions opts(*isymbols, *osymbols);
     opts.do_evaluate = vm["evaluate"].as<bool>();
+    opts.decoder_opts.nbest = std::max<std::size_t>(1, vm["nbest"].as<std::size_t>());
+    opts.decoder_opts.max_queue_size = vm["max-queue-size"].as<std::size_t>();
+    opts.decoder_opts.beam = vm["beam"].as<double>();
+    opts.decoder_opts.timelimit_ms = vm["timelimit-ms"].as<long>();
+    boost::scoped_ptr<drivers::DecodeCache> cache;
+    if (vm["cache-mb"].as<double>() > 0.0) {
+      std::stringstream tag;
+      tag << drivers::DecodeCache::GetModelFingerprint(fst_filename)
+          << " " << opts.decoder_opts.nbest
+          << " " << opts.decoder_opts.max_queue_size
+          << " " << opts.decoder_opts.beam << " " << opts.decoder_opts.timelimit_ms;
+      cache.reset(new drivers::DecodeCache(
+          static_cast<std::size_t>(vm["cache-mb"].as<double>() * 1024 * 1024), tag.str()));
+      if (vm.count("cache-file")) {
+        const std::size_t n = cache->Read(vm["cache-file"].as<std::string>());
+        std::cerr << "# Read " << n << " cached inputs" << std::endl;
+      }
+      opts.cache = cache.get();
+    }
     const std::string separator = vm["multiple-truths-separator"].as<std::string>();
     if (separator.length()) {
       DecodeData(*data, *fst, MultipleAnswersCompare(separator), opts);
@@ -213,6 +300,14 @@ int main(int ac, char** av) {
     else {
       DecodeData(*data, *fst, boost::is_equal(), opts);
     }
+    if (cache) {
+      fprintf(stderr, "# Cache: %ld hits, %ld misses (hit rate %2.4f), %d entries, %2.2f MB\n",
+              cache->NumHits(), cache->NumMisses(), cache->HitRate(),
+              (int)cache->NumEntries(), cache->NumBytes() / (1024.0 * 1024.0));
+      if (vm.count("cache-file")) {
+        cache->Write(vm["cache-file"].as<std::string>());
+      }
+    }
 
     delete data;
     delete fst;
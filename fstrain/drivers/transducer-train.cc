@@ -25,6 +25,7 @@
 #include "fstrain/util/get-vector-fst.h"
 #include "fstrain/util/data.h"
 #include "fstrain/util/get-highest-feature-index.h"
+#include "fstrain/util/trace.h"
 
 // TEST
 // #include "fstrain/util/print-fst.h"
@@ -57,6 +58,7 @@ int main(int ac, char** av) {
         ("l1", po::value<bool>()->default_value(true), "cumulative L1")
         ("C", po::value<double>()->default_value(0.01), "cumulative L1 regularization strength")
         ("passes", po::value<int>()->default_value(20), "num of passes over the data")
+        ("trace-file", po::value<std::string>(), "write a Chrome trace of training here (needs -DFSTRAIN_TRACE)")
         ;
 
     po::options_description hidden("Hidden options");
@@ -142,6 +144,10 @@ int main(int ac, char** av) {
 //    const std::string dev_data_filename = vm["dev-data"].as<std::string>();
 //    util::Data dev_data(dev_data_filename);
 
+    if (vm.count("trace-file")) {
+      fstrain::util::Tracer::instance().Start(vm["trace-file"].as<std::string>());
+    }
+
     if (l1) {
       CumulativeL1Trainer trainer(num_passes, *batches, *rate_fct, C, &weights);
       trainer.Train();
@@ -151,6 +157,10 @@ int main(int ac, char** av) {
       trainer.Train();
     }
 
+    if (vm.count("trace-file")) {
+      fstrain::util::Tracer::instance().Finish();
+    }
+
     if (vm.count("output") != 0) {
       std::string output = vm["output"].as<std::string>();
       std::string weights_file = output + ".feat-weights";
@@ -27,6 +27,7 @@
 #include "fstrain/create/create-ngram-fst-from-best-align.h"
 #include "fstrain/create/create-ngram-fst-from-best-align-r2191.h" // old version
 #include "fstrain/create/create-ngram-fst.h"
+#include "fstrain/create/feature-hashing.h"
 #include "fstrain/create/features/extract-features.h"
 #include "fstrain/create/features/feature-set.h"
 #include "fstrain/create/noepshist/noepshist-create-scoring-fst.h"
@@ -45,11 +46,14 @@
 #include "fstrain/util/misc.h"
 #include "fstrain/util/options.h"
 #include "fstrain/util/symbols-mapper-in-out-align.h"
+#include "fstrain/util/timer.h"
+#include "fstrain/util/trace.h"
 
 #include <boost/shared_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/tuple/tuple.hpp>
 
+#include <cstdio>
 #include <stdexcept>
 #include <limits>
 #include <string>
@@ -65,11 +69,69 @@
 #include "fstrain/train/obj-func-fst-r-interface.cc"
 #include "fstrain/create/r-interface.h"
 
+/**
+ * @brief Number of hash bits set with SetFeatureHashBits for this
+ * model creation (0 if none); call before InitFeatureNamesTable,
+ * which clears the option.
+ */
+int GetFeatureHashBits() {
+  return fstrain::util::options.has("feature-hash-bits")
+      ? fstrain::util::options.get<int>("feature-hash-bits") : 0;
+}
+
+/**
+ * @brief Starts a new feature names table without hashing; also
+ * clears the hashing options of an earlier model creation, so that
+ * they don't carry over to the next one in the same R session.
+ */
 void InitFeatureNamesTable() {
+  fstrain::create::SetFeatureHasher(NULL);
+  fstrain::util::options.erase("feature-hash-bits");
+  fstrain::util::options.erase("feature-space-size");
   feature_names =
       boost::shared_ptr<fst::SymbolTable>(new fst::SymbolTable("feature-names"));
 }
 
+/**
+ * @brief Turns on feature hashing into 2^hash_bits parameters (if
+ * hash_bits > 0). Call after the fixed features have been added to
+ * the feature names table; they keep their IDs.
+ */
+void InitFeatureHasher(int hash_bits) {
+  using namespace fstrain;
+  if (hash_bits <= 0) {
+    return;
+  }
+  create::FeatureHasher* hasher =
+      new create::FeatureHasher(feature_names.get(),
+                                hash_bits,
+                                util::options.has("write-hashed-feature-names"));
+  create::SetFeatureHasher(hasher);
+  util::options["feature-space-size"] = static_cast<int>(hasher->NumParams());
+  std::cerr << "# Hashing features into " << hasher->NumParams()
+            << " parameters" << std::endl;
+}
+
+void PrintFeatureHasherStats() {
+  if (fstrain::create::GetFeatureHasher() != NULL) {
+    fstrain::create::GetFeatureHasher()->PrintStats(std::cerr);
+  }
+}
+
+/**
+ * @brief Prints the size of the created model FST and the time it
+ * took (read by scripts/scaling-sweep.pl).
+ */
+void PrintCreatedModel(const fst::ExpandedFst<fst::MDExpectationArc>& fst,
+                       fstrain::util::Timer* timer) {
+  using namespace fstrain;
+  timer->stop();
+  fprintf(stderr, "# Created model FST with %d states, %d arcs [%2.2f ms, %2.2f MB]\n",
+          (int)fst.NumStates(), (int)util::CountArcs(fst),
+          timer->get_elapsed_time_millis(),
+          util::MemoryInfo::instance().getSizeInMB());
+}
+
 void PopulateFeatureNamesTable(const std::string& filename) {
   if (!feature_names) {
     // exception bad if called from R?
@@ -145,6 +207,11 @@ extern "C" {
     backoff_names_str = std::string(*names);
   }
 
+  /**
+   * @brief Sets the memory budget; util::MemoryGovernor lowers the
+   * number of threads, cache sizes and chunk sizes as the budget is
+   * approached, and MemoryInfo throws once it is exceeded.
+   */
   void SetMemoryLimitInGb(double* limit_gb) {
     if (*limit_gb > 0.0) {
       std::cerr << "# Setting memory limit " << *limit_gb << " GB" << std::endl;
@@ -152,6 +219,98 @@ extern "C" {
     }
   }
 
+  /**
+   * @brief Hashes feature names into 2^bits parameters instead of
+   * storing them, see create/feature-hashing.h. Applies to the next
+   * model creation only.
+   */
+  void SetFeatureHashBits(int* bits) {
+    fstrain::util::options["feature-hash-bits"] = *bits;
+  }
+
+  /**
+   * @brief Keeps the hashed feature names, so that WriteFeatureNames
+   * also writes them (to <filename>.hashed).
+   */
+  void SetWriteHashedFeatureNames() {
+    fstrain::util::options["write-hashed-feature-names"] = true;
+  }
+
+  void SetCreateNumThreads(int* n) {
+    std::cerr << "# Using " << *n << " threads for model creation" << std::endl;
+    fstrain::util::options["create-num-threads"] = *n;
+  }
+
+  /**
+   * @brief Model creation reads and counts the data n pairs at a
+   * time, see create/partial-counts.h.
+   */
+  void SetCreateChunkSize(int* n) {
+    fstrain::util::options["create-chunk-size"] = *n;
+  }
+
+  void SetCreateTmpDir(char** dir) {
+    fstrain::util::options["create-tmp-dir"] = std::string(*dir);
+  }
+
+  /**
+   * @brief Incremental model creation: adds the counts of the data to
+   * those saved by an earlier run (with SetCreateCountsOut). Use with
+   * the earlier feature names (features_init_filestem), so that the
+   * old features keep their IDs and new ones are appended.
+   */
+  void SetCreateCountsIn(char** filename) {
+    fstrain::util::options["create-counts-in"] = std::string(*filename);
+  }
+
+  /**
+   * @brief Saves the ngram counts of all the data, for a later
+   * incremental run.
+   */
+  void SetCreateCountsOut(char** filename) {
+    fstrain::util::options["create-counts-out"] = std::string(*filename);
+  }
+
+  /**
+   * @brief Records the spans of creation and training (see
+   * util/trace.h) until FinishTrace, which writes them to filename.
+   */
+  void StartTrace(char** filename) {
+    fstrain::util::Tracer::instance().Start(std::string(*filename));
+  }
+
+  void FinishTrace() {
+    if (fstrain::util::Tracer::instance().IsRunning()) {
+      fstrain::util::Tracer::instance().Finish();
+    }
+  }
+
+  /**
+   * @brief Keeps intermediate results of the backoff model
+   * intersection delayed, each with a cache of at most cache_mb MB.
+   */
+  void SetLazyIntersection(double* cache_mb) {
+    fstrain::util::options["intersect-lazy-cache-mb"] = *cache_mb;
+  }
+
+  /**
+   * @brief Number of slowest examples reported after each objective
+   * function evaluation (0 turns the report off).
+   */
+  void SetSlowExamplesTopK(int* k) {
+    fstrain::util::options["slow-examples-top-k"] = *k;
+  }
+
+  /**
+   * @brief How to renumber the model states for locality: "bfs",
+   * "rcm" (reverse Cuthill-McKee) or "none" (the default, also
+   * without this call). Applied to the model when training starts
+   * and when it is saved.
+   */
+  void SetStateOrder(char** order) {
+    fstrain::util::options["state-order"] = std::string(*order);
+  }
+
   // options for CheckConvergence of FSTs
   void SetEigenvalueMaxiter(int* maxiter) {
     fstrain::util::options["eigenvalue-maxiter"] = *maxiter;
@@ -189,7 +348,9 @@ extern "C" {
     std::string isymbols_file_str(*isymbols_file);
     std::string osymbols_file_str(*osymbols_file);
     std::string features_init_filestem_str(*features_init_filestem);
+    util::Timer create_timer;
     MutableFst<MDExpectationArc>* fst = new VectorFst<MDExpectationArc>();
+    const int hash_bits = GetFeatureHashBits();
     InitFeatureNamesTable();
     if (features_init_filestem_str.length()) {
       PopulateFeatureNamesTable(features_init_filestem_str);
@@ -198,6 +359,7 @@ extern "C" {
       feature_names->AddSymbol("*LENGTH_IN*");
       feature_names->AddSymbol("*LENGTH_OUT*"); // to give them Ids 0 and 1
     }
+    InitFeatureHasher(hash_bits);
     // e.g. "simple"
     const std::string extract_features_libname_str(*extract_features_libname);
     create::features::ExtractFeaturesFctPlugin extract_features_fct(extract_features_libname_str);
@@ -205,6 +367,8 @@ extern "C" {
                            isymbols_file_str, osymbols_file_str,
                            extract_features_fct,
                            feature_names.get(), fst);
+    PrintCreatedModel(*fst, &create_timer);
+    PrintFeatureHasherStats();
 
     std::string data_file_str(*data_file);
     train::ObjectiveFunctionType type =
@@ -249,6 +413,7 @@ extern "C" {
     std::string isymbols_file_str(*isymbols_file);
     std::string osymbols_file_str(*osymbols_file);
     std::string features_init_filestem_str(*features_init_filestem);
+    util::Timer create_timer;
 
     Fst<StdArc>* align_fst_obj = NULL;
     if (align_fst_file_str == "simple") {
@@ -264,6 +429,7 @@ extern "C" {
     std::cerr << "# Using " << util::MemoryInfo::instance().getSizeInMB()
               << " MB." << std::endl;
 
+    const int hash_bits = GetFeatureHashBits();
     InitFeatureNamesTable();
     if (features_init_filestem_str.length()) {
       PopulateFeatureNamesTable(features_init_filestem_str);
@@ -274,6 +440,7 @@ extern "C" {
       feature_names->AddSymbol("*LENGTH_IN*");
       feature_names->AddSymbol("*LENGTH_OUT*"); // to give them Ids 0 and 1
     }
+    InitFeatureHasher(hash_bits);
     MutableFst<MDExpectationArc>* fst = new VectorFst<MDExpectationArc>();
     util::ThrowExceptionIfFileNotFound(isymbols_file_str);
     util::ThrowExceptionIfFileNotFound(osymbols_file_str);
@@ -415,6 +582,8 @@ extern "C" {
     delete align_fst_obj;
     delete isymbols;
     delete osymbols;
+    PrintCreatedModel(*fst, &create_timer);
+    PrintFeatureHasherStats();
 
     train::ObjectiveFunctionType type = static_cast<train::ObjectiveFunctionType>(*function_type);
     std::cerr << "Obj. function type: " << type << std::endl;
@@ -0,0 +1,117 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#include "fstrain/train/example-stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <utility>
+
+namespace fstrain { namespace train {
+
+double ExampleStatsTable::GetPredictedCost(std::size_t index) const {
+  if (stats_[index].iteration >= 0) {
+    return stats_[index].GetTotalMs();
+  }
+  double sum = 0.0;
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < stats_.size(); ++i) {
+    if (stats_[i].iteration >= 0) {
+      sum += stats_[i].GetTotalMs();
+      ++n;
+    }
+  }
+  return n > 0 ? sum / n : 0.0;
+}
+
+std::size_t ExampleStatsTable::GetMaxArcs() const {
+  std::size_t result = 0;
+  for (std::size_t i = 0; i < stats_.size(); ++i) {
+    result = std::max<std::size_t>(result,
+                                   stats_[i].unclamped_arcs + stats_[i].clamped_arcs);
+  }
+  return result;
+}
+
+void ExampleStatsTable::WriteReport(int iteration, std::size_t top_k,
+                                    std::ostream& out) const {
+  std::vector< std::pair<double, std::size_t> > times; // (ms, index)
+  std::vector<std::size_t> ignored;
+  // bucket b counts times in [2^(b-1), 2^b) ms; bucket 0 is < 1 ms
+  std::vector<std::size_t> histogram;
+  for (std::size_t i = 0; i < stats_.size(); ++i) {
+    const ExampleStats& s = stats_[i];
+    if (s.iteration != iteration) {
+      continue;
+    }
+    if (s.ignored) {
+      ignored.push_back(i);
+    }
+    const double ms = s.GetTotalMs();
+    times.push_back(std::make_pair(ms, i));
+    std::size_t b = 0;
+    for (double limit = 1.0; ms >= limit; limit *= 2.0) {
+      ++b;
+    }
+    if (histogram.size() <= b) {
+      histogram.resize(b + 1, 0);
+    }
+    ++histogram[b];
+  }
+  if (times.empty()) {
+    return;
+  }
+  top_k = std::min(top_k, times.size());
+  std::partial_sort(times.begin(), times.begin() + top_k, times.end(),
+                    std::greater< std::pair<double, std::size_t> >());
+  char buf[256];
+  out << "# Slowest examples (iteration " << iteration << "):" << std::endl;
+  out << "#  example   total ms  compose ms   dist ms  check ms  timeouts"
+      << "  states/arcs (unclamped)  states/arcs (clamped)" << std::endl;
+  for (std::size_t k = 0; k < top_k; ++k) {
+    const std::size_t i = times[k].second;
+    const ExampleStats& s = stats_[i];
+    snprintf(buf, sizeof(buf),
+             "# %8d %10.2f %11.2f %9.2f %9.2f %9d %12d/%-12d %9d/%-12d%s",
+             (int)i, s.GetTotalMs(), s.compose_ms, s.shortest_distance_ms,
+             s.convergence_check_ms, s.num_timeouts,
+             s.unclamped_states, s.unclamped_arcs,
+             s.clamped_states, s.clamped_arcs,
+             s.ignored ? " ignored" : "");
+    out << buf << std::endl;
+  }
+  if (!ignored.empty()) {
+    out << "# Ignored " << ignored.size() << " examples:";
+    for (std::size_t k = 0; k < ignored.size() && k < 20; ++k) {
+      out << " " << ignored[k];
+    }
+    out << (ignored.size() > 20 ? " ..." : "") << std::endl;
+  }
+  out << "# Example time histogram:";
+  for (std::size_t b = 0; b < histogram.size(); ++b) {
+    if (histogram[b] == 0) {
+      continue;
+    }
+    if (b == 0) {
+      out << " <1ms:" << histogram[b];
+    }
+    else {
+      out << " " << (1 << (b - 1)) << "-" << (1 << b) << "ms:" << histogram[b];
+    }
+  }
+  out << std::endl;
+}
+
+} } // end namespaces
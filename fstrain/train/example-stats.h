@@ -0,0 +1,101 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_TRAIN_EXAMPLE_STATS_H
+#define FSTRAIN_TRAIN_EXAMPLE_STATS_H
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+namespace fstrain { namespace train {
+
+/**
+ * @brief What one example cost in one objective function evaluation.
+ */
+struct ExampleStats {
+  int iteration;                // -1 if not processed yet
+  int unclamped_states;
+  int unclamped_arcs;
+  int clamped_states;
+  int clamped_arcs;
+  double compose_ms;
+  double shortest_distance_ms;  // alphas and betas, both machines
+  double convergence_check_ms;  // eigenvalue checks after timeouts
+  int num_timeouts;
+  bool ignored;                 // dropped, e.g. because it diverged
+
+  ExampleStats()
+      : iteration(-1),
+        unclamped_states(0), unclamped_arcs(0),
+        clamped_states(0), clamped_arcs(0),
+        compose_ms(0.0), shortest_distance_ms(0.0), convergence_check_ms(0.0),
+        num_timeouts(0), ignored(false) {}
+
+  double GetTotalMs() const {
+    return compose_ms + shortest_distance_ms + convergence_check_ms;
+  }
+};
+
+/**
+ * @brief The stats of all examples from the last evaluation they were
+ * processed in. Each example is written by one thread only, so no
+ * locking is needed.
+ */
+class ExampleStatsTable {
+
+ public:
+
+  void Resize(std::size_t num_examples) {
+    stats_.resize(num_examples);
+  }
+
+  std::size_t size() const {
+    return stats_.size();
+  }
+
+  ExampleStats& operator[](std::size_t index) {
+    return stats_[index];
+  }
+
+  const ExampleStats& operator[](std::size_t index) const {
+    return stats_[index];
+  }
+
+  /**
+   * @brief Predicted time (ms) of the example in the next evaluation:
+   * its last time, or the mean time of the measured examples if it
+   * has not been processed yet.
+   */
+  double GetPredictedCost(std::size_t index) const;
+
+  /**
+   * @brief The most arcs (unclamped plus clamped) of any example
+   * processed so far.
+   */
+  std::size_t GetMaxArcs() const;
+
+  /**
+   * @brief Writes the top_k slowest examples of the given iteration,
+   * the ignored ones and a histogram of the example times.
+   */
+  void WriteReport(int iteration, std::size_t top_k, std::ostream& out) const;
+
+ private:
+  std::vector<ExampleStats> stats_;
+};
+
+} } // end namespaces
+
+#endif
@@ -114,7 +114,7 @@ double AddLengthRegularization(const fst::Fst<fst::MDExpectationArc>& model_fst,
 
   for (MDExpectations::const_iterator it = opts.expected_lengths->begin();
       it != opts.expected_lengths->end(); ++it) {
-    assert(it->second.sign_x); // length is positive
+    assert(it->second.sign_x()); // length is positive
     retval = NeglogPlus(retval, it->second);
   }
 
@@ -179,7 +179,7 @@ double AddLengthRegularization(const fst::Fst<fst::MDExpectationArc>& model_fst,
       }
     }
   }
-  assert(retval.sign_x);
+  assert(retval.sign_x());
   return GetOrigNum(retval);
 }
 
@@ -31,6 +31,7 @@
 #include "fstrain/util/double-precision-weight.h"
 #include "fstrain/util/memory-info.h"
 #include "fstrain/util/print-fst.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/util/timer.h"
 
@@ -203,10 +204,12 @@ void ObjectiveFunctionFstConditionalLenmatch::ComputeGradientsAndFunctionValue(c
 void ObjectiveFunctionFstConditionalLenmatch::ProcessInputOutputPair(
     const std::string& in, const std::string& out, int iteration) {
   using nsObjectiveFunctionFstUtil::GetFeatureMDExpectations;
-  VectorFst<MDExpectationArc> inputFst;
-  VectorFst<MDExpectationArc> outputFst;
-  util::ConvertStringToFst(in, *isymbols_, &inputFst);
-  util::ConvertStringToFst(out, *osymbols_, &outputFst);
+  std::vector<MDExpectationArc::Label> input_labels;
+  std::vector<MDExpectationArc::Label> output_labels;
+  util::ConvertStringToLabels(in, *isymbols_, &input_labels);
+  util::ConvertStringToLabels(out, *osymbols_, &output_labels);
+  util::LinearFst<MDExpectationArc> inputFst(input_labels);
+  util::LinearFst<MDExpectationArc> outputFst(output_labels);
   assert(inputFst.InputSymbols() == NULL);
   assert(GetFst().InputSymbols() == NULL);
   ComposeFst<MDExpectationArc> unclamped(inputFst, GetFst());
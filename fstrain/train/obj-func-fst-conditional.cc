@@ -25,10 +25,15 @@
 // #include "fst/arcsort.h"
 #include "fstrain/core/expectation-arc.h"
 #include "fstrain/core/debug.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/util/print-fst.h"
 #include "fstrain/util/timer.h"
+#include "fstrain/util/trace.h"
+#include "fstrain/util/memory-governor.h"
 #include "fstrain/util/memory-info.h"
+#include "fstrain/util/misc.h"
+#include "fstrain/util/options.h"
 #include "fstrain/util/compose-fcts.h"
 
 #include <boost/foreach.hpp>
@@ -38,6 +43,12 @@ using namespace fst;
 
 namespace fstrain { namespace train {
 
+// rough size of a lattice arc with its expectations (a few features
+// each), for the memory governor
+static const std::size_t kBytesPerLatticeArc = sizeof(MDExpectationArc)
+    + sizeof(core::MDExpectations)
+    + 4 * (sizeof(core::MDExpectations::value_type) + 4 * sizeof(void*));
+
 struct ProcessInputOutputPair_Fct {
   ObjectiveFunctionFstConditional* obj;
   const util::Data& data;
@@ -51,8 +62,7 @@ struct ProcessInputOutputPair_Fct {
       : obj(obj_), data(data_), first(first_), last(last_), iteration(iteration_) {}
   void operator()() {
     for (std::size_t i = first; i <= last; ++i) {
-      const std::pair<std::string, std::string>& inout = data[i];
-      obj->ProcessInputOutputPair(inout.first, inout.second, iteration);
+      obj->ProcessInputOutputPair(i, iteration);
       boost::this_thread::interruption_point();
     }
   }
@@ -92,6 +102,7 @@ void ObjectiveFunctionFstConditional::ComputeGradientsAndFunctionValue(const dou
   static int call_counter = -1;
   ++call_counter;
   using nsObjectiveFunctionFstUtil::GetFeatureMDExpectations;
+  FSTR_TRACE_SPAN_ARG("compute_gradients", call_counter);
 
   util::Timer timer;
   size_t num_params = GetNumParameters();
@@ -110,13 +121,27 @@ void ObjectiveFunctionFstConditional::ComputeGradientsAndFunctionValue(const dou
   }
   SetFunctionValue(GetFunctionValue() + norm / (2.0 * variance_));
 
-  if (GetNumThreads() == 1) {
+  util::MemoryGovernor& governor = util::MemoryGovernor::instance();
+  if (use_string_compose_) {
+    model_index_.Init(GetFst()); // the weights have changed
+    governor.SetPoolSize("model index", model_index_.NumArcs() * sizeof(MDExpectationArc));
+  }
+  example_stats_.Resize(data_->size());
+
+  // each thread holds the lattices of one example
+  const std::size_t bytes_per_thread = example_stats_.GetMaxArcs() * kBytesPerLatticeArc;
+  const int num_threads =
+      governor.GetNumThreads("objective function",
+                             std::min(GetNumThreads(), (int)data_->size()),
+                             bytes_per_thread);
+  governor.SetPoolSize("lattices", num_threads * bytes_per_thread);
+
+  if (num_threads == 1) {
     ProcessInputOutputPair_Fct f(this, *data_, 0, data_->size() - 1, call_counter);
     f();
   }
   else {
     std::vector<boost::shared_ptr<boost::thread> > threads;
-    const int num_threads = std::min(GetNumThreads(), (int)data_->size()); // TEST
     int prev_last = -1;
     int block_size = data_->size() / num_threads;
     for (int i = 0; i < num_threads; ++i) {
@@ -137,6 +162,13 @@ void ObjectiveFunctionFstConditional::ComputeGradientsAndFunctionValue(const dou
     watch_thread.join();
   }
 
+  if (use_string_compose_) {
+    // don't keep a second copy of the model (and references to its
+    // expectations) through the next SetFeatureWeights
+    model_index_.Clear();
+    governor.SetPoolSize("model index", 0);
+  }
+
   std::cerr << setprecision(8)
             << "Returning x=" << x[0] << "\tg=" << gradients[0]
             << "\tobj=" << GetFunctionValue();
@@ -145,6 +177,12 @@ void ObjectiveFunctionFstConditional::ComputeGradientsAndFunctionValue(const dou
           timer.get_elapsed_time_millis(),
           util::MemoryInfo::instance().getSizeInMB());
 
+  const int top_k = util::options.has("slow-examples-top-k")
+      ? util::options.get<int>("slow-examples-top-k") : 5;
+  if (top_k > 0) {
+    example_stats_.WriteReport(call_counter, top_k, std::cerr);
+  }
+
   if (GetFunctionValue() == core::kPosInfinity) {
     double* gradients = GetGradients();
     // already done in GetFeatureMDExpectations, but not sure due to threads
@@ -160,21 +198,42 @@ void ObjectiveFunctionFstConditional::ComputeGradientsAndFunctionValue(const dou
 }
 
 void ObjectiveFunctionFstConditional::ProcessInputOutputPair(
-    const std::string& in, const std::string& out, int iteration) {
-  FSTR_TRAIN_DBG_MSG(10, "(" << in << ", " << out << "), iter " << iteration << std::endl);
+    std::size_t index, int iteration) {
+  FSTR_TRAIN_DBG_MSG(10, "example " << index << ", iter " << iteration << std::endl);
+  FSTR_TRACE_SPAN_ARG("example", index);
   using nsObjectiveFunctionFstUtil::GetFeatureMDExpectations;
-  VectorFst<MDExpectationArc> inputFst;
-  VectorFst<MDExpectationArc> outputFst;
-  util::ConvertStringToFst(in, *isymbols_, &inputFst);
-  util::ConvertStringToFst(out, *osymbols_, &outputFst);
-  assert(inputFst.InputSymbols() == NULL);
-  assert(GetFst().InputSymbols() == NULL);
+  std::vector<MDExpectationArc::Label> input_labels;
+  std::vector<MDExpectationArc::Label> output_labels;
+  data_->GetLabels(index, *isymbols_, *osymbols_, &input_labels, &output_labels);
+  ExampleStats& stats = example_stats_[index];
+  stats = ExampleStats();
+  stats.iteration = iteration;
+  const uint64 compose_start_ns = util::GetMonotonicNanos();
   VectorFst<MDExpectationArc> unclamped;
   VectorFst<MDExpectationArc> clamped;
-  //mutex_gradient_access_.lock();
-  (*compose_input_fct_)(inputFst, GetFst(), &unclamped);
-  //mutex_gradient_access_.unlock();
-  (*compose_output_fct_)(unclamped, outputFst, &clamped);
+  if (use_string_compose_) {
+    FSTR_TRACE_SPAN("compose");
+    FSTR_COUNT_PHASE(core::kPhaseCompose);
+    util::ComposeString(input_labels, model_index_, &unclamped);
+    util::ComposeWithString(unclamped, output_labels, &clamped);
+  }
+  else {
+    FSTR_TRACE_SPAN("compose");
+    FSTR_COUNT_PHASE(core::kPhaseCompose);
+    util::LinearFst<MDExpectationArc> inputFst(input_labels);
+    util::LinearFst<MDExpectationArc> outputFst(output_labels);
+    assert(inputFst.InputSymbols() == NULL);
+    assert(GetFst().InputSymbols() == NULL);
+    //mutex_gradient_access_.lock();
+    (*compose_input_fct_)(inputFst, GetFst(), &unclamped);
+    //mutex_gradient_access_.unlock();
+    (*compose_output_fct_)(unclamped, outputFst, &clamped);
+  }
+  stats.compose_ms = (util::GetMonotonicNanos() - compose_start_ns) / 1e6;
+  stats.unclamped_states = unclamped.NumStates();
+  stats.unclamped_arcs = util::CountArcs(unclamped);
+  stats.clamped_states = clamped.NumStates();
+  stats.clamped_arcs = util::CountArcs(clamped);
   double* gradients = GetGradients();
   long timelimit = *GetTimelimit(); // copy
   double clamped_result = 0.0;
@@ -182,11 +241,18 @@ void ObjectiveFunctionFstConditional::ProcessInputOutputPair(
     clamped_result = GetFeatureMDExpectations<double, double*>(
         clamped, &gradients, GetNumParameters(),
         false, 1.0,
-        GetFstDelta(), &timelimit, &mutex_gradient_access_);
+        GetFstDelta(), &timelimit, &mutex_gradient_access_, &stats);
   }
   catch(...) {
+    stats.ignored = true;
     if (iteration == 0) {
-      std::cerr << "Ignoring example: " << in << " / " << out << std::endl;
+      std::cerr << "Ignoring example: ";
+      if (data_->IsEncoded()) {
+        std::cerr << index << std::endl;
+      }
+      else {
+        std::cerr << (*data_)[index].first << " / " << (*data_)[index].second << std::endl;
+      }
     }
     return;
   }
@@ -197,7 +263,7 @@ void ObjectiveFunctionFstConditional::ProcessInputOutputPair(
       GetFeatureMDExpectations(unclamped, &gradients, GetNumParameters(),
                              true, 1.0, GetFstDelta(),
                              iteration == 0 ? &unlimited : GetTimelimit(),
-                             &mutex_gradient_access_);
+                             &mutex_gradient_access_, &stats);
   // std::cerr << "New time limit: " << GetTimelimit() << std::endl;
   FSTR_TRAIN_DBG_MSG(10, "UNCLAMPED=" << unclamped_result << std::endl);
   {
@@ -19,10 +19,12 @@
 #include <string>
 #include "obj-func-fst.h"
 #include "obj-func-fst-util.h"
+#include "example-stats.h"
 #include "fst/mutable-fst.h"
 #include "fst/symbol-table.h"
 #include "fstrain/util/data.h"
 #include "fstrain/util/compose-fcts.h"
+#include "fstrain/util/string-compose.h"
 #include "fstrain/core/expectation-arc.h"
 #include <boost/thread/mutex.hpp>
 
@@ -55,13 +57,27 @@ class ObjectiveFunctionFstConditional : public ObjectiveFunctionFst {
         data_(data), isymbols_(isymbols), osymbols_(osymbols), variance_(variance),
         compose_input_fct_(compose_input_fct), compose_output_fct_(compose_output_fct)
   {
+    // plain composition with strings on both sides can use the
+    // string composition (see util::ComposeString)
+    typedef util::DefaultComposeFct<fst::MDExpectationArc> DefaultFct;
+    use_string_compose_ = dynamic_cast<DefaultFct*>(compose_input_fct_) != NULL
+        && dynamic_cast<DefaultFct*>(compose_output_fct_) != NULL;
     std::cerr << "# Constructing ObjectiveFunctionFstConditional" << std::endl;
+    data_->CheckSymbols(*isymbols_, *osymbols_);
     std::cerr << "# Data size: " << data_->size() << std::endl;
     std::cerr << "# Num params: " << GetNumParameters() << std::endl;
   }
 
   virtual ~ObjectiveFunctionFstConditional();
 
+  /**
+   * @brief Per-example costs of the last evaluation each example was
+   * processed in, e.g. to predict the cost of the next evaluation.
+   */
+  const ExampleStatsTable& GetExampleStats() const {
+    return example_stats_;
+  }
+
  protected:
 
   virtual void ComputeGradientsAndFunctionValue(const double* params);
@@ -75,11 +91,13 @@ class ObjectiveFunctionFstConditional : public ObjectiveFunctionFst {
   std::set<int> exclude_data_indices_;
   util::ComposeFct<fst::MDExpectationArc>* compose_input_fct_;
   util::ComposeFct<fst::MDExpectationArc>* compose_output_fct_;
+  bool use_string_compose_;
+  util::LabelIndexedFst<fst::MDExpectationArc> model_index_; // only during an evaluation
   boost::mutex mutex_gradient_access_;
   boost::mutex mutex_functionval_access_;
+  ExampleStatsTable example_stats_;
 
-  void ProcessInputOutputPair(const std::string& in, const std::string& out,
-                              int iteration);
+  void ProcessInputOutputPair(std::size_t index, int iteration);
 
   friend struct ProcessInputOutputPair_Fct;
 
@@ -37,6 +37,7 @@
 #include "fstrain/util/double-precision-weight.h"
 #include "fstrain/util/memory-info.h"
 #include "fstrain/util/print-fst.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/util/timer.h"
 
@@ -229,12 +230,15 @@ void ObjectiveFunctionFstCondotherLenmatch::ProcessInputOutputPair(
   typedef WeightConvertMapper<LogArc, StdArc> Map_LS;
   typedef WeightConvertMapper<StdArc, LogArc> Map_SL;
   using nsObjectiveFunctionFstUtil::GetFeatureMDExpectations;
-  VectorFst<MDExpectationArc> inputFst;
-  VectorFst<MDExpectationArc> outputFst;
-  VectorFst<LogArc> other_fst;
-  util::ConvertStringToFst(in, *isymbols_, &inputFst);
-  util::ConvertStringToFst(out, *osymbols_, &outputFst);
-  util::ConvertStringToFst(other, *other_symbols_, &other_fst);
+  std::vector<MDExpectationArc::Label> input_labels;
+  std::vector<MDExpectationArc::Label> output_labels;
+  util::ConvertStringToLabels(in, *isymbols_, &input_labels);
+  util::ConvertStringToLabels(out, *osymbols_, &output_labels);
+  util::LinearFst<MDExpectationArc> inputFst(input_labels);
+  util::LinearFst<MDExpectationArc> outputFst(output_labels);
+  std::vector<LogArc::Label> other_labels;
+  util::ConvertStringToLabels(other, *other_symbols_, &other_labels);
+  util::LinearFst<LogArc> other_fst(other_labels);
   assert(inputFst.InputSymbols() == NULL);
   assert(GetFst().InputSymbols() == NULL);
 
@@ -26,6 +26,7 @@
 #include "fstrain/core/expectation-arc.h"
 #include "fstrain/core/debug.h"
 // #include "fstrain/core/fst-util.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/util/timer.h"
 #include "fstrain/util/memory-info.h"
@@ -122,10 +123,12 @@ void ObjectiveFunctionFstJoint::ComputeGradientsAndFunctionValue(const double* x
 void ObjectiveFunctionFstJoint::ProcessInputOutputPair(
     const std::string& in, const std::string& out) {
   using nsObjectiveFunctionFstUtil::GetFeatureMDExpectations;
-  VectorFst<MDExpectationArc> inputFst;
-  VectorFst<MDExpectationArc> outputFst;
-  util::ConvertStringToFst(in, *isymbols_, &inputFst);
-  util::ConvertStringToFst(out, *osymbols_, &outputFst);
+  std::vector<MDExpectationArc::Label> input_labels;
+  std::vector<MDExpectationArc::Label> output_labels;
+  util::ConvertStringToLabels(in, *isymbols_, &input_labels);
+  util::ConvertStringToLabels(out, *osymbols_, &output_labels);
+  util::LinearFst<MDExpectationArc> inputFst(input_labels);
+  util::LinearFst<MDExpectationArc> outputFst(output_labels);
   ComposeFst<MDExpectationArc> unclamped(inputFst, GetFst());
   ComposeFstOptions<MDExpectationArc> copts;
   copts.gc_limit = 0;  // Cache only the last state for fastest copy.
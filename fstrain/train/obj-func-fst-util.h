@@ -27,9 +27,11 @@
 #include "fstrain/train/timeout.h"
 // #include "fstrain/core/fst-util.h"
 #include "fstrain/util/timer.h"
+#include "fstrain/util/trace.h"
 #include "fstrain/util/check-convergence.h"
 #include "fstrain/util/double-precision-weight.h"
 #include "fstrain/train/debug.h"
+#include "fstrain/train/example-stats.h"
 #include <boost/thread/mutex.hpp>
 
 namespace fstrain { namespace train {
@@ -46,6 +48,8 @@ namespace nsObjectiveFunctionFstUtil {
  * will be set to max(timelimit_ms, elapsed time) which may be bigger
  * than timelimit_ms if FST was found to be convergent after timeout.
  *
+ * @param stats If given, the time and timeouts are added to it.
+ *
  * @return true if ShortestDistance was successful, false if it diverged
  */
 template<class Arc>
@@ -53,16 +57,24 @@ bool TimedShortestDistance(const fst::Fst<Arc>& fst,
 			   std::vector<typename Arc::Weight>* result,
 			   bool reverse,
 			   double kDelta,
-			   long* timelimit_ms) {
+			   long* timelimit_ms,
+                           ExampleStats* stats = NULL) {
   using util::LogDArc;
   if (*timelimit_ms >= 0 && *timelimit_ms < 100) {
     FSTR_TRAIN_DBG_MSG(10, "Resetting time limit to " << 100 << std::endl);
     *timelimit_ms = 100;
   }
+  FSTR_COUNT_PHASE(core::kPhaseShortestDistance);
+  uint64 start_ns = util::GetMonotonicNanos();
   Timeout timeout(*timelimit_ms);
   ShortestDistance(fst, result, reverse, kDelta, &timeout);
   if (timeout()) {
     std::cerr << *timelimit_ms << " ms reached." << std::endl;
+    if (stats != NULL) {
+      ++stats->num_timeouts;
+      stats->shortest_distance_ms += (util::GetMonotonicNanos() - start_ns) / 1e6;
+      start_ns = util::GetMonotonicNanos();
+    }
     // bool ok = util::CheckConvergence(fst);
     typedef fst::WeightConvertMapper<Arc, LogDArc> Map_AL;
     fst::MapFstOptions map_opts;
@@ -70,6 +82,10 @@ bool TimedShortestDistance(const fst::Fst<Arc>& fst,
     util::CheckConvergenceOptions opts;
     fst::MapFst<Arc, LogDArc, Map_AL> mapped_fst(fst, Map_AL(), map_opts);
     bool ok = util::CheckConvergence(mapped_fst, opts);
+    if (stats != NULL) {
+      stats->convergence_check_ms += (util::GetMonotonicNanos() - start_ns) / 1e6;
+      start_ns = util::GetMonotonicNanos();
+    }
     if (!ok) {
       std::cerr << "DIVERGE" << std::endl;
       return false;
@@ -90,6 +106,9 @@ bool TimedShortestDistance(const fst::Fst<Arc>& fst,
     *timelimit_ms = std::max(*timelimit_ms, std::min(*timelimit_ms * 2, (long)elapsed));
     std::cerr << "New limit: " << *timelimit_ms << " ms." << std::endl;
   }
+  if (stats != NULL) {
+    stats->shortest_distance_ms += (util::GetMonotonicNanos() - start_ns) / 1e6;
+  }
   return true;
 }
 
@@ -114,7 +133,8 @@ DoubleT GetFeatureMDExpectations(const fst::Fst<fst::MDExpectationArc>& fst,
 			       DoubleT factor, // = 1.0,
 			       DoubleT kDelta , //= 1e-10,
 			       long* timelimit_ms,
-                               boost::mutex* mutex_gradient_access = NULL) {
+                               boost::mutex* mutex_gradient_access = NULL,
+                               ExampleStats* stats = NULL) {
   // util::printTransducer(&fst, NULL, NULL, std::cerr);
   // util::printFstSize("", &fst, std::cerr);
   using util::LogDArc;
@@ -133,7 +153,11 @@ DoubleT GetFeatureMDExpectations(const fst::Fst<fst::MDExpectationArc>& fst,
   std::vector<LogDWeight> betas;
   LogDArc::StateId start_state = mapped.Start();
 
-  bool success1 = TimedShortestDistance(mapped, &alphas, false, kDelta, timelimit_ms);
+  bool success1;
+  {
+    FSTR_TRACE_SPAN("alpha");
+    success1 = TimedShortestDistance(mapped, &alphas, false, kDelta, timelimit_ms, stats);
+  }
   // TODO: handle mutex
   if (!success1) {
     ResetArray(array, array_size, mutex_gradient_access);
@@ -141,7 +165,11 @@ DoubleT GetFeatureMDExpectations(const fst::Fst<fst::MDExpectationArc>& fst,
   }
   assert(alphas.size() > 0);
 
-  bool success2 = TimedShortestDistance(mapped, &betas, true, kDelta, timelimit_ms);
+  bool success2;
+  {
+    FSTR_TRACE_SPAN("beta");
+    success2 = TimedShortestDistance(mapped, &betas, true, kDelta, timelimit_ms, stats);
+  }
   if (!success2) {
     ResetArray(array, array_size, mutex_gradient_access);
     return fstrain::core::kNegInfinity;
@@ -151,6 +179,8 @@ DoubleT GetFeatureMDExpectations(const fst::Fst<fst::MDExpectationArc>& fst,
     throw std::runtime_error("no paths: bad fst");
   }
 
+  FSTR_TRACE_SPAN("expectations");
+  FSTR_COUNT_PHASE(core::kPhaseExpectations);
   MDExpectations feat_expectations;
   for (fst::StateIterator< fst::Fst<fst::MDExpectationArc> > siter(fst); !siter.Done(); siter.Next()) {
     StateId in = siter.Value();
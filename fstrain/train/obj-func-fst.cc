@@ -12,11 +12,14 @@
 //
 // Author: markus.dreyer@gmail.com (Markus Dreyer)
 //
+#include <algorithm>
 #include <iomanip>
 
 #include "fst/mutable-fst.h"
+#include "fst/vector-fst.h"
 
 #include "fstrain/core/expectation-arc.h"
+#include "fstrain/core/op-counters.h"
 
 #include "fstrain/train/debug.h"
 #include "fstrain/train/obj-func-fst.h"
@@ -24,8 +27,12 @@
 
 #include "fstrain/util/check-convergence.h"
 #include "fstrain/util/get-highest-feature-index.h"
+#include "fstrain/util/intern-expectations.h"
 #include "fstrain/util/double-precision-weight.h"
+#include "fstrain/util/memory-governor.h"
 #include "fstrain/util/memory-info.h"
+#include "fstrain/util/options.h"
+#include "fstrain/util/reorder-states.h"
 
 using namespace fst;
 
@@ -37,8 +44,22 @@ ObjectiveFunctionFst::ObjectiveFunctionFst(MutableFst<MDExpectationArc>* fst)
   std::cerr << "# Constructing ObjectiveFunctionFst" << std::endl;
   int highest_feature_index =
       (fst_ == NULL) ? -1 : fstrain::util::getHighestFeatureIndex(*fst_);
+  if (fst_ != NULL && util::options.has("state-order")) {
+    util::ReorderStates(fst_, util::ParseStateOrder(
+        util::options.get<std::string>("state-order")));
+  }
+  if (fst_ != NULL) {
+    std::size_t num_sets = fstrain::util::InternExpectations(fst_);
+    std::cerr << "# Distinct feature sets: " << num_sets << std::endl;
+  }
   num_params_ = highest_feature_index + 1;
+  // hashed features: the size does not depend on which IDs occur
+  if (util::options.has("feature-space-size")) {
+    num_params_ = std::max(num_params_,
+                           util::options.get<int>("feature-space-size"));
+  }
   gradients_ = (double*) calloc(num_params_, sizeof(double));
+  util::MemoryGovernor::instance().SetPoolSize("gradients", num_params_ * sizeof(double));
   std::cerr << "# Num params: " << num_params_ << std::endl;
 }
 
@@ -48,8 +69,10 @@ ObjectiveFunctionFst::~ObjectiveFunctionFst() {
 }
 
 void ObjectiveFunctionFst::SetParameters(const double* x) {
+  core::ResetOpCounts();
   SetFeatureWeights(x, fst_);
   ComputeGradientsAndFunctionValue(x);
+  core::WriteOpCounts(std::cerr);
 }
 
 const double* ObjectiveFunctionFst::GetParameters() const {
@@ -80,7 +103,24 @@ void ObjectiveFunctionFst::SquashFunction() {
 void Save(const ObjectiveFunctionFst& theFunction, const std::string& filename) {
   std::cerr << "# Enter Save(), using " << util::MemoryInfo::instance().getSizeInMB()
             << " MB." << std::endl;
-  theFunction.GetFst().Write(filename);
+  // with option "state-order", saved models are reordered for
+  // locality (unless that would need too much memory), so that
+  // training on them starts out that way
+  const util::StateOrder order = util::ParseStateOrder(
+      util::options.has("state-order")
+      ? util::options.get<std::string>("state-order") : "none");
+  if (order == util::kStateOrderNone
+      || util::MemoryGovernor::instance().GetPressure() == util::kMemoryPressureCritical) {
+    theFunction.GetFst().Write(filename);
+  }
+  else {
+    VectorFst<MDExpectationArc> reordered;
+    util::ReorderStates(theFunction.GetFst(), order, &reordered);
+    std::cerr << "# Average arc jump of the saved model: "
+              << util::GetAverageArcJump(theFunction.GetFst()) << " -> "
+              << util::GetAverageArcJump(reordered) << " states" << std::endl;
+    reordered.Write(filename);
+  }
   std::cerr << "# Exit Save(), using " << util::MemoryInfo::instance().getSizeInMB()
             << " MB." << std::endl;
 }
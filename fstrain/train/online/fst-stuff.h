@@ -16,7 +16,9 @@
 #include "fstrain/train/set-feature-weights.h"
 #include "fstrain/util/data.h"
 #include "fstrain/util/print-fst.h"
+#include "fstrain/util/string-compose.h"
 #include "fstrain/util/string-to-fst.h"
+#include "fstrain/util/trace.h"
 #include "fstrain/util/double-precision-weight.h"
 #include "fstrain/core/neg-log-of-signed-num.h"
 
@@ -77,13 +79,20 @@ void AddFeatMDExpectations(const fst::Fst<Arc>& fst,
 
   std::vector<LogDArc::Weight> alphas;
   std::vector<LogDArc::Weight> betas;
-  fst::ShortestDistance(mapped, &alphas);
-  fst::ShortestDistance(mapped, &betas, true);
+  {
+    FSTR_TRACE_SPAN("alpha");
+    fst::ShortestDistance(mapped, &alphas);
+  }
+  {
+    FSTR_TRACE_SPAN("beta");
+    fst::ShortestDistance(mapped, &betas, true);
+  }
   const bool no_paths_fst = (betas.size() == 0);
   if (no_paths_fst) {
     throw std::runtime_error("no paths: bad fst");
   }
 
+  FSTR_TRACE_SPAN("expectations");
   MDExpectations feat_expectations;
   for (fst::StateIterator< fst::Fst<fst::MDExpectationArc> > siter(fst);
        !siter.Done(); siter.Next()) {
@@ -123,8 +132,13 @@ void AddFeatMDExpectations(const fst::Fst<Arc>& fst,
 
 }
 
+/**
+ * @brief Adds the gradients for one data point. The model is given as
+ * an index (see util::ComposeString); its weights are not used, they
+ * are set from the feature weights after composition.
+ */
 template<class Arc, class Map>
-void AddGradients(const fst::Fst<Arc>& fst,
+void AddGradients(const util::LabelIndexedFst<Arc>& model_index,
                   const double* weights,
                   const fst::SymbolTable& isyms,
                   const fst::SymbolTable& osyms,
@@ -132,16 +146,24 @@ void AddGradients(const fst::Fst<Arc>& fst,
                   int data_index,
                   Map* result) {
   using namespace fst;
-  const std::pair<std::string,std::string>& data_point = data[data_index];
-  VectorFst<Arc> input_fst;
-  VectorFst<Arc> output_fst;
-  util::ConvertStringToFst(data_point.first, isyms, &input_fst);
-  util::ConvertStringToFst(data_point.second, osyms, &output_fst);
+  FSTR_TRACE_SPAN_ARG("example", data_index);
+  std::vector<typename Arc::Label> input_labels;
+  std::vector<typename Arc::Label> output_labels;
+  data.GetLabels(data_index, isyms, osyms, &input_labels, &output_labels);
   VectorFst<Arc> unclamped;
   VectorFst<Arc> clamped;
-  Compose(input_fst, fst, &unclamped);
-  fst::Map(&unclamped, SetFeatureWeightsMapper<double>(weights));
-  Compose(unclamped, output_fst, &clamped);
+  {
+    FSTR_TRACE_SPAN("compose");
+    util::ComposeString(input_labels, model_index, &unclamped);
+  }
+  {
+    FSTR_TRACE_SPAN("reweight");
+    fst::Map(&unclamped, SetFeatureWeightsMapper<double>(weights));
+  }
+  {
+    FSTR_TRACE_SPAN("compose");
+    util::ComposeWithString(unclamped, output_labels, &clamped);
+  }
   AddFeatMDExpectations(clamped, weights, true, result);
   AddFeatMDExpectations(unclamped, weights, false, result);
 }
@@ -150,6 +172,7 @@ template<class Arc>
 class FstBatches : public Batches {
 
   const fst::Fst<Arc>& orig_fst_;
+  const util::LabelIndexedFst<Arc> model_index_;
   fst::Fst<Arc>* model_fst_;
   double* weights_;
   const fst::SymbolTable& isyms_;
@@ -166,9 +189,10 @@ class FstBatches : public Batches {
              const fst::SymbolTable& osyms,
              const fstrain::util::Data& data,
              int batch_size)
-      : orig_fst_(model_fst), model_fst_(NULL), weights_(weights), isyms_(isyms), osyms_(osyms),
+      : orig_fst_(model_fst), model_index_(model_fst), model_fst_(NULL), weights_(weights), isyms_(isyms), osyms_(osyms),
         data_(data), batch_size_(batch_size), data_index_(0)
   {
+    data_.CheckSymbols(isyms_, osyms_);
     // UpdateWeights();
   }
 
@@ -195,7 +219,7 @@ class FstBatches : public Batches {
 
   Batches::Map Value() const {
     Batches::Map gradients;
-    AddGradients(orig_fst_, weights_, isyms_, osyms_, data_, data_index_, &gradients);
+    AddGradients(model_index_, weights_, isyms_, osyms_, data_, data_index_, &gradients);
     // AddGradients(*model_fst_, weights_, isyms_, osyms_, data_, data_index_, &gradients);
     return gradients;
   }
@@ -6,6 +6,7 @@
 #include <map>
 
 #include "fstrain/util/timer.h"
+#include "fstrain/util/trace.h"
 #include "fstrain/util/memory-info.h"
 
 namespace fstrain { namespace train { namespace online {
@@ -141,6 +142,7 @@ class CumulativeL1Trainer {
   void Train() {
     int k = 0;
     for (int pass = 0; pass < num_passes_; ++pass) {
+      FSTR_TRACE_SPAN_ARG("train_pass", pass);
       util::Timer timer;
       std::cerr << "PASS " << pass << std::endl;
       int cnt = 1;
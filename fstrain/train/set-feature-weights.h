@@ -22,9 +22,13 @@
 #define FSTRAIN_TRAIN_SET_FEATURE_WEIGHTS_H_
 
 #include <map>
+#include <tr1/unordered_map>
+#include <utility>
+#include <boost/functional/hash.hpp>
 #include "fst/mutable-fst.h"
 #include "fst/map.h"
 #include "fstrain/core/expectation-arc.h"
+#include "fstrain/util/trace.h"
 
 namespace fstrain { namespace train {
 
@@ -50,7 +54,15 @@ class SetFeatureWeightsMapper {
 
   void SetFeatures(fst::MDExpectationWeight* weight) const;
 
+  typedef std::pair<const fst::MDExpectationWeight::MDExpectations*, double> SharedKey;
+  typedef std::pair<fst::MDExpectationWeight, fst::MDExpectationWeight> OldAndNew;
+  typedef std::tr1::unordered_map<SharedKey, OldAndNew, boost::hash<SharedKey> > SharedResults;
+
   const FloatT* weights_;
+  // results for interned expectations (see util::InternExpectations),
+  // so that they stay shared; the old weight is kept so its address
+  // is not reused
+  mutable SharedResults shared_results_;
 };
 
 /**
@@ -71,6 +83,18 @@ SetFeatureWeightsMapper<FloatT>::SetFeatureWeightsMapper(const FloatT* weights)
 
 template<class FloatT>
 fst::MDExpectationArc SetFeatureWeightsMapper<FloatT>::operator()(const fst::MDExpectationArc& arc) const {
+  const fst::MDExpectationWeight::MDExpectations* id = arc.weight.GetMDExpectationsId();
+  if (id != NULL && id->isInterned()) {
+    const SharedKey key(id, arc.weight.Value());
+    typename SharedResults::iterator found = shared_results_.find(key);
+    if (found == shared_results_.end()) {
+      fst::MDExpectationWeight new_weight(arc.weight);
+      SetFeatures(&new_weight);
+      found = shared_results_.insert(
+          std::make_pair(key, OldAndNew(arc.weight, new_weight))).first;
+    }
+    return fst::MDExpectationArc(arc.ilabel, arc.olabel, found->second.second, arc.nextstate);
+  }
   fst::MDExpectationWeight new_weight(arc.weight);
   SetFeatures(&new_weight);
   return fst::MDExpectationArc(arc.ilabel, arc.olabel, new_weight, arc.nextstate);
@@ -95,15 +119,16 @@ void SetFeatureWeightsMapper<FloatT>::SetFeatures(fst::MDExpectationWeight* weig
     for (MDExpectations::iterator it = e.begin(); it != e.end(); ++it) {
       it->second = NeglogTimes(arc_weight, feat_cnt_fire_neglog_map[it->first]);
     }
-    assert(arc_weight.sign_x); // represents a positive num
-    // weight->SetValue(arc_weight.lx);
+    assert(arc_weight.sign_x()); // represents a positive num
+    // weight->SetValue(arc_weight.lx());
     double const& val = weight->Value();
-    const_cast<double&>(val) = arc_weight.lx; // HACK
+    const_cast<double&>(val) = arc_weight.lx(); // HACK
   }
 }
 
 template<class FloatT>
 void SetFeatureWeights(const FloatT* weights, fst::MutableFst<fst::MDExpectationArc>* fst) {
+  FSTR_TRACE_SPAN("reweight");
   SetFeatureWeightsMapper<FloatT> mapper(weights);
   Map(fst, mapper);
 }
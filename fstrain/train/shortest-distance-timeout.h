@@ -28,6 +28,8 @@
 #include <fst/queue.h>
 #include <fst/reverse.h>
 #include <fst/test-properties.h>
+#include "fstrain/core/expectation-weight.h"
+#include "fstrain/core/op-counters.h"
 #include "fstrain/train/timeout.h"
 
 namespace fstrain { namespace train {
@@ -35,6 +37,33 @@ namespace fstrain { namespace train {
 using namespace fst;
 using std::vector;
 
+// Relaxes the distance 'nd' and the residual 'nr' of a state by r *
+// w; returns false if the distance did not change (within delta).
+template <class Weight>
+inline bool RelaxDistance(Weight *nd, Weight *nr,
+                          const Weight &r, const Weight &w, float delta) {
+  Weight rw = Times(r, w);
+  Weight sum = Plus(*nd, rw);
+  if (ApproxEqual(*nd, sum, delta))
+    return false;
+  *nd = sum;
+  *nr = Plus(*nr, rw);
+  return true;
+}
+
+// Same for expectation weights, but updates the distances in place
+// instead of building the product and the sums, so that it allocates
+// only when a state sees new features.
+inline bool RelaxDistance(MDExpectationWeight *nd, MDExpectationWeight *nr,
+                          const MDExpectationWeight &r,
+                          const MDExpectationWeight &w, float delta) {
+  if (ApproxEqualPlusTimes(*nd, r, w, delta))
+    return false;
+  PlusTimesEq(nd, r, w);
+  PlusTimesEq(nr, r, w);
+  return true;
+}
+
 template <class Arc, class Queue, class ArcFilter>
 struct ShortestDistanceOptions {
   typedef typename Arc::StateId StateId;
@@ -156,6 +185,7 @@ void ShortestDistanceState<Arc, Queue, ArcFilter>::ShortestDistance(
          && (timeout_ == NULL || !(*timeout_)())) {
     StateId s = state_queue_->Head();
     state_queue_->Dequeue();
+    FSTR_COUNT_OP(fstrain::core::kOpQueuePop);
     while (distance_->size() <= s) {
       distance_->push_back(Weight::Zero());
       rdistance_.push_back(Weight::Zero());
@@ -187,12 +217,8 @@ void ShortestDistanceState<Arc, Queue, ArcFilter>::ShortestDistance(
           sources_[arc.nextstate] = source;
         }
       }
-      Weight &nd = (*distance_)[arc.nextstate];
-      Weight &nr = rdistance_[arc.nextstate];
-      Weight w = Times(r, arc.weight);
-      if (!ApproxEqual(nd, Plus(nd, w), delta_)) {
-        nd = Plus(nd, w);
-        nr = Plus(nr, w);
+      if (RelaxDistance(&(*distance_)[arc.nextstate],
+                        &rdistance_[arc.nextstate], r, arc.weight, delta_)) {
         if (!enqueued_[arc.nextstate]) {
           state_queue_->Enqueue(arc.nextstate);
           enqueued_[arc.nextstate] = true;
@@ -0,0 +1,76 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+// Helpers shared by the composition tests.
+
+#ifndef FSTRAIN_TRAIN_TEST_RANDOM_FSTS_H
+#define FSTRAIN_TRAIN_TEST_RANDOM_FSTS_H
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "fst/fst.h"
+#include "fst/mutable-fst.h"
+#include "fst/shortest-distance.h"
+
+namespace fstrain { namespace train { namespace test {
+
+inline double GetPathsum(const fst::Fst<fst::LogArc>& f) {
+  std::vector<fst::LogWeight> betas;
+  fst::ShortestDistance(f, &betas, true);
+  if (betas.size() == 0 || f.Start() == fst::kNoStateId) {
+    return fst::LogWeight::Zero().Value();
+  }
+  return betas[f.Start()].Value();
+}
+
+/**
+ * @brief Random model; epsilon arcs only lead to higher states, so
+ * there are no epsilon cycles.
+ */
+inline void GetRandomModel(int num_states, fst::MutableFst<fst::LogArc>* model) {
+  using fst::LogArc;
+  using fst::LogWeight;
+  for (int s = 0; s < num_states; ++s) {
+    model->AddState();
+  }
+  model->SetStart(0);
+  for (int s = 0; s < num_states; ++s) {
+    if (rand() % 3 == 0) {
+      model->SetFinal(s, LogWeight(0.3 * (rand() % 5)));
+    }
+    const int num_arcs = rand() % 5;
+    for (int k = 0; k < num_arcs; ++k) {
+      const int ilabel = rand() % 3;
+      const int olabel = rand() % 3;
+      int nextstate = rand() % num_states;
+      if ((ilabel == 0 || olabel == 0) && nextstate <= s) {
+        if (s + 1 >= num_states) {
+          continue;
+        }
+        nextstate = s + 1 + rand() % (num_states - s - 1);
+      }
+      model->AddArc(s, LogArc(ilabel, olabel, LogWeight(0.2 * (rand() % 10)),
+                              nextstate));
+    }
+  }
+}
+
+inline bool Same(double a, double b) {
+  return (a == b) || std::fabs(a - b) < 1e-4;
+}
+
+} } } // end namespaces
+
+#endif
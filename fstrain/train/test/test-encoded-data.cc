@@ -0,0 +1,137 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+
+#include <unistd.h> // unlink
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "fst/symbol-table.h"
+#include "fstrain/util/data.h"
+#include "fstrain/util/encoded-data.h"
+
+using fstrain::util::Data;
+using fstrain::util::EncodedData;
+
+void Test(bool b, const char* what) {
+  std::cout << what << ": " << (b ? "OK" : "FAIL") << std::endl;
+  if (!b) {
+    throw std::runtime_error("FAIL");
+  }
+}
+
+std::string ReadFile(const std::string& filename) {
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string& filename, const std::string& contents) {
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out.write(contents.data(), contents.size());
+}
+
+bool IsRejected(const std::string& filename) {
+  try {
+    EncodedData data(filename);
+  }
+  catch (std::exception& e) {
+    return true;
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  const std::string filename = "test-encoded-data.tmp";
+  try{
+    fst::SymbolTable isymbols("isymbols");
+    isymbols.AddSymbol("<eps>");
+    isymbols.AddSymbol("a");
+    isymbols.AddSymbol("b");
+    fst::SymbolTable osymbols("osymbols");
+    osymbols.AddSymbol("<eps>");
+    osymbols.AddSymbol("x");
+    osymbols.AddSymbol("y");
+    osymbols.AddSymbol("z");
+    Data data;
+    data.push_back("a b", "x");
+    data.push_back("b", "y z x");
+    data.push_back("a a b", "z");
+    EncodedData::Write(data, isymbols, osymbols, filename);
+
+    // read back through EncodedData and through Data
+    Test(EncodedData::IsEncodedFile(filename), "magic");
+    Data encoded(filename);
+    Test(encoded.IsEncoded() && encoded.size() == data.size(), "size");
+    encoded.CheckSymbols(isymbols, osymbols);
+    bool same = true;
+    for (std::size_t i = 0; i < data.size(); ++i) {
+      std::vector<int> in1, out1, in2, out2;
+      data.GetLabels(i, isymbols, osymbols, &in1, &out1);
+      encoded.GetLabels(i, isymbols, osymbols, &in2, &out2);
+      same = same && in1 == in2 && out1 == out2;
+    }
+    Test(same, "pairs");
+    fst::SymbolTable other_osymbols("other-osymbols");
+    other_osymbols.AddSymbol("<eps>");
+    other_osymbols.AddSymbol("y");
+    bool symbols_checked = false;
+    try {
+      encoded.CheckSymbols(isymbols, other_osymbols);
+    }
+    catch (std::exception& e) {
+      symbols_checked = true;
+    }
+    Test(symbols_checked, "symbols");
+
+    // bad files are rejected, not read out of bounds
+    const std::string contents = ReadFile(filename);
+    const std::size_t header_size = 8 + 4 * sizeof(uint64);
+    const std::size_t offsets_size = (2 * data.size() + 1) * sizeof(uint64);
+    WriteFile(filename, contents.substr(0, contents.size() - sizeof(int32)));
+    Test(IsRejected(filename), "truncated labels");
+    WriteFile(filename, contents.substr(0, header_size + offsets_size / 2));
+    Test(IsRejected(filename), "truncated offsets");
+    std::string corrupt = contents;
+    const uint64 big = 1000;
+    corrupt.replace(header_size + 2 * sizeof(uint64), sizeof(uint64),
+                    reinterpret_cast<const char*>(&big), sizeof(uint64));
+    WriteFile(filename, corrupt);
+    Test(IsRejected(filename), "offset past the labels");
+    corrupt = contents;
+    const uint64 zero = 0;
+    corrupt.replace(header_size + 2 * sizeof(uint64), sizeof(uint64),
+                    reinterpret_cast<const char*>(&zero), sizeof(uint64));
+    WriteFile(filename, corrupt);
+    Test(IsRejected(filename), "decreasing offsets");
+    corrupt = contents;
+    const uint64 many = static_cast<uint64>(-1) / 2;
+    corrupt.replace(8, sizeof(uint64), reinterpret_cast<const char*>(&many),
+                    sizeof(uint64));
+    WriteFile(filename, corrupt);
+    Test(IsRejected(filename), "bad number of examples");
+  }
+  catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    unlink(filename.c_str());
+    return EXIT_FAILURE;
+  }
+  unlink(filename.c_str());
+  return EXIT_SUCCESS;
+}
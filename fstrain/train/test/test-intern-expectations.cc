@@ -0,0 +1,79 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include "fst/fst.h"
+#include "fst/equal.h"
+#include "fst/vector-fst.h"
+#include "fstrain/core/expectation-arc.h"
+#include "fstrain/util/intern-expectations.h"
+#include "fstrain/train/set-feature-weights.h"
+
+using namespace fst;
+
+void Test(bool b, const char* what) {
+  std::cout << what << ": " << (b ? "OK" : "FAIL") << std::endl;
+  if (!b) {
+    throw std::runtime_error("FAIL");
+  }
+}
+
+// arc weight with value p and feature expectations p * count
+MDExpectationWeight GetWeight(double p, int feat1, int feat2) {
+  using fstrain::core::NeglogNum;
+  MDExpectationWeight w(p);
+  w.GetMDExpectations().insert(feat1, NeglogNum(p));
+  w.GetMDExpectations().insert(feat2, NeglogNum(p));
+  return w;
+}
+
+int main(int argc, char** argv) {
+  try{
+    // arcs 0->1 with features {1,2} (twice) and {1,3}
+    VectorFst<MDExpectationArc> fst;
+    fst.AddState();
+    fst.AddState();
+    fst.SetStart(0);
+    fst.SetFinal(1, MDExpectationWeight::One());
+    fst.AddArc(0, MDExpectationArc(1, 1, GetWeight(0.5, 1, 2), 1));
+    fst.AddArc(0, MDExpectationArc(2, 2, GetWeight(0.5, 1, 2), 1));
+    fst.AddArc(0, MDExpectationArc(3, 3, GetWeight(0.5, 1, 3), 1));
+    VectorFst<MDExpectationArc> unshared(fst); // copy before interning
+
+    Test(fstrain::util::InternExpectations(&fst) == 2, "distinct sets");
+    ArcIterator< VectorFst<MDExpectationArc> > aiter(fst, 0);
+    const MDExpectationWeight::MDExpectations* id0 = aiter.Value().weight.GetMDExpectationsId();
+    aiter.Next();
+    Test(aiter.Value().weight.GetMDExpectationsId() == id0, "shared");
+    Test(id0->isInterned(), "marked");
+    aiter.Next();
+    Test(!aiter.Value().weight.GetMDExpectationsId()->isInterned(), "single set not marked");
+
+    const double weights[] = {0.0, 0.1, 0.2, 0.3};
+    fstrain::train::SetFeatureWeights(weights, &fst);
+    fstrain::train::SetFeatureWeights(weights, &unshared);
+    Test(Equal(fst, unshared), "same weights as unshared");
+    ArcIterator< VectorFst<MDExpectationArc> > aiter2(fst, 0);
+    id0 = aiter2.Value().weight.GetMDExpectationsId();
+    aiter2.Next();
+    Test(aiter2.Value().weight.GetMDExpectationsId() == id0, "still shared");
+  }
+  catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+// Compares util::LinearFst to the VectorFst built by
+// ConvertStringToFst: same machine, and same composition results with
+// random models.
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "fst/fst.h"
+#include "fst/compose.h"
+#include "fst/properties.h"
+#include "fst/vector-fst.h"
+#include "fst/verify.h"
+#include "fstrain/train/test/random-fsts.h"
+#include "fstrain/util/linear-fst.h"
+
+using namespace fst;
+using namespace fstrain::train::test;
+
+int main(int argc, char** argv) {
+  try {
+    srand(11);
+    int num_failed = 0;
+    for (int t = 0; t < 200; ++t) {
+      std::vector<LogArc::Label> str;
+      const int len = rand() % 4;
+      for (int i = 0; i < len; ++i) {
+        str.push_back(rand() % 3); // may contain epsilons
+      }
+      fstrain::util::LinearFst<LogArc> linear(str);
+      VectorFst<LogArc> expected;
+      expected.SetStart(expected.AddState());
+      for (std::size_t i = 0; i < str.size(); ++i) {
+        expected.AddState();
+        expected.AddArc(i, LogArc(str[i], str[i], LogWeight::One(), i + 1));
+      }
+      expected.SetFinal(str.size(), LogWeight::One());
+
+      const uint64 props = kAcceptor | kString | kAcyclic | kILabelSorted;
+      VectorFst<LogArc> copy(linear);
+      if (!Verify(linear) || linear.Properties(props, false) != props
+          || copy.NumStates() != expected.NumStates()
+          || !Same(GetPathsum(copy), GetPathsum(expected))) {
+        std::cerr << "Bad machine in test " << t << std::endl;
+        ++num_failed;
+        continue;
+      }
+
+      VectorFst<LogArc> model;
+      GetRandomModel(2 + rand() % 6, &model);
+      VectorFst<LogArc> result1, expected1, result2, expected2;
+      Compose(linear, model, &result1);
+      Compose(expected, model, &expected1);
+      Compose(model, linear, &result2);
+      Compose(model, expected, &expected2);
+      if (!Same(GetPathsum(result1), GetPathsum(expected1))
+          || !Same(GetPathsum(result2), GetPathsum(expected2))) {
+        std::cerr << "Mismatch in test " << t << std::endl;
+        ++num_failed;
+      }
+    }
+    if (num_failed > 0) {
+      std::cerr << num_failed << " tests failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cerr << "OK" << std::endl;
+  }
+  catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
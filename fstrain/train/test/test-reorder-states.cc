@@ -0,0 +1,84 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "fst/fst.h"
+#include "fst/vector-fst.h"
+#include "fstrain/util/reorder-states.h"
+
+using namespace fst;
+
+void Test(bool b, const char* what) {
+  std::cout << what << ": " << (b ? "OK" : "FAIL") << std::endl;
+  if (!b) {
+    throw std::runtime_error("FAIL");
+  }
+}
+
+int main(int argc, char** argv) {
+  try{
+    // chain with labels 1..5 through the scrambled states 3 4 0 5 1 2,
+    // plus an unreachable state 6
+    const int chain[] = {3, 4, 0, 5, 1, 2};
+    VectorFst<StdArc> fst;
+    for (int i = 0; i < 7; ++i) {
+      fst.AddState();
+    }
+    fst.SetStart(chain[0]);
+    for (int i = 0; i < 5; ++i) {
+      fst.AddArc(chain[i], StdArc(i + 1, i + 1, i, chain[i + 1]));
+    }
+    fst.SetFinal(chain[5], 0.5);
+    fst.AddArc(6, StdArc(9, 9, 0, 0));
+
+    VectorFst<StdArc> bfs(fst);
+    fstrain::util::ReorderStates(&bfs, fstrain::util::kStateOrderBfs);
+    Test(bfs.NumStates() == 7, "num states");
+    Test(bfs.Start() == 0, "start state first");
+    for (int i = 0; i < 5; ++i) {
+      ArcIterator< VectorFst<StdArc> > aiter(bfs, i);
+      Test(aiter.Value().ilabel == i + 1 && aiter.Value().nextstate == i + 1,
+           "chain in order");
+    }
+    Test(bfs.Final(5) == TropicalWeight(0.5), "final weight");
+    Test(bfs.NumArcs(6) == 1, "unreachable state last");
+    Test(fstrain::util::GetAverageArcJump(bfs) < fstrain::util::GetAverageArcJump(fst),
+         "smaller jumps");
+
+    VectorFst<StdArc> rcm;
+    fstrain::util::ReorderStates(fst, fstrain::util::kStateOrderCuthillMcKee, &rcm);
+    Test(rcm.Start() == 5, "rcm start state last of the reachable ones");
+    Test(fstrain::util::GetAverageArcJump(rcm) < fstrain::util::GetAverageArcJump(fst),
+         "rcm smaller jumps");
+
+    // arcs end up sorted by input label
+    VectorFst<StdArc> fan;
+    fan.AddState();
+    fan.AddState();
+    fan.SetStart(0);
+    fan.AddArc(0, StdArc(3, 3, 0, 1));
+    fan.AddArc(0, StdArc(1, 1, 0, 1));
+    fan.AddArc(0, StdArc(2, 2, 0, 1));
+    fstrain::util::ReorderStates(&fan, fstrain::util::kStateOrderBfs);
+    Test(fan.Properties(kILabelSorted, true) & kILabelSorted, "arcs sorted");
+  }
+  catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+// Compares util::ComposeString and util::ComposeWithString to
+// generic composition with the flat-line FSTs, on random models.
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "fst/fst.h"
+#include "fst/compose.h"
+#include "fst/connect.h"
+#include "fst/vector-fst.h"
+#include "fstrain/train/test/random-fsts.h"
+#include "fstrain/util/string-compose.h"
+
+using namespace fst;
+using namespace fstrain::train::test;
+
+void GetLinearFst(const std::vector<LogArc::Label>& labels,
+                  MutableFst<LogArc>* ofst) {
+  LogArc::StateId prev = ofst->AddState();
+  ofst->SetStart(prev);
+  for (std::size_t i = 0; i < labels.size(); ++i) {
+    LogArc::StateId next = ofst->AddState();
+    ofst->AddArc(prev, LogArc(labels[i], labels[i], LogWeight::One(), next));
+    prev = next;
+  }
+  ofst->SetFinal(prev, LogWeight::One());
+}
+
+int main(int argc, char** argv) {
+  try {
+    srand(7);
+    int num_failed = 0;
+    for (int t = 0; t < 200; ++t) {
+      VectorFst<LogArc> model;
+      GetRandomModel(2 + rand() % 6, &model);
+      std::vector<LogArc::Label> str;
+      const int len = rand() % 4;
+      for (int i = 0; i < len; ++i) {
+        str.push_back(1 + rand() % 2);
+      }
+      VectorFst<LogArc> str_fst;
+      GetLinearFst(str, &str_fst);
+
+      fstrain::util::LabelIndexedFst<LogArc> index(model);
+      VectorFst<LogArc> result1, expected1;
+      fstrain::util::ComposeString(str, index, &result1);
+      Compose(str_fst, model, &expected1);
+
+      VectorFst<LogArc> result2, expected2;
+      fstrain::util::ComposeWithString(model, str, &result2);
+      Compose(model, str_fst, &expected2);
+
+      if (!Same(GetPathsum(result1), GetPathsum(expected1))
+          || !Same(GetPathsum(result2), GetPathsum(expected2))) {
+        std::cerr << "Mismatch in test " << t << std::endl;
+        ++num_failed;
+      }
+
+      // no dead states, as with Compose
+      VectorFst<LogArc> trimmed1(result1), trimmed2(result2);
+      Connect(&trimmed1);
+      Connect(&trimmed2);
+      if (trimmed1.NumStates() != result1.NumStates()
+          || trimmed2.NumStates() != result2.NumStates()) {
+        std::cerr << "Not trimmed in test " << t << std::endl;
+        ++num_failed;
+      }
+    }
+    if (num_failed > 0) {
+      std::cerr << num_failed << " tests failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cerr << "OK" << std::endl;
+  }
+  catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
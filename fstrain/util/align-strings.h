@@ -30,6 +30,7 @@
 #include "fst/symbol-table.h"
 #include "fst/vector-fst.h"
 #include "fst/mutable-fst.h"
+#include "fstrain/util/linear-fst.h"
 #include "fstrain/util/string-to-fst.h"
 #include "fstrain/util/print-path.h"
 
@@ -92,34 +93,34 @@ void AlignStrings(const util::Data& data,
   print_arc_fct.separator = opts.separator;
   ArcSortFst<Arc, ILabelCompare<Arc> > sorted_fst(fst, ILabelCompare<Arc>());
 
+  std::vector<typename Arc::Label> in_labels;
+  std::vector<typename Arc::Label> out_labels;
   for (int i = 0; i < data.size(); ++i) {
     const std::pair<std::string, std::string>& d = data[i];
-    MutableFst<Arc>* in_fst = new VectorFst<Arc>();
-    util::ConvertStringToFst(d.first, isymbols, in_fst);
-    MutableFst<Arc>* out_fst = new VectorFst<Arc>();
-    util::ConvertStringToFst(d.second, osymbols, out_fst);
+    util::ConvertStringToLabels(d.first, isymbols, &in_labels);
+    util::ConvertStringToLabels(d.second, osymbols, &out_labels);
+    const util::LinearFst<Arc> in_fst(in_labels);
+    const util::LinearFst<Arc> out_fst(out_labels);
 
     typedef SigmaMatcher<Matcher< Fst<Arc> > > SM;
 
     ComposeFstOptions<Arc, SM> copts1;
     copts1.gc_limit = 0;
-    copts1.matcher1 = new SM(*in_fst, MATCH_NONE);
+    copts1.matcher1 = new SM(in_fst, MATCH_NONE);
     copts1.matcher2 = new SM(sorted_fst, MATCH_INPUT, opts.sigma_label);
-    ComposeFst<Arc> composed1(*in_fst, sorted_fst, copts1);
+    ComposeFst<Arc> composed1(in_fst, sorted_fst, copts1);
     ArcSortFst<Arc, OLabelCompare<Arc> > sorted1(composed1, OLabelCompare<Arc>());
 
     ComposeFstOptions<Arc, SM> copts2;
     copts2.gc_limit = 0;
     copts2.matcher1 = new SM(sorted1, MATCH_OUTPUT, opts.sigma_label);
-    copts2.matcher2 = new SM(*out_fst, MATCH_NONE);
-    ComposeFst<Arc> composed2(sorted1, *out_fst, copts2);
+    copts2.matcher2 = new SM(out_fst, MATCH_NONE);
+    ComposeFst<Arc> composed2(sorted1, out_fst, copts2);
 
     typedef WeightConvertMapper<Arc, StdArc> Map_AS;
     MapFst<Arc, StdArc, Map_AS> mapped(composed2, Map_AS());
     VectorFst<StdArc> best_path;
     ShortestPath(mapped, &best_path, opts.n_best_alignments);
-    delete in_fst;
-    delete out_fst;
     if (best_path.Start() == fst::kNoStateId || best_path.NumStates() == 0) {
       std::cerr << "Cannot align example: " << d.first << " / " << d.second
                 << std::endl;
@@ -21,6 +21,7 @@
 #include "fst/map.h"
 #include "fstrain/util/debug.h"
 #include "fstrain/util/options.h"
+#include "fstrain/util/trace.h"
 
 namespace fstrain { namespace util {
 
@@ -216,6 +217,7 @@ bool CheckConvergence(
     const Fst<Arc>& fst,
     const CheckConvergenceOptions& opts = CheckConvergenceOptions()) {
 
+  FSTR_TRACE_SPAN("check_convergence");
   using namespace nsCheckConvergenceUtil;
   typedef typename Arc::Weight Weight;
   typedef typename Arc::StateId StateId;
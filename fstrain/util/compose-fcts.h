@@ -21,10 +21,64 @@
 #include "fst/arcsort.h"
 #include "fst/matcher.h"
 #include <boost/shared_ptr.hpp>
+#include "fstrain/core/op-counters.h"
 #include "fstrain/util/print-fst.h"
 
 namespace fstrain { namespace util {
 
+/**
+ * @brief Matcher that forwards to M and counts the Find calls (see
+ * core/op-counters.h).
+ */
+template<class M>
+class CountingMatcher {
+ public:
+  typedef typename M::FST FST;
+  typedef typename M::Arc Arc;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Label Label;
+
+  CountingMatcher(const FST& fst, fst::MatchType match_type)
+      : matcher_(fst, match_type) {}
+
+  CountingMatcher(const FST& fst, fst::MatchType match_type, Label phi_label)
+      : matcher_(fst, match_type, phi_label) {}
+
+  CountingMatcher(const CountingMatcher<M>& other)
+      : matcher_(other.matcher_) {}
+
+  CountingMatcher<M>* Copy(bool safe = false) const {
+    assert(!safe);
+    return new CountingMatcher<M>(*this);
+  }
+
+  fst::MatchType Type(bool test) const { return matcher_.Type(test); }
+
+  const FST& GetFst() const { return matcher_.GetFst(); }
+
+  uint64 Properties(uint64 props) const { return matcher_.Properties(props); }
+
+  uint32 Flags() const { return matcher_.Flags(); }
+
+  void SetState(StateId s) { matcher_.SetState(s); }
+
+  bool Find(Label label) {
+    FSTR_COUNT_OP(core::kOpMatcherFind);
+    return matcher_.Find(label);
+  }
+
+  bool Done() const { return matcher_.Done(); }
+
+  const Arc& Value() const { return matcher_.Value(); }
+
+  void Next() { matcher_.Next(); }
+
+ private:
+  M matcher_;
+
+  void operator=(const CountingMatcher<M>&);  // disallow
+};
+
 template<class Arc>
 struct ComposeFct {
   virtual ~ComposeFct() {}
@@ -39,7 +93,13 @@ template<class Arc>
 struct DefaultComposeFct : public ComposeFct<Arc> {
   void operator()(const fst::Fst<Arc>& fst1, const fst::Fst<Arc>& fst2,
                   fst::MutableFst<Arc>* result) {
-    fst::Compose(fst1, fst2, result);
+    FSTR_COUNT_PHASE(core::kPhaseCompose);
+    // same as fst::Compose, but with counting matchers
+    typedef CountingMatcher< fst::Matcher< fst::Fst<Arc> > > CM;
+    fst::ComposeFstOptions<Arc, CM> opts;
+    opts.gc_limit = 0;
+    *result = fst::ComposeFst<Arc>(fst1, fst2, opts);
+    fst::Connect(result);
   }
 };
 
@@ -53,9 +113,10 @@ struct ComposePhiLeftFct : public ComposeFct<Arc> {
   void operator()(const fst::Fst<Arc>& fst1, const fst::Fst<Arc>& fst2,
                   fst::MutableFst<Arc>* result) {
     using namespace fst;
+    FSTR_COUNT_PHASE(core::kPhaseCompose);
     ArcSortFst<Arc, OLabelCompare<Arc> > fst1_sorted(fst1, OLabelCompare<Arc>());
     typedef Fst<Arc> FST;
-    typedef PhiMatcher< SortedMatcher<FST> > SM;
+    typedef CountingMatcher< PhiMatcher< SortedMatcher<FST> > > SM;
     ComposeFstOptions<Arc, SM> opts;
     opts.gc_limit = 0;
     opts.matcher1 = new SM(fst1_sorted, MATCH_OUTPUT, phi_label_);
@@ -76,9 +137,10 @@ struct ComposePhiRightFct : public ComposeFct<Arc> {
   void operator()(const fst::Fst<Arc>& fst1, const fst::Fst<Arc>& fst2,
                   fst::MutableFst<Arc>* result) {
     using namespace fst;
+    FSTR_COUNT_PHASE(core::kPhaseCompose);
     ArcSortFst<Arc, ILabelCompare<Arc> > fst2_sorted(fst2, ILabelCompare<Arc>());
     typedef Fst<Arc> FST;
-    typedef PhiMatcher< SortedMatcher<FST> > SM;
+    typedef CountingMatcher< PhiMatcher< SortedMatcher<FST> > > SM;
     ComposeFstOptions<Arc, SM> opts;
     opts.gc_limit = 0;
     opts.matcher1 = new SM(fst1, MATCH_NONE);
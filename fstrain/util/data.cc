@@ -18,24 +18,44 @@
 #include <vector>
 #include "fstrain/util/trim.h"
 #include "fstrain/util/data.h"
+#include "fstrain/util/string-to-fst.h"
 
 namespace fstrain { namespace util {
 
-void Data::init_from_stream(std::istream& in) {
+namespace {
+
+/**
+ * @brief Reads the next input/output pair (two non-empty lines);
+ * returns false at the end of the stream.
+ */
+bool ReadPair(std::istream& in, std::string* input, std::string* output) {
   while (!in.eof()) {
-    std::string input;
-    std::string output;
-    std::getline(in, input);
-    std::getline(in, output);
-    if (input.length() && output.length()) {
-      input = trim(input);
-      output = trim(output);
-      data_.push_back(std::make_pair(input, output));
+    std::getline(in, *input);
+    std::getline(in, *output);
+    if (input->length() && output->length()) {
+      *input = trim(*input);
+      *output = trim(*output);
+      return true;
     }
   }
+  return false;
+}
+
+} // end namespace
+
+void Data::init_from_stream(std::istream& in) {
+  std::string input;
+  std::string output;
+  while (ReadPair(in, &input, &output)) {
+    data_.push_back(std::make_pair(input, output));
+  }
 }
 
 void Data::init(const char* filename) {
+  if (EncodedData::IsEncodedFile(filename)) {
+    encoded_.reset(new EncodedData(filename));
+    return;
+  }
   std::ifstream strm(filename);
   if (!strm.is_open()) {
     throw std::runtime_error("Could not open data file '" + std::string(filename) + "'");
@@ -47,5 +67,53 @@ void Data::push_back(const std::string& in, const std::string& out) {
   data_.push_back(std::make_pair(in, out));
 }
 
+void Data::clear() {
+  data_.clear();
+  encoded_.reset();
+}
+
+DataReader::DataReader(const std::string& filename)
+    : filename_(filename), in_(filename.c_str()) {
+  if (!in_.is_open()) {
+    throw std::runtime_error("Could not open data file '" + filename + "'");
+  }
+  if (EncodedData::IsEncodedFile(filename)) {
+    throw std::runtime_error("Data file '" + filename + "' is encoded; need text data");
+  }
+}
+
+bool DataReader::ReadChunk(std::size_t max_pairs, Data* chunk) {
+  chunk->clear();
+  std::string input;
+  std::string output;
+  while (chunk->size() < max_pairs && ReadPair(in_, &input, &output)) {
+    chunk->push_back(input, output);
+  }
+  return chunk->size() > 0;
+}
+
+void DataReader::Rewind() {
+  in_.clear();
+  in_.seekg(0, std::ios::beg);
+}
+
+void Data::GetLabels(size_type index,
+                     const fst::SymbolTable& isymbols,
+                     const fst::SymbolTable& osymbols,
+                     std::vector<int>* input, std::vector<int>* output) const {
+  if (encoded_) {
+    const int32* begin;
+    const int32* end;
+    encoded_->GetInput(index, &begin, &end);
+    input->assign(begin, end);
+    encoded_->GetOutput(index, &begin, &end);
+    output->assign(begin, end);
+  }
+  else {
+    ConvertStringToLabels(data_[index].first, isymbols, input);
+    ConvertStringToLabels(data_[index].second, osymbols, output);
+  }
+}
+
 
 } } // end namespace fstrain::util
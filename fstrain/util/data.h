@@ -23,18 +23,31 @@
 #ifndef FSTRAIN_UTIL_DATA_H_
 #define FSTRAIN_UTIL_DATA_H_
 
+#include <fstream>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 #include <string>
+#include <boost/shared_ptr.hpp>
+#include "fst/symbol-table.h"
+#include "fstrain/util/encoded-data.h"
 
 namespace fstrain { namespace util {
 
+  /**
+   * Data is read from a text file (input and output strings on
+   * alternating lines) or from a binary file written by
+   * fstrain-encode-data (see EncodedData). Encoded data only supports
+   * size(), GetLabels() and CheckSymbols(); the string accessors
+   * (begin(), end(), operator[]) throw on it.
+   */
   class Data {
 
   private:
 
     typedef std::vector< std::pair<std::string,std::string> > Container;
     Container data_;
+    boost::shared_ptr<const EncodedData> encoded_;
 
     void init(const char* filename);
     void init_from_stream(std::istream& in);
@@ -59,23 +72,88 @@ namespace fstrain { namespace util {
     }
 
     const_iterator begin () const {
+      CheckNotEncoded();
       return data_.begin();
     }
 
     const_iterator end () const {
+      CheckNotEncoded();
       return data_.end();
     }
 
     void push_back(const std::string& in, const std::string& out);
 
+    void clear();
+
     size_type size() const {
-      return data_.size();
+      return encoded_ ? encoded_->size() : data_.size();
+    }
+
+    bool IsEncoded() const {
+      return encoded_.get() != NULL;
+    }
+
+    /**
+     * @brief The input and output labels of an example; text data is
+     * converted with the symbol tables (which throws on unknown
+     * tokens), encoded data is copied.
+     */
+    void GetLabels(size_type index,
+                   const fst::SymbolTable& isymbols,
+                   const fst::SymbolTable& osymbols,
+                   std::vector<int>* input, std::vector<int>* output) const;
+
+    /**
+     * @brief Throws if encoded data was encoded with different symbol
+     * tables.
+     */
+    void CheckSymbols(const fst::SymbolTable& isymbols,
+                      const fst::SymbolTable& osymbols) const {
+      if (encoded_) {
+        encoded_->CheckSymbols(isymbols, osymbols);
+      }
     }
 
     const std::pair<std::string, std::string>& operator[](int index) const {
+      CheckNotEncoded();
       return data_[index];
     }
 
+  private:
+
+    void CheckNotEncoded() const {
+      if (encoded_) {
+        throw std::runtime_error("Encoded data has no strings; use GetLabels");
+      }
+    }
+
+  };
+
+  /**
+   * @brief Reads a text data file in chunks, so that a large corpus
+   * never has to be in memory as a whole.
+   */
+  class DataReader {
+
+  public:
+
+    explicit DataReader(const std::string& filename);
+
+    /**
+     * @brief Replaces the contents of chunk with the next (up to)
+     * max_pairs pairs; returns false if there were none left.
+     */
+    bool ReadChunk(std::size_t max_pairs, Data* chunk);
+
+    /**
+     * @brief Starts reading from the beginning of the file again.
+     */
+    void Rewind();
+
+  private:
+    std::string filename_;
+    std::ifstream in_;
+
   };
 
 } } // end namespaces
@@ -0,0 +1,156 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "fstrain/util/data.h"
+#include "fstrain/util/debug.h"
+#include "fstrain/util/encoded-data.h"
+#include "fstrain/util/string-to-fst.h"
+
+namespace fstrain { namespace util {
+
+namespace {
+
+const char kMagic[8] = {'F', 'S', 'T', 'R', 'D', 'A', 'T', '1'};
+const std::size_t kHeaderSize = sizeof(kMagic) + 4 * sizeof(uint64);
+
+void FnvAdd(const std::string& str, uint64* hash) {
+  for (std::size_t i = 0; i < str.length(); ++i) {
+    *hash ^= static_cast<unsigned char>(str[i]);
+    *hash *= 1099511628211ULL;
+  }
+}
+
+} // end namespace
+
+uint64 EncodedData::GetFingerprint(const fst::SymbolTable& symbols) {
+  uint64 hash = 14695981039346656037ULL;
+  for (fst::SymbolTableIterator it(symbols); !it.Done(); it.Next()) {
+    std::stringstream ss;
+    ss << it.Value() << "\t" << it.Symbol() << "\n";
+    FnvAdd(ss.str(), &hash);
+  }
+  return hash;
+}
+
+bool EncodedData::IsEncodedFile(const std::string& filename) {
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  char magic[sizeof(kMagic)];
+  return in.read(magic, sizeof(magic))
+      && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+void EncodedData::Write(const Data& data,
+                        const fst::SymbolTable& isymbols,
+                        const fst::SymbolTable& osymbols,
+                        const std::string& filename) {
+  std::vector<uint64> offsets;
+  std::vector<int32> labels;
+  std::vector<int32> tmp;
+  offsets.push_back(0);
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    ConvertStringToLabels(data[i].first, isymbols, &tmp);
+    labels.insert(labels.end(), tmp.begin(), tmp.end());
+    offsets.push_back(labels.size());
+    ConvertStringToLabels(data[i].second, osymbols, &tmp);
+    labels.insert(labels.end(), tmp.begin(), tmp.end());
+    offsets.push_back(labels.size());
+  }
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out) {
+    FSTR_UTIL_EXCEPTION("Could not write " << filename);
+  }
+  uint64 header[4];
+  header[0] = data.size();
+  header[1] = labels.size();
+  header[2] = GetFingerprint(isymbols);
+  header[3] = GetFingerprint(osymbols);
+  out.write(kMagic, sizeof(kMagic));
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(&offsets[0]), offsets.size() * sizeof(uint64));
+  if (!labels.empty()) {
+    out.write(reinterpret_cast<const char*>(&labels[0]), labels.size() * sizeof(int32));
+  }
+  if (!out) {
+    FSTR_UTIL_EXCEPTION("Could not write " << filename);
+  }
+}
+
+EncodedData::EncodedData(const std::string& filename)
+    : filename_(filename), mapped_(MAP_FAILED), mapped_size_(0) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    FSTR_UTIL_EXCEPTION("Could not open data file '" << filename << "'");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < kHeaderSize) {
+    close(fd);
+    FSTR_UTIL_EXCEPTION("Bad encoded data file '" << filename << "'");
+  }
+  mapped_size_ = st.st_size;
+  mapped_ = mmap(NULL, mapped_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped_ == MAP_FAILED) {
+    FSTR_UTIL_EXCEPTION("Could not map data file '" << filename << "'");
+  }
+  const char* bytes = static_cast<const char*>(mapped_);
+  const uint64* header = reinterpret_cast<const uint64*>(bytes + sizeof(kMagic));
+  num_examples_ = header[0];
+  const uint64 num_labels = header[1];
+  isymbols_fingerprint_ = header[2];
+  osymbols_fingerprint_ = header[3];
+  offsets_ = header + 4;
+  labels_ = reinterpret_cast<const int32*>(offsets_ + 2 * num_examples_ + 1);
+  // (the counts are checked against the file size first, so that the
+  // expected size cannot overflow)
+  bool ok = memcmp(bytes, kMagic, sizeof(kMagic)) == 0
+      && num_examples_ <= mapped_size_ / (2 * sizeof(uint64))
+      && num_labels <= mapped_size_ / sizeof(int32)
+      && kHeaderSize + (2 * num_examples_ + 1) * sizeof(uint64)
+         + num_labels * sizeof(int32) == mapped_size_;
+  // GetLabels reads labels_[offsets_[k] .. offsets_[k + 1])
+  for (uint64 k = 0; ok && k <= 2 * num_examples_; ++k) {
+    ok = (k == 0 ? offsets_[k] == 0 : offsets_[k] >= offsets_[k - 1])
+        && offsets_[k] <= num_labels;
+  }
+  ok = ok && offsets_[2 * num_examples_] == num_labels;
+  if (!ok) {
+    munmap(mapped_, mapped_size_);
+    FSTR_UTIL_EXCEPTION("Bad encoded data file '" << filename << "'");
+  }
+}
+
+EncodedData::~EncodedData() {
+  munmap(mapped_, mapped_size_);
+}
+
+void EncodedData::CheckSymbols(const fst::SymbolTable& isymbols,
+                               const fst::SymbolTable& osymbols) const {
+  if (GetFingerprint(isymbols) != isymbols_fingerprint_
+      || GetFingerprint(osymbols) != osymbols_fingerprint_) {
+    FSTR_UTIL_EXCEPTION("Data file '" << filename_
+                        << "' was encoded with different symbol tables");
+  }
+}
+
+} } // end namespace fstrain::util
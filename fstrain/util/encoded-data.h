@@ -0,0 +1,114 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_ENCODED_DATA_H
+#define FSTRAIN_UTIL_ENCODED_DATA_H
+
+#include <cstddef>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include "fst/compat.h"
+#include "fst/symbol-table.h"
+
+namespace fstrain { namespace util {
+
+class Data;
+
+/**
+ * @brief A corpus of input/output pairs stored as symbol IDs, in one
+ * binary file that is memory-mapped (read-only and shared, so several
+ * processes training on the same file share the page cache).
+ *
+ * File layout (native byte order):
+ *   char   magic[8]             "FSTRDAT1"
+ *   uint64 num_examples
+ *   uint64 num_labels
+ *   uint64 isymbols_fingerprint
+ *   uint64 osymbols_fingerprint
+ *   uint64 offsets[2 * num_examples + 1]
+ *   int32  labels[num_labels]
+ *
+ * The input of example i is labels[offsets[2i] .. offsets[2i+1]), the
+ * output labels[offsets[2i+1] .. offsets[2i+2]).
+ */
+class EncodedData : private boost::noncopyable {
+
+ public:
+
+  explicit EncodedData(const std::string& filename);
+
+  ~EncodedData();
+
+  std::size_t size() const {
+    return num_examples_;
+  }
+
+  /**
+   * @brief The input labels of example i, in [*begin, *end).
+   */
+  void GetInput(std::size_t i, const int32** begin, const int32** end) const {
+    *begin = labels_ + offsets_[2 * i];
+    *end = labels_ + offsets_[2 * i + 1];
+  }
+
+  /**
+   * @brief The output labels of example i, in [*begin, *end).
+   */
+  void GetOutput(std::size_t i, const int32** begin, const int32** end) const {
+    *begin = labels_ + offsets_[2 * i + 1];
+    *end = labels_ + offsets_[2 * i + 2];
+  }
+
+  /**
+   * @brief Throws if the data was encoded with different symbol
+   * tables.
+   */
+  void CheckSymbols(const fst::SymbolTable& isymbols,
+                    const fst::SymbolTable& osymbols) const;
+
+  /**
+   * @brief Encodes the data and writes it to filename; throws if a
+   * token is not in the symbol tables.
+   */
+  static void Write(const Data& data,
+                    const fst::SymbolTable& isymbols,
+                    const fst::SymbolTable& osymbols,
+                    const std::string& filename);
+
+  /**
+   * @brief Does the file start with the magic string?
+   */
+  static bool IsEncodedFile(const std::string& filename);
+
+  /**
+   * @brief Hash of all (ID, symbol) pairs of a symbol table.
+   */
+  static uint64 GetFingerprint(const fst::SymbolTable& symbols);
+
+ private:
+  std::string filename_;
+  void* mapped_;
+  std::size_t mapped_size_;
+  uint64 num_examples_;
+  uint64 isymbols_fingerprint_;
+  uint64 osymbols_fingerprint_;
+  const uint64* offsets_;
+  const int32* labels_;
+};
+
+} } // end namespaces
+
+#endif
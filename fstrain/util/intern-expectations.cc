@@ -0,0 +1,88 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#include "fstrain/util/intern-expectations.h"
+
+#include <tr1/unordered_set>
+#include <boost/functional/hash.hpp>
+
+namespace fstrain { namespace util {
+
+namespace {
+
+typedef fst::MDExpectationArc::Weight Weight;
+typedef Weight::MDExpectations MDExpectations;
+
+// hash and equality of the expectations only (not the weight value)
+struct ExpectationsHash {
+  std::size_t operator()(const Weight& w) const {
+    std::size_t seed = 0;
+    const MDExpectations& e = w.GetMDExpectations();
+    for (MDExpectations::const_iterator it = e.begin(); it != e.end(); ++it) {
+      boost::hash_combine(seed, it->first);
+      boost::hash_combine(seed, it->second.lx());
+      boost::hash_combine(seed, it->second.sign_x());
+    }
+    return seed;
+  }
+};
+
+struct ExpectationsEqual {
+  bool operator()(const Weight& w1, const Weight& w2) const {
+    const MDExpectations& e1 = w1.GetMDExpectations();
+    const MDExpectations& e2 = w2.GetMDExpectations();
+    if (e1.size() != e2.size()) {
+      return false;
+    }
+    for (MDExpectations::const_iterator it1 = e1.begin(), it2 = e2.begin();
+         it1 != e1.end(); ++it1, ++it2) {
+      if (it1->first != it2->first || it1->second != it2->second) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+} // end namespace
+
+std::size_t InternExpectations(fst::MutableFst<fst::MDExpectationArc>* fst) {
+  using namespace fst;
+  typedef MDExpectationArc::StateId StateId;
+  std::tr1::unordered_set<Weight, ExpectationsHash, ExpectationsEqual> canonical;
+  for (StateIterator< MutableFst<MDExpectationArc> > siter(*fst); !siter.Done(); siter.Next()) {
+    StateId s = siter.Value();
+    for (MutableArcIterator< MutableFst<MDExpectationArc> > aiter(fst, s);
+         !aiter.Done(); aiter.Next()) {
+      const MDExpectationArc& arc = aiter.Value();
+      if (arc.weight.GetMDExpectationsId() == NULL) {
+        continue;
+      }
+      std::pair<std::tr1::unordered_set<Weight, ExpectationsHash, ExpectationsEqual>::iterator, bool>
+          inserted = canonical.insert(arc.weight);
+      if (!inserted.second) {
+        inserted.first->GetMDExpectationsId()->setInterned();
+      }
+      if (!inserted.second
+          && inserted.first->GetMDExpectationsId() != arc.weight.GetMDExpectationsId()) {
+        MDExpectationArc shared_arc = arc;
+        shared_arc.weight.ShareMDExpectations(*inserted.first);
+        aiter.SetValue(shared_arc);
+      }
+    }
+  }
+  return canonical.size();
+}
+
+} } // end namespace fstrain::util
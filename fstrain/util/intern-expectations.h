@@ -0,0 +1,38 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_INTERN_EXPECTATIONS_H
+#define FSTRAIN_UTIL_INTERN_EXPECTATIONS_H
+
+#include <cstddef>
+#include "fst/mutable-fst.h"
+#include "fstrain/core/expectation-arc.h"
+
+namespace fstrain { namespace util {
+
+/**
+ * @brief Lets all arcs with equal feature expectations share one
+ * MDExpectations object, e.g. the backoff arcs and phi-expanded copies
+ * of a model that fire the same features. Since the expectations are
+ * copy-on-write the FST behaves the same. The shared ones are marked
+ * (MDExpectations::isInterned), so that SetFeatureWeights keeps the
+ * sharing.
+ *
+ * @return The number of distinct expectation sets on the arcs.
+ */
+std::size_t InternExpectations(fst::MutableFst<fst::MDExpectationArc>* fst);
+
+} } // end namespace fstrain::util
+
+#endif
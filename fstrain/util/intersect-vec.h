@@ -15,13 +15,27 @@
 #ifndef FSTR_UTIL_INTERSECT_VEC_H
 #define FSTR_UTIL_INTERSECT_VEC_H
 
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <limits>
+#include <string>
+#include <utility>
 #include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "fst/arcsort.h"
+#include "fst/determinize.h"
 #include "fst/intersect.h"
 #include "fst/minimize.h"
 #include "fst/mutable-fst.h"
 #include "fst/rmepsilon.h"
 #include "fst/vector-fst.h"
-#include "fstrain/util/determinize-in-place.h"
+#include "fstrain/util/debug.h"
+#include "fstrain/util/memory-info.h"
+#include "fstrain/util/timer.h"
 
 namespace fstrain { namespace util {
 
@@ -30,18 +44,114 @@ void MyIntersect(const fst::Fst<Arc>& ifst1,
                  const fst::Fst<Arc>& ifst2,
                  fst::MutableFst<Arc>* ofst,
                  bool do_determinize) {
-  fst::Intersect(ifst1, ifst2, ofst);
-  if (do_determinize) {
-    fst::RmEpsilon(ofst);
-    fstrain::util::Determinize(ofst);
-    fst::Minimize(ofst);
+  if (!do_determinize) {
+    fst::Intersect(ifst1, ifst2, ofst);
+    return;
+  }
+  // determinizes straight into ofst, without the extra copy that
+  // util::Determinize makes
+  fst::VectorFst<Arc> tmp;
+  fst::Intersect(ifst1, ifst2, &tmp);
+  fst::RmEpsilon(&tmp);
+  fst::Determinize(tmp, ofst);
+  fst::Minimize(ofst);
+}
+
+struct IntersectVecOptions {
+  bool determinize;  // RmEpsilon, Determinize, Minimize each result
+  int num_threads;   // independent pairs are intersected in parallel
+  bool lazy;         // intermediate results stay delayed FSTs
+  std::size_t cache_gc_limit; // cache size of each delayed FST (bytes)
+  IntersectVecOptions(bool determinize_ = true, int num_threads_ = 1,
+                      bool lazy_ = false,
+                      std::size_t cache_gc_limit_ = 1 << 24)
+      : determinize(determinize_), num_threads(num_threads_),
+        lazy(lazy_), cache_gc_limit(cache_gc_limit_) {}
+};
+
+namespace nsIntersectVecUtil {
+
+/**
+ * @brief Estimated size (states + arcs) of an FST, used to intersect
+ * small FSTs first. Delayed FSTs are not expanded for that; they
+ * count as largest.
+ */
+template<class Arc>
+double EstimateSize(const fst::Fst<Arc>& f) {
+  if (!f.Properties(fst::kExpanded, false)) {
+    return std::numeric_limits<double>::max();
+  }
+  double size = 0.0;
+  for (fst::StateIterator< fst::Fst<Arc> > siter(f); !siter.Done(); siter.Next()) {
+    size += 1 + f.NumArcs(siter.Value());
   }
+  return size;
 }
 
+template<class Arc>
+struct Operand {
+  const fst::Fst<Arc>* fst;
+  bool owned;  // intermediate result
+  double size;
+  bool operator<(const Operand& other) const {
+    return size < other.size;
+  }
+};
+
+template<class Arc>
+struct IntersectPairs_Fct {
+  typedef std::pair<Operand<Arc>, Operand<Arc> > Pair;
+  const std::vector<Pair>* pairs;
+  std::vector<fst::VectorFst<Arc>*>* results;
+  std::size_t first;
+  std::size_t step;
+  bool determinize;
+  std::string* error;
+  void operator()() {
+    typedef fst::ArcSortFst<Arc, fst::OLabelCompare<Arc> > MyArcSortFst;
+    try {
+      for (std::size_t i = first; i < pairs->size(); i += step) {
+        const Pair& p = (*pairs)[i];
+        (*results)[i] = new fst::VectorFst<Arc>();
+        MyIntersect(MyArcSortFst(*p.first.fst, fst::OLabelCompare<Arc>()),
+                    *p.second.fst, (*results)[i], determinize);
+      }
+    }
+    catch (std::exception& e) {
+      *error = e.what();
+    }
+  }
+};
+
+template<class Arc>
+void DeleteOwned(const Operand<Arc>& op) {
+  if (op.owned) {
+    delete op.fst;
+  }
+}
+
+} // end namespace nsIntersectVecUtil
+
+/**
+ * @brief Intersects all FSTs in ifsts.
+ *
+ * The operands are combined in a balanced tree: in each round the
+ * FSTs are sorted by estimated size and the two smallest, the next
+ * two, etc. are intersected, so intermediate results stay small.
+ * The pairs of a round are independent and are intersected in
+ * parallel (see IntersectVecOptions::num_threads). With the lazy
+ * option, the tree is built from delayed IntersectFsts with bounded
+ * caches and only the final result is expanded; in that case
+ * determinize has no effect. Reports time and the highest memory
+ * use seen between rounds.
+ */
 template<class Arc>
 void Intersect_vec(const std::vector<fst::Fst<Arc>*>& ifsts,
                    fst::MutableFst<Arc>* ofst,
-                   bool determinizeIntermediate = true) {
+                   const IntersectVecOptions& opts) {
+  using namespace nsIntersectVecUtil;
+  typedef fst::ArcSortFst<Arc, fst::OLabelCompare<Arc> > MyArcSortFst;
+  typedef std::pair<Operand<Arc>, Operand<Arc> > Pair;
   if (ifsts.size() == 0) {
     return;
   }
@@ -49,15 +159,114 @@ void Intersect_vec(const std::vector<fst::Fst<Arc>*>& ifsts,
     *ofst = *(ifsts[0]);
     return;
   }
-  typedef fst::ArcSortFst<Arc, fst::OLabelCompare<Arc> > MyArcSortFst;
-  MyIntersect(MyArcSortFst(*ifsts[0], fst::OLabelCompare<Arc>()),
-              *ifsts[1],
-              ofst,
-              determinizeIntermediate);
-  for (int i = 2; i < ifsts.size(); ++i) {
-    MyArcSortFst ofst_sorted(*ofst, fst::OLabelCompare<Arc>());
-    MyIntersect(ofst_sorted, *ifsts[i], ofst, determinizeIntermediate);
+  Timer timer;
+  double peak_mb = MemoryInfo::instance().getSizeInMB();
+  std::vector<Operand<Arc> > ops;
+  for (std::size_t i = 0; i < ifsts.size(); ++i) {
+    Operand<Arc> op;
+    op.fst = ifsts[i];
+    op.owned = false;
+    op.size = EstimateSize(*ifsts[i]);
+    ops.push_back(op);
   }
+  int num_rounds = 0;
+  while (ops.size() > 1) {
+    std::stable_sort(ops.begin(), ops.end());
+    std::vector<Pair> pairs;
+    std::vector<Operand<Arc> > next;
+    for (std::size_t i = 0; i + 1 < ops.size(); i += 2) {
+      pairs.push_back(std::make_pair(ops[i], ops[i + 1]));
+    }
+    if (ops.size() % 2 == 1) {
+      next.push_back(ops.back());
+    }
+    if (opts.lazy) {
+      fst::CacheOptions cache_opts(true, opts.cache_gc_limit);
+      for (std::size_t i = 0; i < pairs.size(); ++i) {
+        Operand<Arc> op;
+        // the delayed FSTs keep copies of their inputs, so the
+        // operands can be deleted right away
+        op.fst = new fst::IntersectFst<Arc>(
+            MyArcSortFst(*pairs[i].first.fst, fst::OLabelCompare<Arc>()),
+            *pairs[i].second.fst, cache_opts);
+        op.owned = true;
+        op.size = pairs[i].first.size + pairs[i].second.size;
+        next.push_back(op);
+        DeleteOwned(pairs[i].first);
+        DeleteOwned(pairs[i].second);
+      }
+    }
+    else {
+      std::vector<fst::VectorFst<Arc>*> results(pairs.size(), NULL);
+      const int num_threads =
+          std::max(1, std::min(opts.num_threads, static_cast<int>(pairs.size())));
+      std::vector<std::string> errors(num_threads);
+      std::vector<IntersectPairs_Fct<Arc> > fcts(num_threads);
+      for (int t = 0; t < num_threads; ++t) {
+        fcts[t].pairs = &pairs;
+        fcts[t].results = &results;
+        fcts[t].first = t;
+        fcts[t].step = num_threads;
+        fcts[t].determinize = opts.determinize;
+        fcts[t].error = &errors[t];
+      }
+      if (num_threads == 1) {
+        fcts[0]();
+      }
+      else {
+        std::vector<boost::shared_ptr<boost::thread> > threads;
+        for (int t = 0; t < num_threads; ++t) {
+          threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(fcts[t])));
+        }
+        for (std::size_t t = 0; t < threads.size(); ++t) {
+          threads[t]->join();
+        }
+      }
+      peak_mb = std::max(peak_mb, MemoryInfo::instance().getSizeInMB());
+      for (std::size_t i = 0; i < pairs.size(); ++i) {
+        DeleteOwned(pairs[i].first);
+        DeleteOwned(pairs[i].second);
+      }
+      std::string error;
+      for (int t = 0; t < num_threads; ++t) {
+        if (!errors[t].empty()) {
+          error = errors[t];
+        }
+      }
+      if (!error.empty()) {
+        for (std::size_t i = 0; i < results.size(); ++i) {
+          delete results[i];
+        }
+        for (std::size_t i = 0; i < next.size(); ++i) {
+          DeleteOwned(next[i]);
+        }
+        FSTR_UTIL_EXCEPTION("Intersection failed: " << error);
+      }
+      for (std::size_t i = 0; i < results.size(); ++i) {
+        Operand<Arc> op;
+        op.fst = results[i];
+        op.owned = true;
+        op.size = EstimateSize(*results[i]);
+        next.push_back(op);
+      }
+    }
+    ops.swap(next);
+    ++num_rounds;
+  }
+  *ofst = *ops[0].fst;
+  DeleteOwned(ops[0]);
+  peak_mb = std::max(peak_mb, MemoryInfo::instance().getSizeInMB());
+  timer.stop();
+  fprintf(stderr, "# Intersected %d FSTs in %d rounds (%d threads%s) [%2.2f ms, peak %2.2f MB]\n",
+          static_cast<int>(ifsts.size()), num_rounds, opts.num_threads,
+          opts.lazy ? ", lazy" : "", timer.get_elapsed_time_millis(), peak_mb);
+}
+
+template<class Arc>
+void Intersect_vec(const std::vector<fst::Fst<Arc>*>& ifsts,
+                   fst::MutableFst<Arc>* ofst,
+                   bool determinizeIntermediate = true) {
+  Intersect_vec(ifsts, ofst, IntersectVecOptions(determinizeIntermediate));
 }
 
 } } // end namespaces
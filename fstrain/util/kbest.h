@@ -24,10 +24,12 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
-#include <tr1/unordered_map>
+#include <string>
 
-#include "fst/shortest-path.h"
 #include "fst/fst.h"
+#include "fst/project.h"
+#include "fst/symbol-table.h"
+#include "fstrain/util/map-string-decoder.h"
 
 namespace fstrain { namespace util {
 
@@ -42,9 +44,6 @@ class KbestStrings {
 
   typedef std::pair<std::string, double> KbestEntry;
   typedef std::vector<KbestEntry> Container;
-  typedef std::tr1::unordered_map<std::string, fst::LogWeight> KbestMap;
-  typedef typename A::StateId StateId;
-  typedef typename A::Weight Weight;
 
  public:
 
@@ -78,46 +77,26 @@ class KbestStrings {
 
  private:
 
-  void ExpandState(const fst::Fst<A>& f,
-                   const fst::SymbolTable& symbols,
-                   StateId s,
-                   std::string path,
-                   Weight w,
-                   KbestMap* the_map) {
-    for (fst::ArcIterator<fst::Fst<A> > aiter(f, s); !aiter.Done(); aiter.Next()) {
-      const A& a = aiter.Value();
-      const std::string expanded_path = path +
-          (a.ilabel > 0
-           ? ((path.length() ? " " : "") + symbols.Find(a.ilabel))
-           : "");
-      ExpandState(f, symbols, a.nextstate, expanded_path, fst::Times(w, a.weight),
-                  the_map);
-    }
-    if (f.Final(s) != Weight::Zero()) {
-      // kbest_entries_.push_back(std::make_pair(path, w.Value()));
-      KbestMap::iterator found = the_map->find(path);
-      const bool did_find = found != the_map->end();
-      if (did_find) {
-        found->second = fst::Plus(found->second, fst::LogWeight(w.Value()));
-      }
-      else {
-        the_map->insert(std::make_pair(path, fst::LogWeight(w.Value())));
-      }
-    }
-  }
-
+  /**
+   * @brief The kMax most probable unique input strings, with the
+   * probability summed over all their paths (see MapStringDecoder).
+   */
   void Init(const fst::Fst<A>& f, const fst::SymbolTable& symbols, unsigned kMax) {
-    fst::VectorFst<A> kbestFst;
-    const bool unique = false; // true not implemented by OpenFst
-    fst::ShortestPath(f, &kbestFst, kMax, unique);
-    std::string emptyPath = "";
-    Weight zero = Weight::One();
-    KbestMap the_map;
-    ExpandState(kbestFst, symbols, kbestFst.Start(), emptyPath, zero, &the_map);
-    for (KbestMap::const_iterator it = the_map.begin(); it != the_map.end(); ++it) {
-      kbest_entries_.push_back(std::make_pair(it->first, it->second.Value()));
+    fst::ProjectFst<A> input_side(f, fst::PROJECT_INPUT);
+    MapStringDecoderOptions opts;
+    opts.nbest = kMax;
+    std::vector<DecodedString<typename A::Label> > best;
+    DecodeMapStrings(input_side, opts, &best);
+    for (std::size_t i = 0; i < best.size(); ++i) {
+      std::string path;
+      for (std::size_t j = 0; j < best[i].labels.size(); ++j) {
+        if (j > 0) {
+          path += " ";
+        }
+        path += symbols.Find(best[i].labels[j]);
+      }
+      kbest_entries_.push_back(std::make_pair(path, best[i].neglogprob));
     }
-    std::sort(kbest_entries_.begin(), kbest_entries_.end(), SmallerValuePred);
   }
 
   Container kbest_entries_;
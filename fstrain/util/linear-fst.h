@@ -0,0 +1,273 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_LINEAR_FST_H
+#define FSTRAIN_UTIL_LINEAR_FST_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "fst/expanded-fst.h"
+#include "fst/fst.h"
+#include "fst/properties.h"
+#include "fst/symbol-table.h"
+
+namespace fstrain { namespace util {
+
+template<class A> class LinearFstArcIterator;
+
+/**
+ * @brief Read-only flat-line acceptor over a borrowed label array
+ * (the machine ConvertStringToFst builds): state i has one arc
+ * labeled labels[i] to state i+1, the last state is final, and all
+ * weights are One.
+ *
+ * Nothing is stored per state, so the FST costs nothing to build; the
+ * labels must outlive it. The properties are all known (acceptor,
+ * acyclic, string, sorted), which lets composition pick its fast
+ * paths.
+ */
+template<class A>
+class LinearFst : public fst::ExpandedFst<A> {
+
+ public:
+  typedef A Arc;
+  typedef typename A::Label Label;
+  typedef typename A::StateId StateId;
+  typedef typename A::Weight Weight;
+
+  LinearFst(const Label* begin, const Label* end,
+            const fst::SymbolTable* isymbols = NULL,
+            const fst::SymbolTable* osymbols = NULL)
+      : labels_(begin), num_labels_(end - begin),
+        isymbols_(isymbols), osymbols_(osymbols),
+        properties_(ComputeProperties()) {}
+
+  explicit LinearFst(const std::vector<Label>& labels,
+                     const fst::SymbolTable* isymbols = NULL,
+                     const fst::SymbolTable* osymbols = NULL)
+      : labels_(labels.empty() ? NULL : &labels[0]), num_labels_(labels.size()),
+        isymbols_(isymbols), osymbols_(osymbols),
+        properties_(ComputeProperties()) {}
+
+  StateId Start() const {
+    return 0;
+  }
+
+  Weight Final(StateId s) const {
+    return s == (StateId)num_labels_ ? Weight::One() : Weight::Zero();
+  }
+
+  StateId NumStates() const {
+    return num_labels_ + 1;
+  }
+
+  size_t NumArcs(StateId s) const {
+    return s < (StateId)num_labels_ ? 1 : 0;
+  }
+
+  size_t NumInputEpsilons(StateId s) const {
+    return s < (StateId)num_labels_ && labels_[s] == 0 ? 1 : 0;
+  }
+
+  size_t NumOutputEpsilons(StateId s) const {
+    return NumInputEpsilons(s);
+  }
+
+  uint64 Properties(uint64 mask, bool test) const {
+    return properties_ & mask;
+  }
+
+  const std::string& Type() const {
+    static const std::string type = "linear";
+    return type;
+  }
+
+  LinearFst<A>* Copy(bool safe = false) const {
+    return new LinearFst<A>(*this);
+  }
+
+  const fst::SymbolTable* InputSymbols() const {
+    return isymbols_;
+  }
+
+  const fst::SymbolTable* OutputSymbols() const {
+    return osymbols_;
+  }
+
+  /**
+   * @brief The arc leaving state s (s < NumStates() - 1).
+   */
+  A GetArc(StateId s) const {
+    return A(labels_[s], labels_[s], Weight::One(), s + 1);
+  }
+
+  void InitStateIterator(fst::StateIteratorData<A>* data) const {
+    data->base = NULL;
+    data->nstates = NumStates();
+  }
+
+  void InitArcIterator(StateId s, fst::ArcIteratorData<A>* data) const {
+    data->base = new LinearFstArcIterator<A>(*this, s);
+  }
+
+ private:
+
+  uint64 ComputeProperties() const {
+    using namespace fst;
+    uint64 props = kExpanded | kAcceptor | kIDeterministic | kODeterministic
+        | kILabelSorted | kOLabelSorted | kUnweighted | kAcyclic
+        | kInitialAcyclic | kTopSorted | kAccessible | kCoAccessible | kString;
+    bool has_epsilons = false;
+    for (std::size_t i = 0; i < num_labels_; ++i) {
+      if (labels_[i] == 0) {
+        has_epsilons = true;
+        break;
+      }
+    }
+    return props | (has_epsilons
+                    ? kEpsilons | kIEpsilons | kOEpsilons
+                    : kNoEpsilons | kNoIEpsilons | kNoOEpsilons);
+  }
+
+  const Label* labels_;
+  std::size_t num_labels_;
+  const fst::SymbolTable* isymbols_;
+  const fst::SymbolTable* osymbols_;
+  uint64 properties_;
+};
+
+} } // end namespaces
+
+namespace fst {
+
+/**
+ * @brief Arc iterator for code that knows the FST is a LinearFst; it
+ * needs no allocation (unlike the generic ArcIterator< Fst<A> >).
+ */
+template<class A>
+class ArcIterator< fstrain::util::LinearFst<A> > {
+
+ public:
+  typedef typename A::StateId StateId;
+
+  ArcIterator(const fstrain::util::LinearFst<A>& fst, StateId s)
+      : arc_(fst.NumArcs(s) > 0 ? fst.GetArc(s) : A(0, 0, A::Weight::Zero(), kNoStateId)),
+        num_arcs_(fst.NumArcs(s)), pos_(0) {}
+
+  bool Done() const {
+    return pos_ >= num_arcs_;
+  }
+
+  const A& Value() const {
+    return arc_;
+  }
+
+  void Next() {
+    ++pos_;
+  }
+
+  size_t Position() const {
+    return pos_;
+  }
+
+  void Reset() {
+    pos_ = 0;
+  }
+
+  void Seek(size_t a) {
+    pos_ = a;
+  }
+
+ private:
+  A arc_;
+  size_t num_arcs_;
+  size_t pos_;
+};
+
+template<class A>
+class StateIterator< fstrain::util::LinearFst<A> > {
+
+ public:
+  typedef typename A::StateId StateId;
+
+  explicit StateIterator(const fstrain::util::LinearFst<A>& fst)
+      : num_states_(fst.NumStates()), s_(0) {}
+
+  bool Done() const {
+    return s_ >= num_states_;
+  }
+
+  StateId Value() const {
+    return s_;
+  }
+
+  void Next() {
+    ++s_;
+  }
+
+  void Reset() {
+    s_ = 0;
+  }
+
+ private:
+  StateId num_states_;
+  StateId s_;
+};
+
+} // end namespace fst
+
+namespace fstrain { namespace util {
+
+/**
+ * @brief Arc iterator behind the generic Fst interface.
+ */
+template<class A>
+class LinearFstArcIterator : public fst::ArcIteratorBase<A> {
+
+ public:
+  LinearFstArcIterator(const LinearFst<A>& fst, typename A::StateId s)
+      : it_(fst, s) {}
+
+  bool Done() const {
+    return it_.Done();
+  }
+
+  const A& Value() const {
+    return it_.Value();
+  }
+
+  void Next() {
+    it_.Next();
+  }
+
+  size_t Position() const {
+    return it_.Position();
+  }
+
+  void Reset() {
+    it_.Reset();
+  }
+
+  void Seek(size_t a) {
+    it_.Seek(a);
+  }
+
+ private:
+  fst::ArcIterator< LinearFst<A> > it_;
+};
+
+} } // end namespaces
+
+#endif
@@ -0,0 +1,412 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_MAP_STRING_DECODER_H
+#define FSTRAIN_UTIL_MAP_STRING_DECODER_H
+
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <map>
+#include <queue>
+#include <vector>
+
+#include "fst/fst.h"
+#include "fst/shortest-distance.h"
+#include "fst/vector-fst.h"
+#include "fstrain/util/debug.h"
+
+namespace fstrain { namespace util {
+
+struct MapStringDecoderOptions {
+  std::size_t nbest;          // number of unique strings to return
+  std::size_t max_queue_size; // beam width; 0 means unlimited
+  double beam;                // drop prefixes this much worse than the best
+  long timelimit_ms;          // -1 means no time limit
+  float delta;                // convergence of epsilon closures
+  MapStringDecoderOptions()
+      : nbest(1), max_queue_size(0),
+        beam(std::numeric_limits<double>::infinity()),
+        timelimit_ms(-1), delta(fst::kDelta) {}
+};
+
+/**
+ * @brief An output string and its negative log probability, summed
+ * over all paths that produce it.
+ */
+template<class Label>
+struct DecodedString {
+  std::vector<Label> labels;
+  double neglogprob;
+};
+
+namespace nsMapStringDecoderUtil {
+
+// -log(exp(-a) + exp(-b))
+inline double NeglogPlus(double a, double b) {
+  if (a == std::numeric_limits<double>::infinity()) {
+    return b;
+  }
+  if (b == std::numeric_limits<double>::infinity()) {
+    return a;
+  }
+  return std::min(a, b) - log1p(exp(-std::fabs(a - b)));
+}
+
+inline long GetTimeMillis() {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec * 1000 + t.tv_usec / 1000;
+}
+
+} // end namespace nsMapStringDecoderUtil
+
+/**
+ * @brief Finds the output strings with the highest probability, where
+ * the probability of a string is the sum over all its paths (i.e.,
+ * MAP decoding in the log semiring, not the best path).
+ *
+ * The input is an acceptor (e.g. the output projection of input o
+ * model) with weights -log p; label 0 is epsilon. The search is
+ * best-first over output prefixes. A prefix stands for the
+ * determinized state reached by reading it: the set of lattice
+ * states with their forward weights. Its priority is the total weight
+ * of all paths that start with it, using backward distances in the
+ * log semiring, which never underestimates the probability of any
+ * completion; a string's exact probability is pushed as a separate
+ * entry when its prefix is expanded. Strings therefore come out in
+ * order of probability, and each string at most once.
+ *
+ * The beam options and the time limit make the search approximate;
+ * the return value tells whether the result is exact. On timeout the
+ * best complete strings seen so far are returned.
+ */
+template<class Arc>
+class MapStringDecoder {
+
+ public:
+
+  typedef typename Arc::Label Label;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  typedef DecodedString<Label> Result;
+
+  MapStringDecoder(const fst::Fst<Arc>& lattice,
+                   const MapStringDecoderOptions& opts)
+      : lattice_(lattice), opts_(opts) {
+    ComputeBackwardDistances();
+  }
+
+  /**
+   * @brief -log of the sum over all paths of the lattice; normalizes
+   * the string probabilities to posteriors.
+   */
+  double GetTotalWeight() const {
+    return lattice_.Start() == fst::kNoStateId
+        ? std::numeric_limits<double>::infinity() : Beta(lattice_.Start());
+  }
+
+  /**
+   * @brief Puts the n best unique strings into result (best first);
+   * returns false if the search was cut by the beam or time limit.
+   */
+  bool Decode(std::vector<Result>* result) {
+    using namespace nsMapStringDecoderUtil;
+    const double kInf = std::numeric_limits<double>::infinity();
+    result->clear();
+    nodes_.clear();
+    const long start_time = GetTimeMillis();
+    bool exact = true;
+    std::priority_queue<Item> queue;
+    if (lattice_.Start() == fst::kNoStateId) {
+      return true;
+    }
+    Subset start;
+    start[lattice_.Start()] = 0.0;
+    EpsilonClosure(&start);
+    PushPrefix(-1, 0, start, &queue);
+    double best_key = kInf;
+    std::vector<Result> fallback; // complete strings seen, for timeout
+    while (!queue.empty() && result->size() < opts_.nbest) {
+      if (opts_.timelimit_ms != -1
+          && GetTimeMillis() - start_time >= opts_.timelimit_ms) {
+        exact = false;
+        break;
+      }
+      const Item item = queue.top();
+      queue.pop();
+      if (item.is_final) {
+        result->push_back(GetResult(item.node, item.key));
+        continue;
+      }
+      best_key = std::min(best_key, item.key);
+      if (item.key > best_key + opts_.beam) {
+        exact = false;
+        continue;
+      }
+      const Subset& subset = subsets_[item.subset];
+      // the prefix itself as a complete string
+      double final_weight = kInf;
+      for (typename Subset::const_iterator it = subset.begin(); it != subset.end(); ++it) {
+        const double rho = lattice_.Final(it->first).Value();
+        if (rho != kInf) {
+          final_weight = NeglogPlus(final_weight, it->second + rho);
+        }
+      }
+      if (final_weight != kInf) {
+        Item final_item;
+        final_item.key = final_weight;
+        final_item.node = item.node;
+        final_item.subset = -1;
+        final_item.is_final = true;
+        queue.push(final_item);
+        fallback.push_back(GetResult(item.node, final_weight));
+      }
+      // the prefix extended by one label
+      std::map<Label, Subset> next;
+      for (typename Subset::const_iterator it = subset.begin(); it != subset.end(); ++it) {
+        for (fst::ArcIterator< fst::Fst<Arc> > aiter(lattice_, it->first);
+             !aiter.Done(); aiter.Next()) {
+          const Arc& arc = aiter.Value();
+          if (arc.olabel == 0) {
+            continue;
+          }
+          Subset& n = next[arc.olabel];
+          typename Subset::iterator found = n.find(arc.nextstate);
+          const double w = it->second + arc.weight.Value();
+          if (found == n.end()) {
+            n[arc.nextstate] = w;
+          }
+          else {
+            found->second = NeglogPlus(found->second, w);
+          }
+        }
+      }
+      subsets_[item.subset].clear(); // not needed any more
+      for (typename std::map<Label, Subset>::iterator it = next.begin();
+           it != next.end(); ++it) {
+        EpsilonClosure(&it->second);
+        PushPrefix(item.node, it->first, it->second, &queue);
+      }
+      if (opts_.max_queue_size > 0 && queue.size() > opts_.max_queue_size) {
+        exact = false;
+        PruneQueue(&queue);
+      }
+    }
+    if (!exact && result->size() < opts_.nbest) {
+      AddFallback(&fallback, result);
+    }
+    subsets_.clear();
+    return exact;
+  }
+
+ private:
+
+  typedef std::map<StateId, double> Subset; // state -> forward weight
+
+  struct Node {
+    int parent;
+    Label label;
+  };
+
+  struct Item {
+    double key;
+    int node;
+    int subset; // index into subsets_, -1 for complete strings
+    bool is_final;
+    bool operator<(const Item& other) const {
+      return key > other.key; // smallest key on top
+    }
+  };
+
+  void ComputeBackwardDistances() {
+    fst::VectorFst<fst::LogArc> log_lattice;
+    for (fst::StateIterator< fst::Fst<Arc> > siter(lattice_); !siter.Done(); siter.Next()) {
+      const StateId s = siter.Value();
+      while (log_lattice.NumStates() <= s) {
+        log_lattice.AddState();
+      }
+      log_lattice.SetFinal(s, fst::LogWeight(lattice_.Final(s).Value()));
+      for (fst::ArcIterator< fst::Fst<Arc> > aiter(lattice_, s);
+           !aiter.Done(); aiter.Next()) {
+        const Arc& arc = aiter.Value();
+        while (log_lattice.NumStates() <= arc.nextstate) {
+          log_lattice.AddState();
+        }
+        log_lattice.AddArc(s, fst::LogArc(arc.ilabel, arc.olabel,
+                                          fst::LogWeight(arc.weight.Value()),
+                                          arc.nextstate));
+      }
+    }
+    std::vector<fst::LogWeight> beta;
+    fst::ShortestDistance(log_lattice, &beta, true, opts_.delta);
+    beta_.resize(beta.size());
+    for (std::size_t i = 0; i < beta.size(); ++i) {
+      beta_[i] = beta[i].Value();
+    }
+  }
+
+  double Beta(StateId s) const {
+    return s < static_cast<StateId>(beta_.size())
+        ? beta_[s] : std::numeric_limits<double>::infinity();
+  }
+
+  /**
+   * @brief Adds everything reachable over epsilon arcs; cycles are
+   * followed until the weights change by less than delta.
+   */
+  void EpsilonClosure(Subset* subset) {
+    using namespace nsMapStringDecoderUtil;
+    std::deque<StateId> agenda;
+    Subset residual = *subset; // weight not yet propagated
+    for (typename Subset::const_iterator it = subset->begin(); it != subset->end(); ++it) {
+      agenda.push_back(it->first);
+    }
+    while (!agenda.empty()) {
+      const StateId s = agenda.front();
+      agenda.pop_front();
+      const double r = residual[s];
+      residual[s] = std::numeric_limits<double>::infinity();
+      for (fst::ArcIterator< fst::Fst<Arc> > aiter(lattice_, s);
+           !aiter.Done(); aiter.Next()) {
+        const Arc& arc = aiter.Value();
+        if (arc.olabel != 0) {
+          continue;
+        }
+        const double w = r + arc.weight.Value();
+        typename Subset::iterator found = subset->find(arc.nextstate);
+        const double old = found == subset->end()
+            ? std::numeric_limits<double>::infinity() : found->second;
+        const double sum = NeglogPlus(old, w);
+        (*subset)[arc.nextstate] = sum;
+        if (old == std::numeric_limits<double>::infinity()
+            || old - sum > opts_.delta) {
+          typename Subset::iterator res = residual.find(arc.nextstate);
+          if (res == residual.end()
+              || res->second == std::numeric_limits<double>::infinity()) {
+            residual[arc.nextstate] = w;
+            agenda.push_back(arc.nextstate);
+          }
+          else {
+            res->second = NeglogPlus(res->second, w);
+          }
+        }
+      }
+    }
+  }
+
+  void PushPrefix(int parent, Label label, const Subset& subset,
+                  std::priority_queue<Item>* queue) {
+    using namespace nsMapStringDecoderUtil;
+    double key = std::numeric_limits<double>::infinity();
+    for (typename Subset::const_iterator it = subset.begin(); it != subset.end(); ++it) {
+      key = NeglogPlus(key, it->second + Beta(it->first));
+    }
+    if (key == std::numeric_limits<double>::infinity()) {
+      return; // dead end
+    }
+    Node node;
+    node.parent = parent;
+    node.label = label;
+    nodes_.push_back(node);
+    subsets_.push_back(subset);
+    Item item;
+    item.key = key;
+    item.node = nodes_.size() - 1;
+    item.subset = subsets_.size() - 1;
+    item.is_final = false;
+    queue->push(item);
+  }
+
+  void PruneQueue(std::priority_queue<Item>* queue) {
+    std::priority_queue<Item> pruned;
+    while (pruned.size() < opts_.max_queue_size && !queue->empty()) {
+      pruned.push(queue->top());
+      queue->pop();
+    }
+    while (!queue->empty()) {
+      if (queue->top().subset >= 0) {
+        subsets_[queue->top().subset].clear();
+      }
+      queue->pop();
+    }
+    queue->swap(pruned);
+  }
+
+  Result GetResult(int node, double neglogprob) const {
+    Result r;
+    r.neglogprob = neglogprob;
+    for (int n = node; n > 0; n = nodes_[n].parent) {
+      r.labels.push_back(nodes_[n].label);
+    }
+    std::reverse(r.labels.begin(), r.labels.end());
+    return r;
+  }
+
+  static bool ResultLess(const Result& a, const Result& b) {
+    return a.neglogprob < b.neglogprob;
+  }
+
+  // Fills result up with the best complete strings seen.
+  void AddFallback(std::vector<Result>* fallback,
+                   std::vector<Result>* result) const {
+    std::stable_sort(fallback->begin(), fallback->end(), ResultLess);
+    for (std::size_t i = 0; i < fallback->size()
+             && result->size() < opts_.nbest; ++i) {
+      bool seen = false;
+      for (std::size_t j = 0; j < result->size(); ++j) {
+        if ((*result)[j].labels == (*fallback)[i].labels) {
+          seen = true;
+          break;
+        }
+      }
+      if (!seen) {
+        result->push_back((*fallback)[i]);
+      }
+    }
+  }
+
+  const fst::Fst<Arc>& lattice_;
+  const MapStringDecoderOptions& opts_;
+  std::vector<double> beta_;
+  std::vector<Node> nodes_;
+  std::deque<Subset> subsets_;
+
+};
+
+/**
+ * @brief Convenience function, see MapStringDecoder. The lattice is
+ * expanded first, since the search visits states many times. If
+ * total_weight is given, it is set to the -log path sum of the
+ * lattice.
+ */
+template<class Arc>
+bool DecodeMapStrings(const fst::Fst<Arc>& lattice,
+                      const MapStringDecoderOptions& opts,
+                      std::vector<DecodedString<typename Arc::Label> >* result,
+                      double* total_weight = NULL) {
+  fst::VectorFst<Arc> expanded(lattice);
+  MapStringDecoder<Arc> decoder(expanded, opts);
+  if (total_weight != NULL) {
+    *total_weight = decoder.GetTotalWeight();
+  }
+  return decoder.Decode(result);
+}
+
+} } // end namespaces
+
+#endif
@@ -0,0 +1,171 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#include "fstrain/util/memory-governor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include "fstrain/util/memory-info.h"
+#include "fstrain/util/options.h"
+
+namespace fstrain { namespace util {
+
+namespace {
+
+const char* GetPressureName(MemoryPressure pressure) {
+  static const char* names[] = {"low", "high", "critical"};
+  return names[pressure];
+}
+
+double GetOption(const std::string& name, double default_value) {
+  return options.has(name) ? options.get<double>(name) : default_value;
+}
+
+} // end namespace
+
+MemoryGovernor& MemoryGovernor::instance() {
+  static MemoryGovernor the_instance;
+  return the_instance;
+}
+
+std::size_t MemoryGovernor::GetBudget() const {
+  return static_cast<std::size_t>(GetOption("memory-limit-bytes", 0.0));
+}
+
+void MemoryGovernor::SetPoolSize(const std::string& pool, std::size_t bytes) {
+  boost::mutex::scoped_lock lock(mutex_);
+  pools_[pool] = bytes;
+}
+
+MemoryPressure MemoryGovernor::GetPressure() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return GetPressureLocked();
+}
+
+MemoryPressure MemoryGovernor::GetPressureLocked() {
+  const std::size_t budget = GetBudget();
+  if (budget == 0) {
+    return kMemoryPressureLow;
+  }
+  used_ = MemoryInfo::instance().getSizeUnchecked();
+  MemoryPressure pressure = kMemoryPressureLow;
+  if (used_ > GetOption("memory-critical-fraction", 0.95) * budget) {
+    pressure = kMemoryPressureCritical;
+  }
+  else if (used_ > GetOption("memory-high-fraction", 0.8) * budget) {
+    pressure = kMemoryPressureHigh;
+  }
+  if (pressure != pressure_) {
+    pressure_ = pressure;
+    LogDecision("governor", std::string("memory pressure ") + GetPressureName(pressure));
+  }
+  return pressure;
+}
+
+int MemoryGovernor::GetNumThreads(const std::string& who, int requested,
+                                  std::size_t bytes_per_thread) {
+  boost::mutex::scoped_lock lock(mutex_);
+  const MemoryPressure pressure = GetPressureLocked();
+  if (GetBudget() == 0 || requested <= 1) {
+    return requested;
+  }
+  int result = requested;
+  if (pressure == kMemoryPressureCritical) {
+    result = 1;
+  }
+  else {
+    if (pressure == kMemoryPressureHigh) {
+      result = std::max(1, requested / 2);
+    }
+    if (bytes_per_thread > 0) {
+      const std::size_t budget = GetBudget();
+      const std::size_t free = budget > used_ ? budget - used_ : 0;
+      result = std::min<std::size_t>(result, std::max<std::size_t>(1, free / bytes_per_thread));
+    }
+  }
+  if (result != requested) {
+    std::stringstream ss;
+    ss << "running " << result << " instead of " << requested << " threads";
+    if (bytes_per_thread > 0) {
+      ss << " (" << bytes_per_thread / 1048576.0 << " MB each)";
+    }
+    LogDecision(who, ss.str());
+  }
+  return result;
+}
+
+std::size_t MemoryGovernor::GetCacheLimit(const std::string& who, std::size_t requested) {
+  boost::mutex::scoped_lock lock(mutex_);
+  const MemoryPressure pressure = GetPressureLocked();
+  std::size_t result = requested;
+  if (pressure == kMemoryPressureCritical) {
+    result = 0;
+  }
+  else if (pressure == kMemoryPressureHigh) {
+    result = requested / 4;
+  }
+  if (result != requested) {
+    std::stringstream ss;
+    ss << "shrinking cache from " << requested / 1048576.0 << " MB to "
+       << result / 1048576.0 << " MB";
+    LogDecision(who, ss.str());
+  }
+  return result;
+}
+
+bool MemoryGovernor::UseLazy(const std::string& who, bool requested) {
+  boost::mutex::scoped_lock lock(mutex_);
+  const MemoryPressure pressure = GetPressureLocked();
+  if (!requested && pressure != kMemoryPressureLow) {
+    LogDecision(who, "keeping results delayed instead of expanding them");
+    return true;
+  }
+  return requested;
+}
+
+std::size_t MemoryGovernor::GetChunkSize(const std::string& who, std::size_t requested) {
+  boost::mutex::scoped_lock lock(mutex_);
+  const MemoryPressure pressure = GetPressureLocked();
+  std::size_t result = requested;
+  if (pressure == kMemoryPressureCritical) {
+    result = std::max<std::size_t>(1, requested / 10);
+  }
+  else if (pressure == kMemoryPressureHigh) {
+    result = std::max<std::size_t>(1, requested / 2);
+  }
+  if (result != requested) {
+    std::stringstream ss;
+    ss << "writing to disk every " << result << " instead of " << requested << " items";
+    LogDecision(who, ss.str());
+  }
+  return result;
+}
+
+void MemoryGovernor::LogDecision(const std::string& who, const std::string& decision) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%2.2f MB of %2.2f MB",
+           used_ / 1048576.0, GetBudget() / 1048576.0);
+  std::cerr << "# Memory governor: " << who << ": " << decision << " [" << buf;
+  for (std::map<std::string, std::size_t>::const_iterator it = pools_.begin();
+       it != pools_.end(); ++it) {
+    snprintf(buf, sizeof(buf), ", %s %2.2f MB", it->first.c_str(), it->second / 1048576.0);
+    std::cerr << buf;
+  }
+  std::cerr << "]" << std::endl;
+}
+
+} } // end namespaces
@@ -0,0 +1,113 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_MEMORY_GOVERNOR_H
+#define FSTRAIN_UTIL_MEMORY_GOVERNOR_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace fstrain { namespace util {
+
+enum MemoryPressure {
+  kMemoryPressureLow,
+  kMemoryPressureHigh,     // above option "memory-high-fraction" (default 0.8) of the budget
+  kMemoryPressureCritical  // above "memory-critical-fraction" (default 0.95)
+};
+
+/**
+ * @brief Keeps the process under the memory budget (option
+ * "memory-limit-bytes", see SetMemoryLimitInGb), where MemoryInfo
+ * would otherwise throw and end the run.
+ *
+ * The big consumers report the size of their pools (gradients,
+ * lattices, model index, caches) with SetPoolSize, and ask before
+ * they allocate: how many threads to run, how big a cache to keep,
+ * whether to keep FSTs delayed, how many examples to hold before
+ * the counts go to disk. The answers get smaller as the memory in
+ * use approaches the budget. Every answer that differs from the
+ * request is logged to stderr, with the pool sizes.
+ *
+ * Without a budget all requests are granted.
+ */
+class MemoryGovernor : private boost::noncopyable {
+
+ public:
+  static MemoryGovernor& instance();
+
+  /**
+   * @brief The budget in bytes; 0 if there is none.
+   */
+  std::size_t GetBudget() const;
+
+  /**
+   * @brief Records the current size of a pool (bytes).
+   */
+  void SetPoolSize(const std::string& pool, std::size_t bytes);
+
+  /**
+   * @brief Reads the memory in use and logs changes of the pressure.
+   */
+  MemoryPressure GetPressure();
+
+  /**
+   * @brief The number of threads to run if each needs about
+   * bytes_per_thread: at most as many as fit into the free budget,
+   * half of the requested ones at high pressure, one at critical
+   * pressure.
+   */
+  int GetNumThreads(const std::string& who, int requested,
+                    std::size_t bytes_per_thread = 0);
+
+  /**
+   * @brief Size of a cache (bytes): a quarter of the request at high
+   * pressure, no cache at critical pressure.
+   */
+  std::size_t GetCacheLimit(const std::string& who, std::size_t requested);
+
+  /**
+   * @brief True if results that could stay delayed (lazy composition
+   * or intersection) should not be expanded; false at low pressure
+   * unless requested.
+   */
+  bool UseLazy(const std::string& who, bool requested);
+
+  /**
+   * @brief Number of items to hold in memory before writing them to
+   * disk: half of the request at high pressure, a tenth at critical
+   * pressure.
+   */
+  std::size_t GetChunkSize(const std::string& who, std::size_t requested);
+
+ private:
+  MemoryGovernor() : pressure_(kMemoryPressureLow), used_(0) {}
+
+  MemoryPressure GetPressureLocked();
+
+  // logs with the memory in use, the budget and the pool sizes
+  void LogDecision(const std::string& who, const std::string& decision);
+
+  boost::mutex mutex_;
+  MemoryPressure pressure_;
+  std::size_t used_; // bytes, at the last GetPressure
+  std::map<std::string, std::size_t> pools_;
+};
+
+} } // end namespaces
+
+#endif
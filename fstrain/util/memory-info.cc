@@ -36,14 +36,18 @@ MemoryInfo& MemoryInfo::instance() {
 	return the_instance;
 }
 
-std::size_t MemoryInfo::getSize() {
+std::size_t MemoryInfo::getSizeUnchecked() {
   // unsigned long long memoryUsage;
     memoryFileStream.open(memoryFilename, std::ifstream::in);
     std::string line;
     std::getline(memoryFileStream, line);
     memoryFileStream.close();
     const std::string val0 = getColumn(line, 22); // virtual memory size column
-    std::size_t val = boost::lexical_cast<std::size_t>(val0);
+    return boost::lexical_cast<std::size_t>(val0);
+}
+
+std::size_t MemoryInfo::getSize() {
+    std::size_t val = getSizeUnchecked();
     if (fstrain::util::options.has("memory-limit-bytes")
        && val > fstrain::util::options.get<double>("memory-limit-bytes")) {
       std::cerr << "Error: Memory limit exceeded (" << val << " bytes)" << std::endl;
@@ -43,6 +43,9 @@ public:
     std::size_t getSize();
     double getSizeInMB();
 
+    // like getSize, but does not check the memory limit
+    std::size_t getSizeUnchecked();
+
 private:
 
     char memoryFilename[64];
@@ -15,6 +15,7 @@
 #ifndef UTIL_MISC_H
 #define UTIL_MISC_H
 
+#include <cstddef>
 #include <string>
 #include <set>
 
@@ -51,6 +52,15 @@ bool IsTrie(const fst::Fst<Arc>& fst) {
   return true;
 }
 
+template<class Arc>
+std::size_t CountArcs(const fst::Fst<Arc>& fst) {
+  std::size_t num_arcs = 0;
+  for (fst::StateIterator< fst::Fst<Arc> > sit(fst); !sit.Done(); sit.Next()) {
+    num_arcs += fst.NumArcs(sit.Value());
+  }
+  return num_arcs;
+}
+
 } } // end namespaces
 
 #endif
@@ -0,0 +1,214 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_REORDER_STATES_H
+#define FSTRAIN_UTIL_REORDER_STATES_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fst/arcsort.h"
+#include "fst/fst.h"
+#include "fst/mutable-fst.h"
+#include "fst/vector-fst.h"
+#include "fstrain/util/debug.h"
+
+namespace fstrain { namespace util {
+
+enum StateOrder {
+  kStateOrderNone,
+  kStateOrderBfs,          // breadth-first from the start state
+  kStateOrderCuthillMcKee  // reverse Cuthill-McKee from the start state
+};
+
+/**
+ * @brief Parses "none", "bfs" or "rcm".
+ */
+inline StateOrder ParseStateOrder(const std::string& name) {
+  if (name == "none") {
+    return kStateOrderNone;
+  }
+  if (name == "bfs") {
+    return kStateOrderBfs;
+  }
+  if (name == "rcm") {
+    return kStateOrderCuthillMcKee;
+  }
+  FSTR_UTIL_EXCEPTION("Unknown state order: " << name);
+}
+
+/**
+ * @brief Average distance |s - nextstate| between the states of an
+ * arc; the smaller, the fewer cache misses when following arcs.
+ */
+template<class Arc>
+double GetAverageArcJump(const fst::Fst<Arc>& fst) {
+  typedef typename Arc::StateId StateId;
+  double sum = 0.0;
+  std::size_t num_arcs = 0;
+  for (fst::StateIterator< fst::Fst<Arc> > siter(fst); !siter.Done(); siter.Next()) {
+    const StateId s = siter.Value();
+    for (fst::ArcIterator< fst::Fst<Arc> > aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      sum += std::abs(static_cast<double>(aiter.Value().nextstate - s));
+      ++num_arcs;
+    }
+  }
+  return num_arcs > 0 ? sum / num_arcs : 0.0;
+}
+
+namespace nsReorderStatesUtil {
+
+template<class Arc>
+struct FewerArcs {
+  const fst::Fst<Arc>& fst;
+  explicit FewerArcs(const fst::Fst<Arc>& f) : fst(f) {}
+  bool operator()(typename Arc::StateId a, typename Arc::StateId b) const {
+    return fst.NumArcs(a) < fst.NumArcs(b);
+  }
+};
+
+} // end namespace nsReorderStatesUtil
+
+/**
+ * @brief Computes new state IDs (order[old] = new) that visit the
+ * states breadth-first from the start state, following the arcs in
+ * input label order. Cuthill-McKee visits the successors with fewer
+ * arcs first and reverses the result. States not reachable from the
+ * start state come last, in their old order.
+ */
+template<class Arc>
+void GetStateOrder(const fst::Fst<Arc>& fst, StateOrder how,
+                   std::vector<typename Arc::StateId>* order) {
+  typedef typename Arc::StateId StateId;
+  StateId num_states = 0;
+  for (fst::StateIterator< fst::Fst<Arc> > siter(fst); !siter.Done(); siter.Next()) {
+    ++num_states;
+  }
+  order->assign(num_states, fst::kNoStateId);
+  if (how == kStateOrderNone || fst.Start() == fst::kNoStateId) {
+    for (StateId s = 0; s < num_states; ++s) {
+      (*order)[s] = s;
+    }
+    return;
+  }
+  std::vector<StateId> visited; // in visiting order
+  visited.reserve(num_states);
+  std::vector<Arc> arcs;
+  std::vector<StateId> successors;
+  (*order)[fst.Start()] = 0;
+  visited.push_back(fst.Start());
+  for (std::size_t head = 0; head < visited.size(); ++head) {
+    const StateId s = visited[head];
+    arcs.clear();
+    for (fst::ArcIterator< fst::Fst<Arc> > aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      arcs.push_back(aiter.Value());
+    }
+    std::stable_sort(arcs.begin(), arcs.end(), fst::ILabelCompare<Arc>());
+    successors.clear();
+    for (std::size_t i = 0; i < arcs.size(); ++i) {
+      const StateId t = arcs[i].nextstate;
+      if ((*order)[t] == fst::kNoStateId) {
+        (*order)[t] = 0; // marks t as seen
+        successors.push_back(t);
+      }
+    }
+    if (how == kStateOrderCuthillMcKee) {
+      std::stable_sort(successors.begin(), successors.end(),
+                       nsReorderStatesUtil::FewerArcs<Arc>(fst));
+    }
+    visited.insert(visited.end(), successors.begin(), successors.end());
+  }
+  const StateId num_visited = visited.size();
+  for (StateId i = 0; i < num_visited; ++i) {
+    (*order)[visited[i]] = (how == kStateOrderCuthillMcKee) ? num_visited - 1 - i : i;
+  }
+  StateId next = num_visited;
+  for (StateId s = 0; s < num_states; ++s) {
+    if ((*order)[s] == fst::kNoStateId) {
+      (*order)[s] = next++;
+    }
+  }
+}
+
+/**
+ * @brief Writes fst to result with the states renumbered as computed
+ * by GetStateOrder and the arcs of each state sorted by input
+ * label. The states are added in their new order, so their arc
+ * arrays are allocated one after the other, much like in a ConstFst
+ * (which we cannot use, since training changes the arc weights).
+ */
+template<class Arc>
+void ReorderStates(const fst::Fst<Arc>& fst, StateOrder how,
+                   fst::MutableFst<Arc>* result) {
+  typedef typename Arc::StateId StateId;
+  std::vector<StateId> order;
+  GetStateOrder(fst, how, &order);
+  const StateId num_states = order.size();
+  std::vector<StateId> old_state(num_states);
+  for (StateId s = 0; s < num_states; ++s) {
+    old_state[order[s]] = s;
+  }
+  result->DeleteStates();
+  result->SetInputSymbols(fst.InputSymbols());
+  result->SetOutputSymbols(fst.OutputSymbols());
+  for (StateId s = 0; s < num_states; ++s) {
+    result->AddState();
+  }
+  if (fst.Start() != fst::kNoStateId) {
+    result->SetStart(order[fst.Start()]);
+  }
+  std::vector<Arc> arcs;
+  for (StateId s = 0; s < num_states; ++s) {
+    const StateId old = old_state[s];
+    result->SetFinal(s, fst.Final(old));
+    arcs.clear();
+    for (fst::ArcIterator< fst::Fst<Arc> > aiter(fst, old); !aiter.Done(); aiter.Next()) {
+      arcs.push_back(aiter.Value());
+      arcs.back().nextstate = order[arcs.back().nextstate];
+    }
+    std::stable_sort(arcs.begin(), arcs.end(), fst::ILabelCompare<Arc>());
+    result->ReserveArcs(s, arcs.size());
+    for (std::size_t i = 0; i < arcs.size(); ++i) {
+      result->AddArc(s, arcs[i]);
+    }
+  }
+}
+
+/**
+ * @brief Reorders the states of fst in place (see above) and reports
+ * the average arc jump before and after to stderr.
+ */
+template<class Arc>
+void ReorderStates(fst::MutableFst<Arc>* fst, StateOrder how) {
+  if (how == kStateOrderNone) {
+    return;
+  }
+  const double jump_before = GetAverageArcJump(*fst);
+  {
+    fst::VectorFst<Arc> reordered;
+    ReorderStates(*fst, how, &reordered);
+    *fst = reordered;
+  }
+  std::cerr << "# Reordered states (" << (how == kStateOrderBfs ? "bfs" : "rcm")
+            << "): average arc jump " << jump_before << " -> "
+            << GetAverageArcJump(*fst) << " states" << std::endl;
+}
+
+} } // end namespaces
+
+#endif
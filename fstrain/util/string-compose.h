@@ -0,0 +1,286 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_STRING_COMPOSE_H
+#define FSTRAIN_UTIL_STRING_COMPOSE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <tr1/unordered_map>
+#include <vector>
+
+#include "fst/connect.h"
+#include "fst/fst.h"
+#include "fst/mutable-fst.h"
+#include "fstrain/core/op-counters.h"
+
+namespace fstrain { namespace util {
+
+/**
+ * @brief Read-only copy of a model FST with the arcs of each state
+ * sorted by input label in one flat array, so that the arcs of a
+ * state that read a given label are found by binary search. Used to
+ * compose strings with the model (see ComposeString).
+ *
+ * The copy does not follow changes to the model; call Init() again
+ * after changing its weights. Lookups do not modify the object, so
+ * one index can be shared by several threads.
+ */
+template<class Arc>
+class LabelIndexedFst {
+
+ public:
+  typedef typename Arc::Label Label;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+
+  LabelIndexedFst() : start_(fst::kNoStateId) {}
+
+  explicit LabelIndexedFst(const fst::Fst<Arc>& model)
+      : start_(fst::kNoStateId) {
+    Init(model);
+  }
+
+  /**
+   * @brief (Re-)builds the index from the model.
+   */
+  void Init(const fst::Fst<Arc>& model) {
+    using namespace fst;
+    start_ = model.Start();
+    StateId num_states = 0;
+    for (StateIterator< Fst<Arc> > siter(model); !siter.Done(); siter.Next()) {
+      num_states = std::max(num_states, siter.Value() + 1);
+    }
+    finals_.assign(num_states, Weight::Zero());
+    offsets_.assign(num_states + 1, 0);
+    arcs_.clear();
+    // StateIterator need not go in order, so collect the arcs first
+    std::vector<std::vector<Arc> > state_arcs(num_states);
+    for (StateIterator< Fst<Arc> > siter(model); !siter.Done(); siter.Next()) {
+      const StateId s = siter.Value();
+      finals_[s] = model.Final(s);
+      for (ArcIterator< Fst<Arc> > aiter(model, s); !aiter.Done(); aiter.Next()) {
+        state_arcs[s].push_back(aiter.Value());
+      }
+    }
+    for (StateId s = 0; s < num_states; ++s) {
+      std::stable_sort(state_arcs[s].begin(), state_arcs[s].end(), ILabelLess());
+      offsets_[s] = arcs_.size();
+      arcs_.insert(arcs_.end(), state_arcs[s].begin(), state_arcs[s].end());
+      std::vector<Arc>().swap(state_arcs[s]);
+    }
+    offsets_[num_states] = arcs_.size();
+  }
+
+  /**
+   * @brief Frees the copied arcs; the copies also hold references to
+   * the expectations of the model arcs.
+   */
+  void Clear() {
+    start_ = fst::kNoStateId;
+    std::vector<Weight>().swap(finals_);
+    std::vector<std::size_t>().swap(offsets_);
+    std::vector<Arc>().swap(arcs_);
+  }
+
+  StateId Start() const { return start_; }
+
+  StateId NumStates() const { return finals_.size(); }
+
+  const Weight& Final(StateId s) const { return finals_[s]; }
+
+  std::size_t NumArcs() const { return arcs_.size(); }
+
+  /**
+   * @brief Finds the arcs of state s with the given input label; they
+   * are in [*begin, *end).
+   */
+  void Find(StateId s, Label label,
+            const Arc** begin, const Arc** end) const {
+    FSTR_COUNT_OP(core::kOpMatcherFind);
+    if (arcs_.empty()) {
+      *begin = *end = NULL;
+      return;
+    }
+    const Arc* first = &arcs_[0] + offsets_[s];
+    const Arc* last = &arcs_[0] + offsets_[s + 1];
+    std::pair<const Arc*, const Arc*> range =
+        std::equal_range(first, last, Arc(label, 0, Weight::One(), 0), ILabelLess());
+    *begin = range.first;
+    *end = range.second;
+  }
+
+ private:
+
+  struct ILabelLess {
+    bool operator()(const Arc& a, const Arc& b) const {
+      return a.ilabel < b.ilabel;
+    }
+  };
+
+  StateId start_;
+  std::vector<Weight> finals_;
+  std::vector<std::size_t> offsets_; // arcs of s: arcs_[offsets_[s] .. offsets_[s+1])
+  std::vector<Arc> arcs_;
+};
+
+namespace nsStringComposeUtil {
+
+/**
+ * @brief Maps (string position, other state) pairs to result states.
+ */
+template<class Arc>
+class PairStates {
+
+ public:
+  typedef typename Arc::StateId StateId;
+
+  PairStates(std::size_t num_positions, fst::MutableFst<Arc>* ofst)
+      : state_ids_(num_positions), queues_(num_positions), ofst_(ofst) {}
+
+  /**
+   * @brief Result state for (pos, s); a new state is also queued for
+   * expansion.
+   */
+  StateId Get(std::size_t pos, StateId s) {
+    typename StateMap::const_iterator found = state_ids_[pos].find(s);
+    if (found != state_ids_[pos].end()) {
+      return found->second;
+    }
+    const StateId id = ofst_->AddState();
+    state_ids_[pos][s] = id;
+    queues_[pos].push_back(s);
+    return id;
+  }
+
+  /**
+   * @brief States at pos, in the order they were created; grows while
+   * states at the same position are expanded.
+   */
+  const std::vector<StateId>& Queue(std::size_t pos) const {
+    return queues_[pos];
+  }
+
+  void Clear(std::size_t pos) {
+    StateMap().swap(state_ids_[pos]);
+    std::vector<StateId>().swap(queues_[pos]);
+  }
+
+ private:
+  typedef std::tr1::unordered_map<StateId, StateId> StateMap;
+  std::vector<StateMap> state_ids_;
+  std::vector<std::vector<StateId> > queues_;
+  fst::MutableFst<Arc>* ofst_;
+};
+
+} // end namespace nsStringComposeUtil
+
+/**
+ * @brief ofst = input o model, where input is a string (the linear
+ * chain that ConvertStringToFst would build from it).
+ *
+ * Walks the input positions directly and looks up the matching model
+ * arcs in the index, instead of going through the generic ComposeFst
+ * with its matchers and caches. The result has the same paths and
+ * weights as Compose(input_fst, model), and like Compose it is
+ * trimmed (Connect), so states that cannot reach a final state do
+ * not cost time later.
+ */
+template<class Arc>
+void ComposeString(const std::vector<typename Arc::Label>& input,
+                   const LabelIndexedFst<Arc>& model,
+                   fst::MutableFst<Arc>* ofst) {
+  using namespace fst;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  ofst->DeleteStates();
+  if (model.Start() == kNoStateId) {
+    return;
+  }
+  const std::size_t n = input.size();
+  nsStringComposeUtil::PairStates<Arc> states(n + 1, ofst);
+  ofst->SetStart(states.Get(0, model.Start()));
+  const Arc* begin;
+  const Arc* end;
+  for (std::size_t i = 0; i <= n; ++i) {
+    const std::vector<StateId>& queue = states.Queue(i);
+    for (std::size_t k = 0; k < queue.size(); ++k) {
+      const StateId q = queue[k];
+      const StateId s = states.Get(i, q);
+      // model moves alone
+      model.Find(q, 0, &begin, &end);
+      for (const Arc* a = begin; a != end; ++a) {
+        ofst->AddArc(s, Arc(0, a->olabel, a->weight, states.Get(i, a->nextstate)));
+      }
+      if (i < n) {
+        model.Find(q, input[i], &begin, &end);
+        for (const Arc* a = begin; a != end; ++a) {
+          ofst->AddArc(s, Arc(input[i], a->olabel, a->weight,
+                              states.Get(i + 1, a->nextstate)));
+        }
+      }
+      else if (model.Final(q) != Weight::Zero()) {
+        ofst->SetFinal(s, model.Final(q));
+      }
+    }
+    states.Clear(i);
+  }
+  fst::Connect(ofst);
+}
+
+/**
+ * @brief ofst = ifst o output, where output is a string; the
+ * counterpart of ComposeString for the output side (also trimmed).
+ */
+template<class Arc>
+void ComposeWithString(const fst::Fst<Arc>& ifst,
+                       const std::vector<typename Arc::Label>& output,
+                       fst::MutableFst<Arc>* ofst) {
+  using namespace fst;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  ofst->DeleteStates();
+  if (ifst.Start() == kNoStateId) {
+    return;
+  }
+  const std::size_t m = output.size();
+  nsStringComposeUtil::PairStates<Arc> states(m + 1, ofst);
+  ofst->SetStart(states.Get(0, ifst.Start()));
+  for (std::size_t j = 0; j <= m; ++j) {
+    const std::vector<StateId>& queue = states.Queue(j);
+    for (std::size_t k = 0; k < queue.size(); ++k) {
+      const StateId q = queue[k];
+      const StateId s = states.Get(j, q);
+      for (ArcIterator< Fst<Arc> > aiter(ifst, q); !aiter.Done(); aiter.Next()) {
+        const Arc& a = aiter.Value();
+        if (a.olabel == 0) {
+          ofst->AddArc(s, Arc(a.ilabel, 0, a.weight, states.Get(j, a.nextstate)));
+        }
+        else if (j < m && a.olabel == output[j]) {
+          ofst->AddArc(s, Arc(a.ilabel, a.olabel, a.weight,
+                              states.Get(j + 1, a.nextstate)));
+        }
+      }
+      if (j == m && ifst.Final(q) != Weight::Zero()) {
+        ofst->SetFinal(s, ifst.Final(q));
+      }
+    }
+    states.Clear(j);
+  }
+  fst::Connect(ofst);
+}
+
+} } // end namespaces
+
+#endif
@@ -17,6 +17,7 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 #include "fst/fst.h"
 #include "fst/mutable-fst.h"
 #include "fst/symbol-table.h"
@@ -69,6 +70,32 @@ namespace fstrain { namespace util {
     ConvertStringToFst(str, syms, final_weight, ofst, delete_unknown);
   }
 
+  /**
+   * @brief Converts a string into its sequence of labels, the labels
+   * of the flat-line machine ConvertStringToFst builds (deleted
+   * unknown tokens are left out). See also LinearFst.
+   */
+  template<class Label>
+    void ConvertStringToLabels(const std::string& str, const fst::SymbolTable& syms,
+                               std::vector<Label>* labels, bool delete_unknown = false) {
+    labels->clear();
+    std::stringstream ss(str);
+    std::string token;
+    while (ss >> token) {
+      int64 label = syms.Find(token);
+      if (label == -1) {
+        if (delete_unknown) {
+          std::cerr << "Warning: Removed unknown token '" << token
+                    << "' from " << str << "." << std::endl;
+          continue;
+        }
+        FSTR_UTIL_EXCEPTION("Could not find id for token '" << token
+                            << "' when trying to convert '" <<str << "'");
+      }
+      labels->push_back(static_cast<Label>(label));
+    }
+  }
+
 } } // end namespaces
 
 #endif
@@ -0,0 +1,240 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#include "fstrain/util/trace.h"
+
+#include <unistd.h> // getpid
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+#include <boost/thread/tss.hpp>
+
+#include "fstrain/util/debug.h"
+
+namespace fstrain { namespace util {
+
+namespace {
+
+// cached per thread, so that recording a span needs no lock
+__thread TraceBuffer* tls_buffer = NULL;
+__thread int tls_generation = -1;
+
+// false once the Tracer is destroyed at exit
+bool tracer_alive = true;
+
+// hands the buffer of an exiting thread back to the Tracer
+struct ThreadBufferOwner {
+  TraceBuffer* buffer;
+  int generation;
+  ThreadBufferOwner(TraceBuffer* b, int g) : buffer(b), generation(g) {}
+  ~ThreadBufferOwner() {
+    if (tracer_alive) {
+      Tracer::instance().ReleaseThreadBuffer(buffer, generation);
+    }
+  }
+};
+
+boost::thread_specific_ptr<ThreadBufferOwner> tls_owner;
+
+// parents before their children
+bool BeginsEarlier(const TraceEvent& a, const TraceEvent& b) {
+  if (a.begin_ns != b.begin_ns) {
+    return a.begin_ns < b.begin_ns;
+  }
+  return a.end_ns > b.end_ns;
+}
+
+struct ProfileEntry {
+  uint64 calls;
+  uint64 total_ns;
+  uint64 self_ns;
+  ProfileEntry() : calls(0), total_ns(0), self_ns(0) {}
+};
+
+bool MoreSelfTime(const std::pair<std::string, ProfileEntry>& a,
+                  const std::pair<std::string, ProfileEntry>& b) {
+  return a.second.self_ns > b.second.self_ns;
+}
+
+std::string JsonEscape(const char* str) {
+  std::string result;
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      result += '\\';
+    }
+    result += *str;
+  }
+  return result;
+}
+
+} // end namespace
+
+const std::size_t TraceBuffer::kChunkSize;
+
+void TraceBuffer::GetEvents(std::vector<TraceEvent>* events) const {
+  const std::size_t n = std::min<uint64>(num_added_, capacity_);
+  events->clear();
+  events->reserve(n);
+  for (std::size_t c = 0; c < chunks_.size(); ++c) {
+    const std::size_t m = std::min(kChunkSize, n - c * kChunkSize);
+    events->insert(events->end(), chunks_[c].begin(), chunks_[c].begin() + m);
+  }
+}
+
+Tracer& Tracer::instance() {
+  static Tracer the_instance;
+  return the_instance;
+}
+
+Tracer::~Tracer() {
+  if (running_) {
+    Finish();
+  }
+  tracer_alive = false;
+}
+
+void Tracer::Start(const std::string& filename, std::size_t events_per_thread) {
+#ifndef FSTRAIN_TRACE
+  std::cerr << "# Warning: built without FSTRAIN_TRACE, the trace will be empty"
+            << std::endl;
+#endif
+  boost::mutex::scoped_lock lock(mutex_);
+  filename_ = filename;
+  events_per_thread_ = events_per_thread;
+  buffers_.clear();
+  free_buffers_.clear();
+  ++generation_;
+  start_ns_ = GetMonotonicNanos();
+  running_ = true;
+}
+
+void Tracer::Finish() {
+  running_ = false;
+  std::ofstream out(filename_.c_str());
+  if (!out) {
+    FSTR_UTIL_EXCEPTION("Could not write trace to " << filename_);
+  }
+  WriteChromeTrace(out);
+  std::cerr << "# Wrote trace to " << filename_ << std::endl;
+  WriteFlatProfile(std::cerr);
+}
+
+TraceBuffer* Tracer::GetThreadBuffer() {
+  if (tls_generation != generation_) {
+    TraceBuffer* buffer;
+    int generation;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (!free_buffers_.empty()) {
+        buffer = free_buffers_.back();
+        free_buffers_.pop_back();
+      }
+      else {
+        buffers_.push_back(boost::shared_ptr<TraceBuffer>(
+            new TraceBuffer(buffers_.size(), events_per_thread_)));
+        buffer = buffers_.back().get();
+      }
+      generation = generation_;
+    }
+    // outside the lock: releases the buffer of an earlier generation
+    tls_owner.reset(new ThreadBufferOwner(buffer, generation));
+    tls_buffer = buffer;
+    tls_generation = generation;
+  }
+  return tls_buffer;
+}
+
+void Tracer::ReleaseThreadBuffer(TraceBuffer* buffer, int generation) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (generation == generation_) {
+    free_buffers_.push_back(buffer);
+  }
+}
+
+void Tracer::WriteChromeTrace(std::ostream& out) const {
+  const int pid = getpid();
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  bool first = true;
+  std::vector<TraceEvent> events;
+  char buf[128];
+  for (std::size_t b = 0; b < buffers_.size(); ++b) {
+    buffers_[b]->GetEvents(&events);
+    for (std::size_t i = 0; i < events.size(); ++i) {
+      const TraceEvent& e = events[i];
+      snprintf(buf, sizeof(buf), "\"ts\": %.3f, \"dur\": %.3f",
+               (e.begin_ns - start_ns_) / 1000.0, (e.end_ns - e.begin_ns) / 1000.0);
+      out << (first ? "" : ",\n")
+          << "{\"name\": \"" << JsonEscape(e.name) << "\", \"ph\": \"X\", \"pid\": "
+          << pid << ", \"tid\": " << buffers_[b]->GetThreadId() << ", " << buf;
+      if (e.arg != -1) {
+        out << ", \"args\": {\"i\": " << e.arg << "}";
+      }
+      out << "}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+}
+
+void Tracer::WriteFlatProfile(std::ostream& out) const {
+  std::map<std::string, ProfileEntry> profile;
+  uint64 num_dropped = 0;
+  std::vector<TraceEvent> events;
+  for (std::size_t b = 0; b < buffers_.size(); ++b) {
+    buffers_[b]->GetEvents(&events);
+    num_dropped += buffers_[b]->NumDropped();
+    std::sort(events.begin(), events.end(), BeginsEarlier);
+    // self time = own time minus the time of the direct children
+    std::vector<std::size_t> open; // enclosing spans
+    std::vector<uint64> child_ns(events.size(), 0);
+    for (std::size_t i = 0; i < events.size(); ++i) {
+      while (!open.empty() && events[open.back()].end_ns <= events[i].begin_ns) {
+        open.pop_back();
+      }
+      if (!open.empty()) {
+        child_ns[open.back()] += events[i].end_ns - events[i].begin_ns;
+      }
+      open.push_back(i);
+    }
+    for (std::size_t i = 0; i < events.size(); ++i) {
+      const uint64 dur = events[i].end_ns - events[i].begin_ns;
+      ProfileEntry& entry = profile[events[i].name];
+      ++entry.calls;
+      entry.total_ns += dur;
+      entry.self_ns += dur > child_ns[i] ? dur - child_ns[i] : 0;
+    }
+  }
+  std::vector< std::pair<std::string, ProfileEntry> > sorted(profile.begin(), profile.end());
+  std::sort(sorted.begin(), sorted.end(), MoreSelfTime);
+  char buf[256];
+  out << "# Flat profile (" << buffers_.size() << " threads";
+  if (num_dropped > 0) {
+    out << ", " << num_dropped << " oldest spans dropped";
+  }
+  out << "):" << std::endl;
+  snprintf(buf, sizeof(buf), "# %12s %12s %10s  %s", "self ms", "total ms", "calls", "name");
+  out << buf << std::endl;
+  for (std::size_t i = 0; i < sorted.size(); ++i) {
+    const ProfileEntry& e = sorted[i].second;
+    snprintf(buf, sizeof(buf), "# %12.2f %12.2f %10lu  %s",
+             e.self_ns / 1e6, e.total_ns / 1e6, (unsigned long)e.calls,
+             sorted[i].first.c_str());
+    out << buf << std::endl;
+  }
+}
+
+} } // end namespaces
@@ -0,0 +1,203 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Author: markus.dreyer@gmail.com (Markus Dreyer)
+//
+#ifndef FSTRAIN_UTIL_TRACE_H
+#define FSTRAIN_UTIL_TRACE_H
+
+#include <time.h>
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "fst/compat.h" // int64, uint64
+
+/**
+ * Scoped spans for profiling, e.g.
+ *
+ *   FSTR_TRACE_SPAN("compose");
+ *   FSTR_TRACE_SPAN_ARG("example", index);
+ *
+ * record the time from here to the end of the enclosing block. Spans
+ * are only compiled in with -DFSTRAIN_TRACE (cmake -DFSTRAIN_TRACE=ON)
+ * and only recorded between Tracer::Start and Tracer::Finish. The
+ * name must be a string literal (only the pointer is kept).
+ */
+#ifdef FSTRAIN_TRACE
+#define FSTR_TRACE_CONCAT_(a, b) a##b
+#define FSTR_TRACE_CONCAT(a, b) FSTR_TRACE_CONCAT_(a, b)
+#define FSTR_TRACE_SPAN(name) fstrain::util::TraceSpan FSTR_TRACE_CONCAT(fstr_trace_span_, __LINE__)(name)
+#define FSTR_TRACE_SPAN_ARG(name, arg) fstrain::util::TraceSpan FSTR_TRACE_CONCAT(fstr_trace_span_, __LINE__)(name, arg)
+#else
+#define FSTR_TRACE_SPAN(name)
+#define FSTR_TRACE_SPAN_ARG(name, arg)
+#endif
+
+namespace fstrain { namespace util {
+
+inline uint64 GetMonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+struct TraceEvent {
+  const char* name;
+  int64 arg;  // e.g. the example index; -1 if none
+  uint64 begin_ns;
+  uint64 end_ns;
+};
+
+/**
+ * @brief Ring buffer of the spans of one thread; when it is full the
+ * oldest spans are overwritten. The memory is allocated in chunks as
+ * the spans come in.
+ */
+class TraceBuffer : private boost::noncopyable {
+
+ public:
+  static const std::size_t kChunkSize = 4096; // events
+
+  TraceBuffer(int tid, std::size_t capacity)
+      : tid_(tid), capacity_(capacity), num_added_(0) {}
+
+  void Add(const char* name, int64 arg, uint64 begin_ns, uint64 end_ns) {
+    const std::size_t i = num_added_ % capacity_;
+    if (i / kChunkSize == chunks_.size()) {
+      chunks_.push_back(std::vector<TraceEvent>(kChunkSize));
+    }
+    TraceEvent& e = chunks_[i / kChunkSize][i % kChunkSize];
+    e.name = name;
+    e.arg = arg;
+    e.begin_ns = begin_ns;
+    e.end_ns = end_ns;
+    ++num_added_;
+  }
+
+  int GetThreadId() const {
+    return tid_;
+  }
+
+  /**
+   * @brief The spans still in the buffer.
+   */
+  void GetEvents(std::vector<TraceEvent>* events) const;
+
+  uint64 NumDropped() const {
+    return num_added_ > capacity_ ? num_added_ - capacity_ : 0;
+  }
+
+ private:
+  const int tid_;
+  const std::size_t capacity_;
+  std::vector< std::vector<TraceEvent> > chunks_;
+  uint64 num_added_;
+};
+
+/**
+ * @brief Collects the spans of all threads and writes them as a
+ * Chrome trace (chrome://tracing or ui.perfetto.dev), plus a flat
+ * profile (self and total time per span name).
+ *
+ * Start, Finish and the Write functions must not run while other
+ * threads are still recording.
+ */
+class Tracer : private boost::noncopyable {
+
+ public:
+  static Tracer& instance();
+
+  ~Tracer();
+
+  /**
+   * @brief Starts recording; Finish writes the trace to filename.
+   */
+  void Start(const std::string& filename,
+             std::size_t events_per_thread = 1 << 20);
+
+  /**
+   * @brief Stops recording, writes the trace file and prints the flat
+   * profile to stderr. Called at exit if still running.
+   */
+  void Finish();
+
+  bool IsRunning() const {
+    return running_;
+  }
+
+  /**
+   * @brief The buffer of the calling thread (on first use, one left
+   * by a thread that has exited, or a new one).
+   */
+  TraceBuffer* GetThreadBuffer();
+
+  /**
+   * @brief Called when a thread exits; a later thread will continue
+   * its buffer (under its thread ID in the trace).
+   */
+  void ReleaseThreadBuffer(TraceBuffer* buffer, int generation);
+
+  void WriteChromeTrace(std::ostream& out) const;
+
+  void WriteFlatProfile(std::ostream& out) const;
+
+ private:
+  Tracer() : running_(false), generation_(0), events_per_thread_(0), start_ns_(0) {}
+
+  volatile bool running_;
+  int generation_; // invalidates the buffers cached by threads
+  std::size_t events_per_thread_;
+  uint64 start_ns_;
+  std::string filename_;
+  boost::mutex mutex_;
+  std::vector< boost::shared_ptr<TraceBuffer> > buffers_;
+  std::vector<TraceBuffer*> free_buffers_; // of exited threads
+};
+
+/**
+ * @brief Records the time from construction to destruction (see
+ * FSTR_TRACE_SPAN).
+ */
+class TraceSpan : private boost::noncopyable {
+
+ public:
+  explicit TraceSpan(const char* name, int64 arg = -1)
+      : buffer_(NULL), name_(name), arg_(arg), begin_ns_(0) {
+    if (Tracer::instance().IsRunning()) {
+      buffer_ = Tracer::instance().GetThreadBuffer();
+      begin_ns_ = GetMonotonicNanos();
+    }
+  }
+
+  ~TraceSpan() {
+    if (buffer_ != NULL) {
+      buffer_->Add(name_, arg_, begin_ns_, GetMonotonicNanos());
+    }
+  }
+
+ private:
+  TraceBuffer* buffer_;
+  const char* name_;
+  int64 arg_;
+  uint64 begin_ns_;
+};
+
+} } // end namespaces
+
+#endif
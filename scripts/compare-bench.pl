@@ -0,0 +1,60 @@
+#!/usr/bin/perl -w
+
+# Compares two JSON files written by fstrain-bench and prints the
+# change in median ns/op per benchmark. Exits with status 1 if any
+# benchmark got slower by more than the threshold (in percent).
+#
+# Usage: compare-bench.pl [--threshold 10] baseline.json new.json
+
+use strict;
+use Getopt::Long;
+use JSON::PP;
+
+my $threshold = 10;
+
+GetOptions(
+	   "threshold=f" => \$threshold
+	  ) or die("options error");
+
+@ARGV == 2 or die("Usage: $0 [--threshold percent] baseline.json new.json\n");
+
+sub read_results {
+  my ($filename) = @_;
+  open(my $in, "<", $filename) or die("Could not open $filename: $!");
+  local $/;
+  my $json = decode_json(<$in>);
+  close($in);
+  my %ns_per_op;
+  foreach my $b (@{$json->{benchmarks}}) {
+    $ns_per_op{$b->{name}} = $b->{ns_per_op};
+  }
+  return \%ns_per_op;
+}
+
+my $old = read_results($ARGV[0]);
+my $new = read_results($ARGV[1]);
+
+my $num_regressions = 0;
+printf("%-32s %14s %14s %9s\n", "benchmark", "old ns/op", "new ns/op", "change");
+foreach my $name (sort keys %$new) {
+  if (!exists $old->{$name}) {
+    printf("%-32s %14s %14.1f %9s\n", $name, "-", $new->{$name}, "new");
+    next;
+  }
+  my $change = $old->{$name} > 0
+      ? 100.0 * ($new->{$name} - $old->{$name}) / $old->{$name} : 0.0;
+  my $is_regression = $change > $threshold;
+  $num_regressions++ if $is_regression;
+  printf("%-32s %14.1f %14.1f %+8.1f%%%s\n", $name, $old->{$name}, $new->{$name},
+         $change, $is_regression ? "  REGRESSION" : "");
+}
+foreach my $name (sort keys %$old) {
+  printf("%-32s %14.1f %14s %9s\n", $name, $old->{$name}, "-", "removed")
+      unless exists $new->{$name};
+}
+
+if ($num_regressions > 0) {
+  print STDERR "$num_regressions benchmark(s) slower by more than $threshold%\n";
+  exit 1;
+}
+exit 0;
@@ -0,0 +1,92 @@
+#!/usr/bin/perl -w
+
+# Generates a random corpus of string pairs and its symbol tables, for
+# scaling studies that should not depend on real data (see
+# scaling-sweep.pl).
+#
+# Each input string is drawn uniformly from the alphabet; its output
+# string is a copy with random substitutions, deletions and insertions,
+# so that alignment and n-gram models have something to learn.
+#
+# Writes <output>.train (input and output strings on alternating
+# lines, framed by S and E), <output>.isyms and <output>.osyms.
+
+use strict;
+use Getopt::Long;
+
+my $outstem;
+my $alphabetSize = 26;
+my $outputAlphabetSize;  # default: same as input
+my $numPairs = 1000;
+my $minLength = 3;
+my $maxLength = 10;
+my $editProb = 0.1;      # per position: substitution, half as often del/ins
+my $seed = 1;
+
+GetOptions(
+	   "output=s" => \$outstem,
+	   "alphabet-size=i" => \$alphabetSize,
+	   "output-alphabet-size=i" => \$outputAlphabetSize,
+	   "num-pairs=i" => \$numPairs,
+	   "min-length=i" => \$minLength,
+	   "max-length=i" => \$maxLength,
+	   "edit-prob=f" => \$editProb,
+	   "seed=i" => \$seed
+	  ) or die("options error");
+
+die("Please use --output") unless defined $outstem;
+die("Need 1 <= --min-length <= --max-length")
+    unless $minLength >= 1 && $minLength <= $maxLength;
+$outputAlphabetSize = $alphabetSize unless defined $outputAlphabetSize;
+
+srand($seed);
+
+my @isyms = GetSymbols($alphabetSize);
+my @osyms = GetSymbols($outputAlphabetSize);
+
+open(F, ">$outstem.train") or die("$outstem.train: $!");
+for (my $n = 0; $n < $numPairs; ++$n) {
+  my $len = $minLength + int(rand($maxLength - $minLength + 1));
+  my @in = map { int(rand($alphabetSize)) } (1..$len);
+  my @out;
+  foreach my $i (@in) {
+    my $r = rand();
+    if ($r < $editProb) {       # substitution
+      push(@out, int(rand($outputAlphabetSize)));
+    }
+    elsif ($r < 1.5 * $editProb) { # deletion
+    }
+    elsif ($r < 2.0 * $editProb) { # insertion
+      push(@out, $i % $outputAlphabetSize, int(rand($outputAlphabetSize)));
+    }
+    else {
+      push(@out, $i % $outputAlphabetSize);
+    }
+  }
+  @out = (int(rand($outputAlphabetSize))) unless @out;
+  print F join(" ", "S", (map { $isyms[$_] } @in), "E"), "\n";
+  print F join(" ", "S", (map { $osyms[$_] } @out), "E"), "\n";
+}
+close F;
+
+WriteSymbols(\@isyms, "$outstem.isyms");
+WriteSymbols(\@osyms, "$outstem.osyms");
+print STDERR "Wrote $numPairs pairs to $outstem.train\n";
+
+# Single letters if they suffice, otherwise s1, s2, ...
+sub GetSymbols {
+  my ($size) = @_;
+  return ('a'..'z')[0..$size-1] if $size <= 26;
+  return map { "s$_" } (1..$size);
+}
+
+sub WriteSymbols {
+  my ($symsref, $filename) = @_;
+  open(S, ">$filename") or die("$filename: $!");
+  print S "eps 0\n";
+  my $i = 0;
+  foreach my $sym (@$symsref, "S", "E") {
+    print S "$sym ", ++$i, "\n";
+  }
+  close S;
+}
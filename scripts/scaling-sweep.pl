@@ -0,0 +1,139 @@
+#!/usr/bin/perl -w
+
+# Measures how model creation, one training evaluation and decoding
+# scale with alphabet size, string length, n-gram order,
+# max-insertions and the feature set, on synthetic data from
+# gen-synthetic-data.pl. Run from the fstrain root directory.
+#
+# For each combination of the comma-separated values, creates a model
+# with train.R (--create=ngram: all n-grams, CreateNgramFst;
+# --create=align: n-grams seen in the aligned data,
+# CreateNgramFstFromBestAlign with simple alignments), stops after
+# one L-BFGS iteration, then decodes the training inputs. Prints one
+# tab-separated line per run; NA where a step failed.
+#
+# Example:
+#   ./scripts/scaling-sweep.pl --alphabet-sizes=10,20,40 \
+#     --lengths=5,10 --ngram-orders=1,2,3 > scaling.tsv
+
+use strict;
+use Getopt::Long;
+use Time::HiRes qw(time);
+
+my $alphabetSizes = "10,20";
+my $lengths = "5,10";
+my $ngramOrders = "1,2";
+my $maxInsertionsList = "-1";
+my $featuresList = "simple";
+my $createList = "ngram,align";
+my $numPairs = 200;
+my $editProb = 0.1;
+my $seed = 1;
+my $workDir = "scaling-sweep";
+my $binDir = "./Release/drivers";
+my $keep = 0;
+my $verbose = 1;
+
+GetOptions(
+	   "alphabet-sizes=s" => \$alphabetSizes,
+	   "lengths=s" => \$lengths,
+	   "ngram-orders=s" => \$ngramOrders,
+	   "max-insertions=s" => \$maxInsertionsList,
+	   "features=s" => \$featuresList,
+	   "create=s" => \$createList,
+	   "num-pairs=i" => \$numPairs,
+	   "edit-prob=f" => \$editProb,
+	   "seed=i" => \$seed,
+	   "work-dir=s" => \$workDir,
+	   "bin-dir=s" => \$binDir,
+	   "keep!" => \$keep,
+	   "verbose!" => \$verbose
+	  ) or die("options error");
+
+-d $workDir or mkdir($workDir) or die("$workDir: $!");
+
+# GNU time gives the peak memory of the decoder, which does not print it
+my $gnuTime = -x "/usr/bin/time" ? "/usr/bin/time -f '# maxrss %M' " : "";
+
+print join("\t", qw(create alphabet_size length ngram_order max_insertions features
+                    num_pairs num_params states arcs create_ms create_mb
+                    eval_ms eval_mb decode_ms decode_mb)), "\n";
+
+foreach my $alphabetSize (split /,/, $alphabetSizes) {
+  foreach my $length (split /,/, $lengths) {
+    my $data = "$workDir/data-a$alphabetSize-l$length";
+    safesystem("./scripts/gen-synthetic-data.pl --output=$data"
+	       . " --alphabet-size=$alphabetSize --num-pairs=$numPairs"
+	       . " --min-length=$length --max-length=$length"
+	       . " --edit-prob=$editProb --seed=$seed 2>/dev/null");
+    foreach my $create (split /,/, $createList) {
+      foreach my $ngramOrder (split /,/, $ngramOrders) {
+	foreach my $maxInsertions (split /,/, $maxInsertionsList) {
+	  foreach my $features (split /,/, $featuresList) {
+	    my $stem = "$data-$create-n$ngramOrder-i$maxInsertions-$features";
+	    $stem =~ s/\+/_/g;
+	    my $alignOpt = $create eq "align" ? "--align-fst=simple" : "";
+	    safesystem("./scripts/train.R --isymbols=$data.isyms --osymbols=$data.osyms"
+		       . " --train-data=$data.train --ngram-order=$ngramOrder"
+		       . " --max-insertions=$maxInsertions --features=$features"
+		       . " $alignOpt --force-convergence --lbfgs-max-iterations=1"
+		       . " --output=$stem >$stem.train.stdout 2>$stem.train.stderr");
+	    my %r = ParseTrainLog("$stem.train.stderr");
+	    my $start = time();
+	    my $ok = -f "$stem.fst"
+		&& safesystem("$gnuTime$binDir/transducer-decode --fst=$stem.fst"
+			      . " --isymbols=$data.isyms --osymbols=$data.osyms"
+			      . " $data.train >$stem.decode.stdout 2>$stem.decode.stderr");
+	    if ($ok) {
+	      $r{decode_ms} = sprintf("%.2f", 1000 * (time() - $start));
+	      $r{decode_mb} = ParseMaxRss("$stem.decode.stderr");
+	    }
+	    print join("\t", $create, $alphabetSize, $length, $ngramOrder,
+		       $maxInsertions, $features, $numPairs,
+		       map { defined $r{$_} ? $r{$_} : "NA" }
+		       qw(num_params states arcs create_ms create_mb
+			  eval_ms eval_mb decode_ms decode_mb)), "\n";
+	    unlink(glob("$stem.*")) unless $keep;
+	  }
+	}
+      }
+    }
+    unlink(glob("$data.*")) unless $keep;
+  }
+}
+
+# Reads the lines that the glue code and the objective function print
+sub ParseTrainLog {
+  my ($filename) = @_;
+  my %r;
+  open(F, $filename) or return %r;
+  while (<F>) {
+    if (/^# Created model FST with (\d+) states, (\d+) arcs \[([\d.]+) ms, ([\d.]+) MB\]/) {
+      @r{qw(states arcs create_ms create_mb)} = ($1, $2, $3, $4);
+    }
+    elsif (/^Found (\d+) params/) {
+      $r{num_params} = $1;
+    }
+    elsif (/^Returning .*\[([\d.]+) ms, ([\d.]+) MB\]/ && !defined $r{eval_ms}) {
+      @r{qw(eval_ms eval_mb)} = ($1, $2);
+    }
+  }
+  close F;
+  return %r;
+}
+
+sub ParseMaxRss {
+  my ($filename) = @_;
+  my $mb;
+  open(F, $filename) or return undef;
+  while (<F>) {
+    $mb = sprintf("%.2f", $1 / 1024) if /^# maxrss (\d+)/;
+  }
+  close F;
+  return $mb;
+}
+
+sub safesystem {
+  print STDERR "# Executing: @_\n" if($verbose);
+  return system(@_) == 0;
+}